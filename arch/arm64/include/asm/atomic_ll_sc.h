@@ -37,7 +37,7 @@
  * (the optimize attribute silently ignores these options).
  */
 #define ATOMIC_OP(op, asm_op)			\
-static inline void atomic_##op(int i, atomic_t *v)		\
+static inline void __ll_sc_atomic_##op(int i, atomic_t *v)		\
 {									\
 	unsigned long tmp;						\
 	int result;							\
@@ -53,7 +53,7 @@ static inline void atomic_##op(int i, atomic_t *v)		\
 }
 
 #define ATOMIC_OP_RETURN(name, mb, acq, rel, cl, op, asm_op)	\
-static inline int atomic_##op##_return##name(int i, atomic_t *v)	\
+static inline int __ll_sc_atomic_##op##_return##name(int i, atomic_t *v)	\
 {									\
 	unsigned long tmp;						\
 	int result;							\
@@ -73,7 +73,7 @@ static inline int atomic_##op##_return##name(int i, atomic_t *v)	\
 }
 
 #define ATOMIC_FETCH_OP(name, mb, acq, rel, cl, op, asm_op)		\
-static inline int atomic_fetch_##op##name(int i, atomic_t *v)	\
+static inline int __ll_sc_atomic_fetch_##op##name(int i, atomic_t *v)	\
 {									\
 	unsigned long tmp;						\
 	int val, result;						\
@@ -125,7 +125,7 @@ ATOMIC_OPS(xor, eor)
 #undef ATOMIC_OP
 
 #define ATOMIC64_OP(op, asm_op)						\
-static void atomic64_##op(long i, atomic64_t *v)			\
+static inline void __ll_sc_atomic64_##op(long i, atomic64_t *v)			\
 {									\
 	long result;							\
 	unsigned long tmp;						\
@@ -141,7 +141,7 @@ static void atomic64_##op(long i, atomic64_t *v)			\
 }
 
 #define ATOMIC64_OP_RETURN(name, mb, acq, rel, cl, op, asm_op)		\
-static inline long atomic64_##op##_return##name(long i, atomic64_t *v)	\
+static inline long __ll_sc_atomic64_##op##_return##name(long i, atomic64_t *v)	\
 {									\
 	long result;							\
 	unsigned long tmp;						\
@@ -161,7 +161,7 @@ static inline long atomic64_##op##_return##name(long i, atomic64_t *v)	\
 }
 
 #define ATOMIC64_FETCH_OP(name, mb, acq, rel, cl, op, asm_op)		\
-static inline long atomic64_fetch_##op##name(long i, atomic64_t *v)	\
+static inline long __ll_sc_atomic64_fetch_##op##name(long i, atomic64_t *v)	\
 {									\
 	long result, val;						\
 	unsigned long tmp;						\
@@ -212,7 +212,7 @@ ATOMIC64_OPS(xor, eor)
 #undef ATOMIC64_OP_RETURN
 #undef ATOMIC64_OP
 
-static inline long atomic64_dec_if_positive(atomic64_t *v)
+static inline long __ll_sc_atomic64_dec_if_positive(atomic64_t *v)
 {
 	long result;
 	unsigned long tmp;
@@ -234,7 +234,7 @@ static inline long atomic64_dec_if_positive(atomic64_t *v)
 }
 
 #define __CMPXCHG_CASE(w, sfx, name, sz, mb, acq, rel, cl)		\
-static inline u##sz __cmpxchg_case_##name##sz(volatile void *ptr,		\
+static inline u##sz __ll_sc__cmpxchg_case_##name##sz(volatile void *ptr,		\
 					 unsigned long old,		\
 					 u##sz new)			\
 {									\
@@ -286,7 +286,7 @@ __CMPXCHG_CASE( ,  ,  mb_, 64, dmb ish,  , l, "memory")
 #undef __CMPXCHG_CASE
 
 #define __CMPXCHG_DBL(name, mb, rel, cl)				\
-static inline long __cmpxchg_double##name(unsigned long old1,		\
+static inline long __ll_sc__cmpxchg_double##name(unsigned long old1,		\
 				      unsigned long old2,		\
 				      unsigned long new1,		\
 				      unsigned long new2,		\
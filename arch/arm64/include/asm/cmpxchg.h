@@ -21,6 +21,25 @@
 #include <linux/bug.h>
 
 #include <asm/barrier.h>
+#include <asm/lse.h>
+
+#if defined(CONFIG_AS_LSE) && defined(CONFIG_ARM64_LSE_ATOMICS)
+#define __LSE_XCHG_CASE(w, sfx, name, sz, acq, rel, cl)			\
+static inline u##sz __lse__xchg_case_##name##sz(u##sz x, volatile void *ptr)	\
+{									\
+	u##sz ret;							\
+									\
+	asm volatile(__LSE_PREAMBLE					\
+	"	swp" #acq #rel #sfx "\t%" #w "2, %" #w "0, %1\n"		\
+	: "=&r" (ret), "+Q" (*(u##sz *)ptr)				\
+	: "r" (x)							\
+	: cl);								\
+									\
+	return ret;							\
+}
+#else
+#define __LSE_XCHG_CASE(w, sfx, name, sz, acq, rel, cl)
+#endif
 
 /*
  * We need separate acquire parameters for ll/sc and lse, since the full
@@ -28,7 +47,7 @@
  * acquire+release for the latter.
  */
 #define __XCHG_CASE(w, sfx, name, sz, mb, nop_lse, acq, acq_lse, rel, cl)	\
-static inline u##sz __xchg_case_##name##sz(u##sz x, volatile void *ptr)		\
+static inline u##sz __ll_sc__xchg_case_##name##sz(u##sz x, volatile void *ptr)	\
 {										\
 	u##sz ret;								\
 	unsigned long tmp;							\
@@ -44,6 +63,12 @@ static inline u##sz __xchg_case_##name##sz(u##sz x, volatile void *ptr)		\
 	: cl);									\
 										\
 	return ret;								\
+}										\
+__LSE_XCHG_CASE(w, sfx, name, sz, acq_lse, rel, cl)				\
+										\
+static inline u##sz __xchg_case_##name##sz(u##sz x, volatile void *ptr)		\
+{										\
+	return __lse_ll_sc_body(_xchg_case_##name##sz, x, ptr);			\
 }
 
 __XCHG_CASE(w, b,     ,  8,        ,    ,  ,  ,  ,         )
@@ -64,6 +89,7 @@ __XCHG_CASE(w,  ,  mb_, 32, dmb ish, nop,  , a, l, "memory")
 __XCHG_CASE( ,  ,  mb_, 64, dmb ish, nop,  , a, l, "memory")
 
 #undef __XCHG_CASE
+#undef __LSE_XCHG_CASE
 
 #define __XCHG_GEN(sfx)							\
 static inline unsigned long __xchg##sfx(unsigned long x,		\
@@ -107,6 +133,50 @@ __XCHG_GEN(_mb)
 #define xchg_release(...)	__xchg_wrapper(_rel, __VA_ARGS__)
 #define xchg(...)		__xchg_wrapper( _mb, __VA_ARGS__)
 
+#define __CMPXCHG_CASE(name, sz)					\
+static inline u##sz __cmpxchg_case_##name##sz(volatile void *ptr,	\
+					      unsigned long old,	\
+					      u##sz new)		\
+{									\
+	return __lse_ll_sc_body(_cmpxchg_case_##name##sz,		\
+				ptr, old, new);				\
+}
+
+__CMPXCHG_CASE(    ,  8)
+__CMPXCHG_CASE(    , 16)
+__CMPXCHG_CASE(    , 32)
+__CMPXCHG_CASE(    , 64)
+__CMPXCHG_CASE(acq_,  8)
+__CMPXCHG_CASE(acq_, 16)
+__CMPXCHG_CASE(acq_, 32)
+__CMPXCHG_CASE(acq_, 64)
+__CMPXCHG_CASE(rel_,  8)
+__CMPXCHG_CASE(rel_, 16)
+__CMPXCHG_CASE(rel_, 32)
+__CMPXCHG_CASE(rel_, 64)
+__CMPXCHG_CASE(mb_,  8)
+__CMPXCHG_CASE(mb_, 16)
+__CMPXCHG_CASE(mb_, 32)
+__CMPXCHG_CASE(mb_, 64)
+
+#undef __CMPXCHG_CASE
+
+#define __CMPXCHG_DBL(name)						\
+static inline long __cmpxchg_double##name(unsigned long old1,		\
+					  unsigned long old2,		\
+					  unsigned long new1,		\
+					  unsigned long new2,		\
+					  volatile void *ptr)		\
+{									\
+	return __lse_ll_sc_body(_cmpxchg_double##name,			\
+				old1, old2, new1, new2, ptr);		\
+}
+
+__CMPXCHG_DBL(   )
+__CMPXCHG_DBL(_mb)
+
+#undef __CMPXCHG_DBL
+
 #define __CMPXCHG_GEN(sfx)						\
 static inline unsigned long __cmpxchg##sfx(volatile void *ptr,		\
 					   unsigned long old,		\
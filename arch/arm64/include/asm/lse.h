@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef __ASM_LSE_H
+#define __ASM_LSE_H
+
+#include <linux/compiler.h>
+#include <linux/types.h>
+
+#define __ARM64_IN_ATOMIC_IMPL
+
+#include <asm/atomic_ll_sc.h>
+
+#if defined(CONFIG_AS_LSE) && defined(CONFIG_ARM64_LSE_ATOMICS)
+
+#define __LSE_PREAMBLE	".arch_extension lse\n"
+
+#include <asm/atomic_lse.h>
+
+/*
+ * Set by setup_cpufeature() once ID_AA64ISAR0_EL1 reports the ARMv8.1
+ * atomics. The LL/SC sequences remain correct against concurrent LSE
+ * accesses, so flipping it while other atomics are in flight is fine.
+ */
+extern bool arm64_use_lse_atomics;
+
+static inline bool system_uses_lse_atomics(void)
+{
+	return likely(arm64_use_lse_atomics);
+}
+
+#define __lse_ll_sc_body(op, ...)					\
+({									\
+	system_uses_lse_atomics() ?					\
+		__lse_##op(__VA_ARGS__) :				\
+		__ll_sc_##op(__VA_ARGS__);				\
+})
+
+#else	/* CONFIG_AS_LSE && CONFIG_ARM64_LSE_ATOMICS */
+
+static inline bool system_uses_lse_atomics(void)
+{
+	return false;
+}
+
+#define __lse_ll_sc_body(op, ...)	__ll_sc_##op(__VA_ARGS__)
+
+#endif	/* CONFIG_AS_LSE && CONFIG_ARM64_LSE_ATOMICS */
+
+#undef __ARM64_IN_ATOMIC_IMPL
+
+#endif	/* __ASM_LSE_H */
@@ -10,6 +10,12 @@
 extern struct pglist_data *node_data[];
 #define NODE_DATA(nid)		(node_data[(nid)])
 
-extern void __init map_vmemmap(pgd_t *pgdp, phys_addr_t phys, 
-								unsigned long virt, size_t size);
+struct vmemmap_stat {
+	unsigned long mapped;	/* bytes of vmemmap mapped for the node */
+	unsigned long blocks;	/* in that many blocks (i.e. TLB entries) */
+	unsigned long remote;	/* of which were allocated off-node */
+};
+
+extern int __init vmemmap_populate(unsigned long start, unsigned long end,
+				   int node, struct vmemmap_stat *stat);
 #endif /* __ASM_MMZONE_H */
@@ -87,8 +87,8 @@ static inline void __pgd_populate(pgd_t *pgdp, phys_addr_t pudp, pgdval_t prot)
 }
 #endif	/* CONFIG_PGTABLE_LEVELS > 3 */
 
-extern pgd_t *pgd_alloc(struct mm_struct *mm); /* TODO */
-extern void pgd_free(struct mm_struct *mm, pgd_t *pgdp); /* TODO */
+extern pgd_t *pgd_alloc(struct mm_struct *mm);
+extern void pgd_free(struct mm_struct *mm, pgd_t *pgdp);
 
 static inline pte_t *
 pte_alloc_one_kernel(struct mm_struct *mm)
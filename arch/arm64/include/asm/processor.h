@@ -35,6 +35,12 @@
 #include <asm/types.h>
 
 #ifdef __KERNEL__
+/*
+ * TASK_SIZE - the maximum size of a user space task.
+ */
+#define TASK_SIZE_64		(UL(1) << VA_BITS)
+#define TASK_SIZE		TASK_SIZE_64
+
 #define STACK_TOP_MAX		TASK_SIZE_64
 #ifdef CONFIG_COMPAT
 #define AARCH32_VECTORS_BASE	0xffff0000
@@ -135,7 +141,6 @@ static inline void cpu_relax(void)
 
 #define cpu_relax_lowlatency()                cpu_relax()
 
-/* TODO asm-generic/switch_to.h */
 /* Thread switching */
 extern struct task_struct *cpu_switch_to(struct task_struct *prev,
 					 struct task_struct *next);
@@ -49,4 +49,8 @@ extern void *memset(void *, int, __kernel_size_t);
 #define __HAVE_ARCH_MEMCMP
 extern int memcmp(const void *, const void *, size_t);
 
+#define __HAVE_ARCH_MEMTEST
+extern void __memtest_fill(u64 *start, u64 *end, u64 pattern);
+extern u64 *__memtest_check(u64 *start, u64 *end, u64 pattern);
+
 #endif
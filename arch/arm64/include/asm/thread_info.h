@@ -23,6 +23,7 @@
 
 #include <linux/compiler.h>
 #include <linux/sizes.h>
+#include <asm/current.h>
 #include <asm/memory.h>
 
 #define THREAD_START_SP		(THREAD_SIZE - 16)
@@ -72,14 +73,15 @@ struct thread_info {
 register unsigned long current_stack_pointer asm ("sp");
 
 /*
- * how to get the thread information struct from C
+ * how to get the thread information struct from C: it is the first
+ * member of the task_struct that sp_el0 points to, wherever the task's
+ * stack is.
  */
 static inline struct thread_info *current_thread_info(void) __attribute_const__;
 
 static inline struct thread_info *current_thread_info(void)
 {
-	return (struct thread_info *)
-		(current_stack_pointer & ~(THREAD_SIZE - 1));
+	return (struct thread_info *)get_current();
 }
 
 #define thread_saved_pc(tsk)	\
@@ -21,11 +21,18 @@
 #include <linux/cache.h>
 #include <linux/types.h>
 #include <linux/init.h>
+#include <linux/printk.h>
 
 #include <asm/hwcap.h>
+#include <asm/lse.h>
+#include <asm/sysreg.h>
 
 unsigned long elf_hwcap __read_mostly;
 
+#if defined(CONFIG_AS_LSE) && defined(CONFIG_ARM64_LSE_ATOMICS)
+bool arm64_use_lse_atomics __ro_after_init;
+#endif
+
 #ifdef CONFIG_COMPAT
 #define COMPAT_ELF_HWCAP_DEFAULT	\
 				(COMPAT_HWCAP_HALF|COMPAT_HWCAP_THUMB|\
@@ -37,7 +44,7 @@ unsigned int compat_elf_hwcap __read_mostly = COMPAT_ELF_HWCAP_DEFAULT;
 unsigned int compat_elf_hwcap2 __read_mostly;
 #endif
 
-static void __init setup_cpufeature(void)
+static int __init setup_cpufeature(void)
 {
 	u64 features, block;
 
@@ -75,6 +82,16 @@ static void __init setup_cpufeature(void)
 	if (block && !(block & 0x8))
 		elf_hwcap |= HWCAP_CRC32;
 
+	/* 0b0010: LDADD, CAS, CASP, SWP and friends are implemented */
+	block = (features >> ID_AA64ISAR0_ATOMICS_SHIFT) & 0xf;
+	if (block >= 2 && !(block & 0x8)) {
+		elf_hwcap |= HWCAP_ATOMICS;
+#if defined(CONFIG_AS_LSE) && defined(CONFIG_ARM64_LSE_ATOMICS)
+		arm64_use_lse_atomics = true;
+		pr_info("using LSE atomic instructions\n");
+#endif
+	}
+
 #ifdef CONFIG_COMPAT
 	/*
 	 * ID_ISAR5_EL1 carries similar information as above, but pertaining to
@@ -106,5 +123,92 @@ static void __init setup_cpufeature(void)
 	if (block && !(block & 0x8))
 		compat_elf_hwcap2 |= COMPAT_HWCAP2_CRC32;
 #endif
+	return 0;
 }
 arch_initcall(setup_cpufeature);
+
+#if defined(CONFIG_TEST_LSE_ATOMICS) && defined(CONFIG_AS_LSE)
+#include <linux/atomic.h>
+#include <linux/boot_test.h>
+
+/* Call the LSE or the LL/SC implementation of @op directly */
+#define lse_test_op(lse, op, ...)					\
+	((lse) ? __lse_##op(__VA_ARGS__) : __ll_sc_##op(__VA_ARGS__))
+
+/* Signed overflow wraps, and subtracting the minimum negates nothing */
+static void __init lse_test_wrap(struct boot_test *t, bool lse)
+{
+	atomic_t v = ATOMIC_INIT(INT_MAX);
+	atomic64_t v64 = ATOMIC64_INIT(0);
+
+	BOOT_TEST_EXPECT(t, lse_test_op(lse, atomic_add_return, 1, &v) ==
+			    INT_MIN);
+	BOOT_TEST_EXPECT(t, lse_test_op(lse, atomic_sub_return, 1, &v) ==
+			    INT_MAX);
+	BOOT_TEST_EXPECT(t, lse_test_op(lse, atomic64_sub_return, LONG_MIN,
+					&v64) == LONG_MIN);
+	BOOT_TEST_EXPECT(t, lse_test_op(lse, atomic64_fetch_sub, LONG_MIN,
+					&v64) == LONG_MIN);
+	BOOT_TEST_EXPECT(t, atomic64_read(&v64) == 0);
+}
+
+/* Never stores unless the result is non-negative */
+static void __init lse_test_dec_if_positive(struct boot_test *t, bool lse)
+{
+	atomic64_t v = ATOMIC64_INIT(1);
+
+	BOOT_TEST_EXPECT(t, lse_test_op(lse, atomic64_dec_if_positive, &v) ==
+			    0);
+	BOOT_TEST_EXPECT(t, lse_test_op(lse, atomic64_dec_if_positive, &v) ==
+			    -1);
+	BOOT_TEST_EXPECT(t, atomic64_read(&v) == 0);
+
+	atomic64_set(&v, LONG_MIN);
+	lse_test_op(lse, atomic64_dec_if_positive, &v);
+	BOOT_TEST_EXPECT(t, atomic64_read(&v) == LONG_MIN);
+}
+
+/*
+ * A sub-word cmpxchg compares only its own bits of @old, leaves its
+ * neighbours alone and returns the current value when it fails.
+ */
+static void __init lse_test_cmpxchg(struct boot_test *t, bool lse)
+{
+	union {
+		u64 word;
+		u8 bytes[8];
+	} v = { .word = 0x1122334455667788 };
+	u64 word = ~0UL;
+
+	BOOT_TEST_EXPECT(t, lse_test_op(lse, _cmpxchg_case_mb_8,
+					&v.bytes[1], 0xff00 | 0x77, 0xaa) ==
+			    0x77);
+	BOOT_TEST_EXPECT(t, v.word == 0x112233445566aa88);
+
+	BOOT_TEST_EXPECT(t, lse_test_op(lse, _cmpxchg_case_mb_16,
+					&v.bytes[2], 0x6665, 0) == 0x5566);
+	BOOT_TEST_EXPECT(t, v.word == 0x112233445566aa88);
+
+	BOOT_TEST_EXPECT(t, lse_test_op(lse, _cmpxchg_case_mb_64, &word,
+					~0UL, 0) == ~0UL);
+	BOOT_TEST_EXPECT(t, !word);
+}
+
+/*
+ * Check the edge cases of both implementations: the LL/SC one always,
+ * the LSE one when the cpu has the instructions. Either may be the one
+ * in use depending on the cpu, so both have to agree.
+ */
+static void __init lse_test(struct boot_test *t)
+{
+	bool lse = false;
+
+	do {
+		lse_test_wrap(t, lse);
+		lse_test_dec_if_positive(t, lse);
+		lse_test_cmpxchg(t, lse);
+		lse = !lse;
+	} while (lse && system_uses_lse_atomics());
+}
+boot_test(lse_test);
+#endif /* CONFIG_TEST_LSE_ATOMICS && CONFIG_AS_LSE */
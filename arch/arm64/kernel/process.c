@@ -20,12 +20,33 @@
 
 #include <stdarg.h>
 #include <linux/sched.h>
+#include <linux/sched/task.h>
+#include <linux/sched/task_stack.h>
 #include <linux/percpu.h>
 #include <linux/reboot.h>
+#include <linux/cpu.h>
+#include <linux/irqflags.h>
+
+#include <asm/mmu_context.h>
+#include <asm/proc-fns.h>
+#include <asm/switch_to.h>
 
 void (*arm_pm_restart)(enum reboot_mode reboot_mode, const char *cmd);
 void (*pm_power_off)(void);
 
+/*
+ * This is our default idle handler.
+ */
+void arch_cpu_idle(void)
+{
+	/*
+	 * This should do all the clock switching and wait for interrupt
+	 * tricks
+	 */
+	cpu_do_idle();
+	local_irq_enable();
+}
+
 /*
  * Called from setup_new_exec() after (COMPAT_)SET_PERSONALITY.
  */
@@ -46,3 +67,60 @@ unsigned long get_wchan(struct task_struct *p)
  */
 DEFINE_PER_CPU(struct task_struct *, __entry_task);
 
+asmlinkage void ret_from_fork(void) asm("ret_from_fork");
+
+/*
+ * Only kernel threads are created so far: ret_from_fork calls x19 with
+ * x20 as its argument, and the function never returns to the empty
+ * pt_regs at the top of the new stack.
+ */
+int copy_thread(unsigned long clone_flags, unsigned long stack_start,
+		unsigned long stk_sz, struct task_struct *p)
+{
+	struct pt_regs *childregs = task_pt_regs(p);
+
+	if (WARN_ON(!(p->flags & PF_KTHREAD)))
+		return -EINVAL;
+
+	memset(&p->thread.cpu_context, 0, sizeof(struct cpu_context));
+	memset(childregs, 0, sizeof(struct pt_regs));
+	childregs->pstate = PSR_MODE_EL1h;
+
+	p->thread.cpu_context.x19 = stack_start;
+	p->thread.cpu_context.x20 = stk_sz;
+	p->thread.cpu_context.pc = (unsigned long)ret_from_fork;
+	p->thread.cpu_context.sp = (unsigned long)childregs;
+
+	return 0;
+}
+
+static void entry_task_switch(struct task_struct *next)
+{
+	__this_cpu_write(__entry_task, next);
+}
+
+/*
+ * Thread switching.
+ */
+struct task_struct *__switch_to(struct task_struct *prev,
+				struct task_struct *next)
+{
+	struct task_struct *last;
+
+	contextidr_thread_switch(next);
+	entry_task_switch(next);
+
+	/*
+	 * Complete any pending TLB or cache maintenance on this CPU in case
+	 * the thread migrates to a different CPU.
+	 * This full barrier is also required by the membarrier system
+	 * call.
+	 */
+	dsb(ish);
+
+	/* the actual thread switch */
+	last = cpu_switch_to(prev, next);
+
+	return last;
+}
+
@@ -29,6 +29,7 @@
 #include <asm/daifflags.h>
 #include <asm/fixmap.h>
 #include <asm/sections.h>
+#include <asm/topology.h>
 #include <asm/early_ioremap.h>
 #include <asm/mmu_context.h>
 
@@ -215,6 +216,7 @@ void __init setup_arch(char **cmdline_p)
 
 	cpu_read_bootcpu_ops();
 	smp_init_cpus();
+	init_cpu_topology();
 
 	if (boot_args[1] || boot_args[2] || boot_args[3]) {
 		pr_err("WARNING: x1-x3 nonzero in violation of boot protocol:\n"
@@ -0,0 +1,114 @@
+/*
+ * arch/arm64/kernel/topology.c
+ *
+ * CPU topology for the scheduler, derived from the MPIDR values that
+ * of_parse_and_init_cpus() recorded in the logical map. Based on the
+ * arm implementation.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file "COPYING" in the main directory of this archive
+ * for more details.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/numa.h>
+
+#include <asm/cputype.h>
+#include <asm/smp_plat.h>
+#include <asm/topology.h>
+
+struct cpu_topology cpu_topology[NR_CPUS];
+
+const struct cpumask *cpu_coregroup_mask(int cpu)
+{
+	const cpumask_t *core_mask = cpumask_of_node(cpu_to_node(cpu));
+
+	/* Find the smaller of NUMA or core siblings */
+	if (cpumask_subset(&cpu_topology[cpu].core_sibling, core_mask))
+		core_mask = &cpu_topology[cpu].core_sibling;
+
+	return core_mask;
+}
+
+static void __init update_siblings_masks(unsigned int cpuid)
+{
+	struct cpu_topology *cpu_topo, *cpuid_topo = &cpu_topology[cpuid];
+	int cpu;
+
+	/* update core and thread sibling masks */
+	for_each_possible_cpu(cpu) {
+		cpu_topo = &cpu_topology[cpu];
+
+		if (cpuid_topo->package_id != cpu_topo->package_id)
+			continue;
+
+		cpumask_set_cpu(cpuid, &cpu_topo->core_sibling);
+		cpumask_set_cpu(cpu, &cpuid_topo->core_sibling);
+
+		if (cpuid_topo->core_id != cpu_topo->core_id)
+			continue;
+
+		cpumask_set_cpu(cpuid, &cpu_topo->thread_sibling);
+		cpumask_set_cpu(cpu, &cpuid_topo->thread_sibling);
+	}
+}
+
+/*
+ * Only the boot CPU has run by the time the topology is needed, so the
+ * MT bit of its own MPIDR decides how the affinity levels of every
+ * logical map entry are interpreted: Aff0 is the thread within a core
+ * on multi-threaded parts and the core within a cluster otherwise.
+ */
+static void __init store_cpu_topology(unsigned int cpuid, bool mt)
+{
+	struct cpu_topology *cpuid_topo = &cpu_topology[cpuid];
+	u64 mpidr = cpu_logical_map(cpuid);
+
+	if (mpidr == INVALID_HWID) {
+		/* Give CPUs without a usable hwid a package of their own */
+		cpuid_topo->thread_id  = -1;
+		cpuid_topo->core_id    = 0;
+		cpuid_topo->package_id = -1 - (int)cpuid;
+	} else if (mt) {
+		/* Multiprocessor system : Multi-threads per core */
+		cpuid_topo->thread_id  = MPIDR_AFFINITY_LEVEL(mpidr, 0);
+		cpuid_topo->core_id    = MPIDR_AFFINITY_LEVEL(mpidr, 1);
+		cpuid_topo->package_id = MPIDR_AFFINITY_LEVEL(mpidr, 2) |
+					 MPIDR_AFFINITY_LEVEL(mpidr, 3) << 8;
+	} else {
+		/* Multiprocessor system : Single-thread per core */
+		cpuid_topo->thread_id  = -1;
+		cpuid_topo->core_id    = MPIDR_AFFINITY_LEVEL(mpidr, 0);
+		cpuid_topo->package_id = MPIDR_AFFINITY_LEVEL(mpidr, 1) |
+					 MPIDR_AFFINITY_LEVEL(mpidr, 2) << 8 |
+					 MPIDR_AFFINITY_LEVEL(mpidr, 3) << 16;
+	}
+
+	pr_debug("CPU%u: cluster %d core %d thread %d mpidr %#016llx\n",
+		 cpuid, cpuid_topo->package_id, cpuid_topo->core_id,
+		 cpuid_topo->thread_id, mpidr);
+}
+
+/*
+ * Called once the logical map and the CPU to node mapping have been
+ * parsed from the DT. Fills in the sibling masks of every possible CPU
+ * and the node masks that the scheduler domains are built from.
+ */
+void __init init_cpu_topology(void)
+{
+	u64 mpidr = read_cpuid_mpidr();
+	bool mt = !(mpidr & MPIDR_UP_BITMASK) && (mpidr & MPIDR_MT_BITMASK);
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		cpumask_clearall_cpu(&cpu_topology[cpu].thread_sibling);
+		cpumask_clearall_cpu(&cpu_topology[cpu].core_sibling);
+		store_cpu_topology(cpu, mt);
+	}
+
+	for_each_possible_cpu(cpu) {
+		update_siblings_masks(cpu);
+		numa_add_cpu(cpu);
+	}
+}
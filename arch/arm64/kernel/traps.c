@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <linux/kernel.h>
 #include <linux/types.h>
 #include <linux/smp.h>
 
@@ -115,7 +116,9 @@ asmlinkage void bad_mode(struct pt_regs *regs, int reason, unsigned int esr)
 
 asmlinkage void __exception do_undefinstr(struct pt_regs *regs)
 {
+	oops_enter();
 	pr_err("%s regs %p\n", __func__, regs);
+	oops_exit();
 }
 
 asmlinkage void __exception do_sysinstr(unsigned int esr, struct pt_regs *regs)
@@ -19,30 +19,517 @@
  */
 #include <linux/kernel.h>
 #include <linux/init.h>
+#include <linux/mm.h>
 #include <linux/printk.h>
+#include <linux/sched.h>
+#include <linux/signal.h>
+#include <linux/sizes.h>
 
 #include <asm/exception.h>
+#include <asm/pgtable.h>
+#include <asm/processor.h>
 #include <asm/ptrace.h>
 #include <asm/sysreg.h>
+#include <asm/tlbflush.h>
 
+struct fault_info {
+	int	(*fn)(unsigned long addr, unsigned int esr,
+		      struct pt_regs *regs);
+	int	sig;
+	const char *name;
+};
+
+static const struct fault_info fault_info[];
+
+static inline const struct fault_info *esr_to_fault_info(unsigned int esr)
+{
+	return fault_info + (esr & ESR_ELx_FSC);
+}
+
+static void data_abort_decode(unsigned int esr)
+{
+	pr_alert("Data abort info:\n");
+
+	if (esr & ESR_ELx_ISV) {
+		pr_alert("  Access size = %u byte(s)\n",
+			 1U << ((esr & ESR_ELx_SAS) >> ESR_ELx_SAS_SHIFT));
+		pr_alert("  SSE = %lu, SRT = %lu\n",
+			 (esr & ESR_ELx_SSE) >> ESR_ELx_SSE_SHIFT,
+			 (esr & ESR_ELx_SRT_MASK) >> ESR_ELx_SRT_SHIFT);
+		pr_alert("  SF = %lu, AR = %lu\n",
+			 (esr & ESR_ELx_SF) >> ESR_ELx_SF_SHIFT,
+			 (esr & ESR_ELx_AR) >> ESR_ELx_AR_SHIFT);
+	} else {
+		pr_alert("  ISV = 0, ISS = 0x%08lx\n", esr & ESR_ELx_ISS_MASK);
+	}
+
+	pr_alert("  CM = %lu, WnR = %lu\n",
+		 (esr & ESR_ELx_CM) >> ESR_ELx_CM_SHIFT,
+		 (esr & ESR_ELx_WNR) >> ESR_ELx_WNR_SHIFT);
+}
+
+static void mem_abort_decode(unsigned int esr)
+{
+	pr_alert("Mem abort info:\n");
+
+	pr_alert("  ESR = 0x%08x\n", esr);
+	pr_alert("  Exception class = %s, IL = %u bits\n",
+		 esr_get_class_string(esr),
+		 (esr & ESR_ELx_IL) ? 32 : 16);
+	pr_alert("  SET = %lu, FnV = %lu\n",
+		 (esr & ESR_ELx_SET_MASK) >> ESR_ELx_SET_SHIFT,
+		 (esr & ESR_ELx_FnV) >> ESR_ELx_FnV_SHIFT);
+	pr_alert("  EA = %lu, S1PTW = %lu\n",
+		 (esr & ESR_ELx_EA) >> ESR_ELx_EA_SHIFT,
+		 (esr & ESR_ELx_S1PTW) >> ESR_ELx_S1PTW_SHIFT);
+
+	if (esr_is_data_abort(esr))
+		data_abort_decode(esr);
+}
+
+static inline bool is_ttbr0_addr(unsigned long addr)
+{
+	/* entry assembly clears tags for TTBR0 addrs */
+	return addr < TASK_SIZE;
+}
+
+static inline bool is_ttbr1_addr(unsigned long addr)
+{
+	/* TTBR1 addresses may have a tag if KASAN_SW_TAGS is in use */
+	return addr >= VA_START;
+}
+
+/*
+ * Dump out the page tables associated with 'addr' in the currently active mm.
+ */
+static void show_pte(unsigned long addr)
+{
+	struct mm_struct *mm;
+	pgd_t *pgdp;
+	pgd_t pgd;
+
+	if (is_ttbr0_addr(addr)) {
+		/* TTBR0 */
+		mm = current->active_mm;
+		if (mm == &init_mm) {
+			pr_alert("[%016lx] user address but active_mm is swapper\n",
+				 addr);
+			return;
+		}
+	} else if (is_ttbr1_addr(addr)) {
+		/* TTBR1 */
+		mm = &init_mm;
+	} else {
+		pr_alert("[%016lx] address between user and kernel address ranges\n",
+			 addr);
+		return;
+	}
+
+	pr_alert("%s pgtable: %luk pages, %u-bit VAs, pgdp = %p\n",
+		 mm == &init_mm ? "swapper" : "user", PAGE_SIZE / SZ_1K,
+		 VA_BITS, mm->pgd);
+	pgdp = pgd_offset(mm, addr);
+	pgd = READ_ONCE(*pgdp);
+	pr_alert("[%016lx] pgd=%016llx", addr, pgd_val(pgd));
+
+	do {
+		pud_t *pudp, pud;
+		pmd_t *pmdp, pmd;
+		pte_t *ptep, pte;
+
+		if (pgd_none(pgd) || pgd_bad(pgd))
+			break;
+
+		pudp = pud_offset(pgdp, addr);
+		pud = READ_ONCE(*pudp);
+		pr_cont(", pud=%016llx", pud_val(pud));
+		if (pud_none(pud) || pud_bad(pud))
+			break;
+
+		pmdp = pmd_offset(pudp, addr);
+		pmd = READ_ONCE(*pmdp);
+		pr_cont(", pmd=%016llx", pmd_val(pmd));
+		if (pmd_none(pmd) || pmd_bad(pmd))
+			break;
+
+		ptep = pte_offset_map(pmdp, addr);
+		pte = READ_ONCE(*ptep);
+		pr_cont(", pte=%016llx", pte_val(pte));
+		pte_unmap(ptep);
+	} while(0);
+
+	pr_cont("\n");
+}
+
+/*
+ * This function sets the access flags (dirty, accessed), as well as write
+ * permission, and only to a more permissive setting.
+ *
+ * It needs to cope with hardware update of the accessed/dirty state by other
+ * agents in the system and can safely skip the __sync_icache_dcache() call as,
+ * like set_pte_at(), the PTE is never changed from no-exec to exec here.
+ *
+ * Returns whether or not the PTE actually changed.
+ */
+int ptep_set_access_flags(struct vm_area_struct *vma,
+			  unsigned long address, pte_t *ptep,
+			  pte_t entry, int dirty)
+{
+	pteval_t old_pteval, pteval;
+	pte_t pte = READ_ONCE(*ptep);
+
+	if (pte_same(pte, entry))
+		return 0;
+
+	/* only preserve the access flags and write permission */
+	pte_val(entry) &= PTE_RDONLY | PTE_AF | PTE_WRITE | PTE_DIRTY;
+
+	/*
+	 * Setting the flags must be done atomically to avoid racing with the
+	 * hardware update of the access/dirty state. The PTE_RDONLY bit must
+	 * be set to the most permissive (lowest value) of *ptep and entry
+	 * (calculated as: a & b == ~(~a | ~b)).
+	 */
+	pte_val(entry) ^= PTE_RDONLY;
+	pteval = pte_val(pte);
+	do {
+		old_pteval = pteval;
+		pteval ^= PTE_RDONLY;
+		pteval |= pte_val(entry);
+		pteval ^= PTE_RDONLY;
+		pteval = cmpxchg_relaxed(&pte_val(*ptep), old_pteval, pteval);
+	} while (pteval != old_pteval);
+
+	/* Invalidate a stale read-only entry */
+	if (dirty)
+		flush_tlb_page(vma, address);
+	return 1;
+}
+
+static bool is_el1_instruction_abort(unsigned int esr)
+{
+	return ESR_ELx_EC(esr) == ESR_ELx_EC_IABT_CUR;
+}
+
+static inline bool is_el1_permission_fault(unsigned long addr, unsigned int esr,
+					   struct pt_regs *regs)
+{
+	unsigned int ec       = ESR_ELx_EC(esr);
+	unsigned int fsc_type = esr & ESR_ELx_FSC_TYPE;
+
+	if (ec != ESR_ELx_EC_DABT_CUR && ec != ESR_ELx_EC_IABT_CUR)
+		return false;
+
+	if (fsc_type == ESR_ELx_FSC_PERM)
+		return true;
+
+	return false;
+}
+
+static void die_kernel_fault(const char *msg, unsigned long addr,
+			     unsigned int esr, struct pt_regs *regs)
+{
+	pr_alert("Unable to handle kernel %s at virtual address %016lx\n", msg,
+		 addr);
+
+	mem_abort_decode(esr);
+
+	show_pte(addr);
+	panic("%s: pc 0x%llx", msg, regs->pc);
+}
+
+static void __do_kernel_fault(unsigned long addr, unsigned int esr,
+			      struct pt_regs *regs)
+{
+	const char *msg;
+
+	if (is_el1_permission_fault(addr, esr, regs)) {
+		if (esr & ESR_ELx_WNR)
+			msg = "write to read-only memory";
+		else if (is_el1_instruction_abort(esr))
+			msg = "execute from non-executable memory";
+		else
+			msg = "read from unreadable memory";
+	} else if (addr < PAGE_SIZE) {
+		msg = "NULL pointer dereference";
+	} else {
+		msg = "paging request";
+	}
+
+	die_kernel_fault(msg, addr, esr, regs);
+}
+
+static void __do_user_fault(const struct fault_info *inf, unsigned long addr,
+			    unsigned int esr)
+{
+	pr_alert("%s[%d]: unhandled %s (%d) at 0x%016lx, esr 0x%08x\n",
+		 current->comm, current->pid, inf->name, inf->sig, addr, esr);
+	mem_abort_decode(esr);
+	show_pte(addr);
+
+	/*
+	 * There is no signal delivery in this tree, so a user fault that
+	 * can not be handled is fatal.
+	 */
+	panic("Attempted to kill %s on %s", current->comm, inf->name);
+}
+
+static void do_bad_area(unsigned long addr, unsigned int esr, struct pt_regs *regs)
+{
+	/*
+	 * If we are in kernel mode at this point, we have no context to
+	 * handle this fault with.
+	 */
+	if (user_mode(regs))
+		__do_user_fault(esr_to_fault_info(esr), addr, esr);
+	else
+		__do_kernel_fault(addr, esr, regs);
+}
+
+#define VM_FAULT_BADMAP		0x010000
+#define VM_FAULT_BADACCESS	0x020000
+
+static vm_fault_t __do_page_fault(struct mm_struct *mm, unsigned long addr,
+			   unsigned int mm_flags, unsigned long vm_flags)
+{
+	struct vm_area_struct *vma = find_vma(mm, addr);
+
+	if (unlikely(!vma))
+		return VM_FAULT_BADMAP;
+
+	/*
+	 * There is no stack expansion, so an address below the VMA is
+	 * simply unmapped.
+	 */
+	if (unlikely(vma->vm_start > addr))
+		return VM_FAULT_BADMAP;
+
+	/*
+	 * Check that the permissions on the VMA allow for the fault which
+	 * occurred.
+	 */
+	if (!(vma->vm_flags & vm_flags))
+		return VM_FAULT_BADACCESS;
+
+	return handle_mm_fault(vma, addr & PAGE_MASK, mm_flags);
+}
+
+static bool is_el0_instruction_abort(unsigned int esr)
+{
+	return ESR_ELx_EC(esr) == ESR_ELx_EC_IABT_LOW;
+}
+
+/*
+ * Note: not valid for EL1 DC IVAC, but we never use that such that it
+ * should fault. EL0 cannot issue DC IVAC (undef).
+ */
+static bool is_write_abort(unsigned int esr)
+{
+	return (esr & ESR_ELx_WNR) && !(esr & ESR_ELx_CM);
+}
+
+static int do_page_fault(unsigned long addr, unsigned int esr,
+			 struct pt_regs *regs)
+{
+	struct mm_struct *mm = current->mm;
+	vm_fault_t fault;
+	unsigned long vm_flags = VM_READ | VM_WRITE;
+	unsigned int mm_flags = 0;
+
+	/*
+	 * If we're in an interrupt or have no user context, we must not take
+	 * the fault.
+	 */
+	if (in_interrupt() || !mm)
+		goto no_context;
+
+	if (user_mode(regs))
+		mm_flags |= FAULT_FLAG_USER;
+
+	if (is_el0_instruction_abort(esr)) {
+		vm_flags = VM_EXEC;
+		mm_flags |= FAULT_FLAG_INSTRUCTION;
+	} else if (is_write_abort(esr)) {
+		vm_flags = VM_WRITE;
+		mm_flags |= FAULT_FLAG_WRITE;
+	}
+
+	if (is_ttbr0_addr(addr) && is_el1_permission_fault(addr, esr, regs)) {
+		if (is_el1_instruction_abort(esr))
+			die_kernel_fault("execution of user memory",
+					 addr, esr, regs);
+	}
+
+	fault = __do_page_fault(mm, addr, mm_flags, vm_flags);
+
+	/*
+	 * Handle the "normal" (no error) case first.
+	 */
+	if (likely(!(fault & (VM_FAULT_ERROR | VM_FAULT_BADMAP |
+			      VM_FAULT_BADACCESS))))
+		return 0;
+
+	/*
+	 * If we are in kernel mode at this point, we have no context to
+	 * handle this fault with.
+	 */
+	if (!user_mode(regs))
+		goto no_context;
+
+	if (fault & VM_FAULT_OOM) {
+		/*
+		 * We ran out of memory; there is no OOM killer to pick a
+		 * victim, so treat it like any other fatal user fault.
+		 */
+		pr_err("Out of memory handling fault at 0x%016lx\n", addr);
+	}
+
+	__do_user_fault(esr_to_fault_info(esr), addr, esr);
+	return 0;
+
+no_context:
+	__do_kernel_fault(addr, esr, regs);
+	return 0;
+}
+
+static int do_translation_fault(unsigned long addr, unsigned int esr,
+				struct pt_regs *regs)
+{
+	if (is_ttbr0_addr(addr))
+		return do_page_fault(addr, esr, regs);
+
+	do_bad_area(addr, esr, regs);
+	return 0;
+}
+
+static int do_alignment_fault(unsigned long addr, unsigned int esr,
+			      struct pt_regs *regs)
+{
+	do_bad_area(addr, esr, regs);
+	return 0;
+}
+
+static int do_bad(unsigned long addr, unsigned int esr, struct pt_regs *regs)
+{
+	return 1; /* "fault" */
+}
+
+static int do_sea(unsigned long addr, unsigned int esr, struct pt_regs *regs)
+{
+	const struct fault_info *inf = esr_to_fault_info(esr);
+
+	pr_err("Synchronous External Abort: %s (0x%08x) at 0x%016lx\n",
+	       inf->name, esr, addr);
+
+	return 1;
+}
+
+static const struct fault_info fault_info[] = {
+	{ do_bad,		SIGKILL, "ttbr address size fault"	},
+	{ do_bad,		SIGKILL, "level 1 address size fault"	},
+	{ do_bad,		SIGKILL, "level 2 address size fault"	},
+	{ do_bad,		SIGKILL, "level 3 address size fault"	},
+	{ do_translation_fault,	SIGSEGV, "level 0 translation fault"	},
+	{ do_translation_fault,	SIGSEGV, "level 1 translation fault"	},
+	{ do_translation_fault,	SIGSEGV, "level 2 translation fault"	},
+	{ do_translation_fault,	SIGSEGV, "level 3 translation fault"	},
+	{ do_bad,		SIGKILL, "unknown 8"			},
+	{ do_page_fault,	SIGSEGV, "level 1 access flag fault"	},
+	{ do_page_fault,	SIGSEGV, "level 2 access flag fault"	},
+	{ do_page_fault,	SIGSEGV, "level 3 access flag fault"	},
+	{ do_bad,		SIGKILL, "unknown 12"			},
+	{ do_page_fault,	SIGSEGV, "level 1 permission fault"	},
+	{ do_page_fault,	SIGSEGV, "level 2 permission fault"	},
+	{ do_page_fault,	SIGSEGV, "level 3 permission fault"	},
+	{ do_sea,		SIGBUS,  "synchronous external abort"	},
+	{ do_bad,		SIGKILL, "unknown 17"			},
+	{ do_bad,		SIGKILL, "unknown 18"			},
+	{ do_bad,		SIGKILL, "unknown 19"			},
+	{ do_sea,		SIGKILL, "level 0 (translation table walk)"	},
+	{ do_sea,		SIGKILL, "level 1 (translation table walk)"	},
+	{ do_sea,		SIGKILL, "level 2 (translation table walk)"	},
+	{ do_sea,		SIGKILL, "level 3 (translation table walk)"	},
+	{ do_sea,		SIGBUS,  "synchronous parity or ECC error" },	// Reserved when RAS is implemented
+	{ do_bad,		SIGKILL, "unknown 25"			},
+	{ do_bad,		SIGKILL, "unknown 26"			},
+	{ do_bad,		SIGKILL, "unknown 27"			},
+	{ do_sea,		SIGKILL, "level 0 synchronous parity error (translation table walk)"	},	// Reserved when RAS is implemented
+	{ do_sea,		SIGKILL, "level 1 synchronous parity error (translation table walk)"	},	// Reserved when RAS is implemented
+	{ do_sea,		SIGKILL, "level 2 synchronous parity error (translation table walk)"	},	// Reserved when RAS is implemented
+	{ do_sea,		SIGKILL, "level 3 synchronous parity error (translation table walk)"	},	// Reserved when RAS is implemented
+	{ do_bad,		SIGKILL, "unknown 32"			},
+	{ do_alignment_fault,	SIGBUS,  "alignment fault"		},
+	{ do_bad,		SIGKILL, "unknown 34"			},
+	{ do_bad,		SIGKILL, "unknown 35"			},
+	{ do_bad,		SIGKILL, "unknown 36"			},
+	{ do_bad,		SIGKILL, "unknown 37"			},
+	{ do_bad,		SIGKILL, "unknown 38"			},
+	{ do_bad,		SIGKILL, "unknown 39"			},
+	{ do_bad,		SIGKILL, "unknown 40"			},
+	{ do_bad,		SIGKILL, "unknown 41"			},
+	{ do_bad,		SIGKILL, "unknown 42"			},
+	{ do_bad,		SIGKILL, "unknown 43"			},
+	{ do_bad,		SIGKILL, "unknown 44"			},
+	{ do_bad,		SIGKILL, "unknown 45"			},
+	{ do_bad,		SIGKILL, "unknown 46"			},
+	{ do_bad,		SIGKILL, "unknown 47"			},
+	{ do_bad,		SIGKILL, "TLB conflict abort"		},
+	{ do_bad,		SIGKILL, "Unsupported atomic hardware update fault"	},
+	{ do_bad,		SIGKILL, "unknown 50"			},
+	{ do_bad,		SIGKILL, "unknown 51"			},
+	{ do_bad,		SIGKILL, "implementation fault (lockdown abort)" },
+	{ do_bad,		SIGBUS,  "implementation fault (unsupported exclusive)" },
+	{ do_bad,		SIGKILL, "unknown 54"			},
+	{ do_bad,		SIGKILL, "unknown 55"			},
+	{ do_bad,		SIGKILL, "unknown 56"			},
+	{ do_bad,		SIGKILL, "unknown 57"			},
+	{ do_bad,		SIGKILL, "unknown 58" 			},
+	{ do_bad,		SIGKILL, "unknown 59"			},
+	{ do_bad,		SIGKILL, "unknown 60"			},
+	{ do_bad,		SIGKILL, "section domain fault"		},
+	{ do_bad,		SIGKILL, "page domain fault"		},
+	{ do_bad,		SIGKILL, "unknown 63"			},
+};
+
+/*
+ * Decode the fault status code from the ESR and dispatch to the matching
+ * handler. Anonymous user memory is demand-paged through do_page_fault(),
+ * everything the handlers cannot resolve is fatal.
+ */
 asmlinkage void __exception do_mem_abort(unsigned long addr, unsigned int esr,
 					 struct pt_regs *regs)
 {
-	panic("%s addr 0x%lx, esr 0x%x, regs %p\n", __func__, addr, esr, regs);
+	const struct fault_info *inf = esr_to_fault_info(esr);
+
+	if (!inf->fn(addr, esr, regs))
+		return;
+
+	if (!user_mode(regs)) {
+		pr_alert("Unhandled fault at 0x%016lx\n", addr);
+		mem_abort_decode(esr);
+		show_pte(addr);
+		panic("%s (0x%08x) at 0x%016lx", inf->name, esr, addr);
+	}
+
+	__do_user_fault(inf, addr, esr);
 }
 
 asmlinkage void __exception do_sp_pc_abort(unsigned long addr,
 					   unsigned int esr,
 					   struct pt_regs *regs)
 {
+	oops_enter();
 	pr_warn("%s addr 0x%lx, esr 0x%x, regs %p\n", __func__, addr, esr, regs);
+	oops_exit();
 }
 
 asmlinkage int __exception do_debug_exception(unsigned long addr,
 					      unsigned int esr,
 					      struct pt_regs *regs)
 {
+	oops_enter();
 	pr_warn("%s addr 0x%lx, esr 0x%x, regs %p\n", __func__, addr, esr, regs);
+	oops_exit();
 
 	return 0;
 }
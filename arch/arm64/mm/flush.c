@@ -1,4 +1,6 @@
 #include <linux/types.h>
+#include <linux/mm.h>
+
 #include <asm/cacheflush.h>
 #include <asm/cache.h>
 
@@ -18,6 +20,15 @@ void sync_icache_aliases(void *kaddr, unsigned long len)
 	}
 }
 
+void __sync_icache_dcache(pte_t pte)
+{
+	struct page *page = pte_page(pte);
+
+	if (!test_and_set_bit(PG_dcache_clean, &page->flags))
+		sync_icache_aliases(page_address(page),
+				    PAGE_SIZE << compound_order(page));
+}
+
 /*
  * This function is called when a page has been modified by the kernel. Mark
  * it as dirty for later flushing when mapped in user space (if executable,
@@ -198,12 +198,13 @@ void __init bootmem_init(void)
 	min = PFN_UP(memblock_start_of_DRAM());
 	max = PFN_DOWN(memblock_end_of_DRAM());
 
-	early_memtest(min << PAGE_SHIFT, max << PAGE_SHIFT);
-
 	max_pfn = max_low_pfn = max;
 
 	arm64_numa_init();
 
+	/* after NUMA init, so that the free ranges carry their node */
+	early_memtest(min << PAGE_SHIFT, max << PAGE_SHIFT);
+
 	vmemmap_init();
 
 	zone_sizes_init(min, max);
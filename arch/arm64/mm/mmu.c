@@ -34,6 +34,7 @@
 #include <asm/pgalloc.h>
 #include <asm/boot.h>
 #include <asm/mmu_context.h>
+#include <asm/arch_timer.h>
 
 #define NO_BLOCK_MAPPINGS	BIT(0)
 #define NO_CONT_MAPPINGS	BIT(1)
@@ -107,6 +108,82 @@ static phys_addr_t __init early_pgtable_alloc(void)
 	return phys;
 }
 
+/*
+ * Page tables for the mappings set up by paging_init() are carved out of
+ * this pool first. It lives in the kernel image, which is mapped from
+ * the start, so its tables can be zeroed and filled in place through
+ * the image mapping, instead of being mapped one at a time through a
+ * fixmap slot at the cost of a TLBI per table. Only once the pool runs
+ * dry do we fall back to early_pgtable_alloc(); whatever is left over
+ * is handed back to memblock at the end of paging_init().
+ */
+#define PGTABLE_POOL_PAGES	64
+
+static u8 pgtable_pool[PGTABLE_POOL_PAGES * PAGE_SIZE] __page_aligned_bss;
+static unsigned int pgtable_pool_used __initdata;
+static unsigned int pgtable_fixmap_allocs __initdata;
+
+static inline bool pgtable_in_pool(phys_addr_t phys)
+{
+	return phys - __pa_symbol(pgtable_pool) < sizeof(pgtable_pool);
+}
+
+static inline bool pgtable_ptr_in_pool(void *ptr)
+{
+	return (unsigned long)ptr - (unsigned long)pgtable_pool <
+		sizeof(pgtable_pool);
+}
+
+static phys_addr_t __init pool_pgtable_alloc(void)
+{
+	/* .bss is already zeroed */
+	if (pgtable_pool_used < PGTABLE_POOL_PAGES)
+		return __pa_symbol(pgtable_pool) +
+			pgtable_pool_used++ * PAGE_SIZE;
+
+	pgtable_fixmap_allocs++;
+	return early_pgtable_alloc();
+}
+
+/*
+ * Map a table for writing: pool tables are reached through the kernel
+ * image mapping, anything else through the matching fixmap slot.
+ */
+static inline void *pgtable_map(phys_addr_t phys, enum fixed_addresses idx)
+{
+	if (pgtable_in_pool(phys))
+		return (void *)__phys_to_kimg(phys);
+	return (void *)set_fixmap_offset(idx, phys);
+}
+
+static inline void pgtable_unmap(void *ptr, enum fixed_addresses idx)
+{
+	if (!pgtable_ptr_in_pool(ptr))
+		clear_fixmap(idx);
+}
+
+#define pte_map_offset(pmdp, addr)	\
+	((pte_t *)pgtable_map(pte_offset_phys(pmdp, addr), FIX_PTE))
+#define pte_unmap_offset(ptep)		pgtable_unmap(ptep, FIX_PTE)
+
+#if CONFIG_PGTABLE_LEVELS > 2
+#define pmd_map_offset(pudp, addr)	\
+	((pmd_t *)pgtable_map(pmd_offset_phys(pudp, addr), FIX_PMD))
+#define pmd_unmap_offset(pmdp)		pgtable_unmap(pmdp, FIX_PMD)
+#else
+#define pmd_map_offset(pudp, addr)	pmd_set_fixmap_offset(pudp, addr)
+#define pmd_unmap_offset(pmdp)		pmd_clear_fixmap()
+#endif
+
+#if CONFIG_PGTABLE_LEVELS > 3
+#define pud_map_offset(pgdp, addr)	\
+	((pud_t *)pgtable_map(pud_offset_phys(pgdp, addr), FIX_PUD))
+#define pud_unmap_offset(pudp)		pgtable_unmap(pudp, FIX_PUD)
+#else
+#define pud_map_offset(pgdp, addr)	pud_set_fixmap_offset(pgdp, addr)
+#define pud_unmap_offset(pudp)		pud_clear_fixmap()
+#endif
+
 static bool pgattr_change_is_safe(u64 old, u64 new)
 {
 	/*
@@ -133,9 +210,9 @@ static bool pgattr_change_is_safe(u64 old, u64 new)
 static void init_pte(pmd_t *pmdp, unsigned long addr, unsigned long end,
 		     phys_addr_t phys, pgprot_t prot)
 {
-	pte_t *ptep;
+	pte_t *ptep, *table;
 
-	ptep = pte_set_fixmap_offset(pmdp, addr);
+	table = ptep = pte_map_offset(pmdp, addr);
 	do {
 		pte_t old_pte = READ_ONCE(*ptep);
 
@@ -151,7 +228,7 @@ static void init_pte(pmd_t *pmdp, unsigned long addr, unsigned long end,
 		phys += PAGE_SIZE;
 	} while (ptep++, addr += PAGE_SIZE, addr != end);
 
-	pte_clear_fixmap();
+	pte_unmap_offset(table);
 }
 
 static void alloc_init_cont_pte(pmd_t *pmdp, unsigned long addr,
@@ -194,9 +271,9 @@ static void init_pmd(pud_t *pudp, unsigned long addr, unsigned long end,
 		     phys_addr_t (*pgtable_alloc)(void), int flags)
 {
 	unsigned long next;
-	pmd_t *pmdp;
+	pmd_t *pmdp, *table;
 
-	pmdp = pmd_set_fixmap_offset(pudp, addr);
+	table = pmdp = pmd_map_offset(pudp, addr);
 	do {
 		pmd_t old_pmd = READ_ONCE(*pmdp);
 
@@ -223,7 +300,7 @@ static void init_pmd(pud_t *pudp, unsigned long addr, unsigned long end,
 		phys += next - addr;
 	} while (pmdp++, addr = next, addr != end);
 
-	pmd_clear_fixmap();
+	pmd_unmap_offset(table);
 }
 
 static void alloc_init_cont_pmd(pud_t *pudp, unsigned long addr,
@@ -281,7 +358,7 @@ static void alloc_init_pud(pgd_t *pgdp, unsigned long addr, unsigned long end,
 			   int flags)
 {
 	unsigned long next;
-	pud_t *pudp;
+	pud_t *pudp, *table;
 	pgd_t pgd = READ_ONCE(*pgdp);
 
 	if (pgd_none(pgd)) {
@@ -293,7 +370,7 @@ static void alloc_init_pud(pgd_t *pgdp, unsigned long addr, unsigned long end,
 	}
 	BUG_ON(pgd_bad(pgd));
 
-	pudp = pud_set_fixmap_offset(pgdp, addr);
+	table = pudp = pud_map_offset(pgdp, addr);
 	do {
 		pud_t old_pud = READ_ONCE(*pudp);
 
@@ -322,7 +399,7 @@ static void alloc_init_pud(pgd_t *pgdp, unsigned long addr, unsigned long end,
 		phys += next - addr;
 	} while (pudp++, addr = next, addr != end);
 
-	pud_clear_fixmap();
+	pud_unmap_offset(table);
 }
 
 static void __create_pgd_mapping(pgd_t *pgdir, phys_addr_t phys,
@@ -417,7 +494,7 @@ static void __init __map_memblock(pgd_t *pgdp, phys_addr_t start,
 				  phys_addr_t end, pgprot_t prot, int flags)
 {
 	__create_pgd_mapping(pgdp, start, __phys_to_virt(start), end - start,
-			     prot, early_pgtable_alloc, flags);
+			     prot, pool_pgtable_alloc, flags);
 }
 
 void __init mark_linear_text_alias_ro(void)
@@ -500,7 +577,7 @@ static void __init map_kernel_segment(pgd_t *pgdp, void *va_start, void *va_end,
 	BUG_ON(!PAGE_ALIGNED(size));
 
 	__create_pgd_mapping(pgdp, pa_start, (unsigned long)va_start, size, prot,
-			     early_pgtable_alloc, flags);
+			     pool_pgtable_alloc, flags);
 
 	if (!(vm_flags & VM_NO_GUARD))
 		size += PAGE_SIZE;
@@ -574,6 +651,7 @@ static void __init map_kernel(pgd_t *pgdp)
  */
 void __init paging_init(void)
 {
+	u64 start = arch_counter_get_cntvct();
 	pgd_t *pgdp = pgd_set_fixmap(__pa_symbol(swapper_pg_dir));
 
 	map_kernel(pgdp);
@@ -587,7 +665,18 @@ void __init paging_init(void)
 	memblock_free(__pa_symbol(init_pg_dir),
 		      __pa_symbol(init_pg_end) - __pa_symbol(init_pg_dir));
 
+	/* Give back the part of the table pool we didn't need */
+	if (pgtable_pool_used < PGTABLE_POOL_PAGES)
+		memblock_free(__pa_symbol(pgtable_pool) +
+			      pgtable_pool_used * PAGE_SIZE,
+			      (PGTABLE_POOL_PAGES - pgtable_pool_used) * PAGE_SIZE);
+
 	memblock_allow_resize();
+
+	pr_info("paging_init: %llu us, %u page tables from the pool, %u through the fixmap\n",
+		(arch_counter_get_cntvct() - start) * USEC_PER_SEC /
+		arch_timer_get_cntfrq(),
+		pgtable_pool_used, pgtable_fixmap_allocs);
 }
 
 /*
@@ -631,55 +720,49 @@ int kern_addr_valid(unsigned long addr)
 	return pfn_valid(pte_pfn(pte));
 }
 
-#if 0 /* TODO */
-#if !ARM64_SWAPPER_USES_SECTION_MAPS
-int __meminit vmemmap_populate(unsigned long start, unsigned long end, int node,
-		struct vmem_altmap *altmap)
-{
-	return vmemmap_populate_basepages(start, end, node);
-}
-#else	/* !ARM64_SWAPPER_USES_SECTION_MAPS */
-int __meminit vmemmap_populate(unsigned long start, unsigned long end, int node,
-		struct vmem_altmap *altmap)
-{
-	unsigned long addr = start;
-	unsigned long next;
-	pgd_t *pgdp;
-	pud_t *pudp;
-	pmd_t *pmdp;
-
-	do {
-		next = pmd_addr_end(addr, end);
-
-		pgdp = vmemmap_pgd_populate(addr, node);
-		if (!pgdp)
-			return -ENOMEM;
+#if ARM64_SWAPPER_USES_SECTION_MAPS
+#define VMEMMAP_BLOCK_SIZE	PMD_SIZE
+#else
+#define VMEMMAP_BLOCK_SIZE	PAGE_SIZE
+#endif
 
-		pudp = vmemmap_pud_populate(pgdp, addr, node);
-		if (!pudp)
-			return -ENOMEM;
+/*
+ * Back the vmemmap range [start, end) with memory from @node, one
+ * section (or page, where the swapper doesn't use section maps) at a
+ * time, so that each block costs a single TLB entry and struct page
+ * walks stay node local. A block straddling a node boundary has
+ * already been populated by the previous node and is left alone.
+ */
+int __init vmemmap_populate(unsigned long start, unsigned long end, int node,
+			    struct vmemmap_stat *stat)
+{
+	unsigned long addr = start & ~(VMEMMAP_BLOCK_SIZE - 1);
+	phys_addr_t phys;
 
-		pmdp = pmd_offset(pudp, addr);
-		if (pmd_none(READ_ONCE(*pmdp))) {
-			void *p = NULL;
+	for (; addr < end; addr += VMEMMAP_BLOCK_SIZE) {
+		if (kern_addr_valid(addr))
+			continue;
 
-			p = vmemmap_alloc_block_buf(PMD_SIZE, node);
-			if (!p)
+		phys = memblock_phys_alloc_nid(VMEMMAP_BLOCK_SIZE,
+					       VMEMMAP_BLOCK_SIZE, node);
+		if (!phys) {
+			phys = __memblock_alloc_base(VMEMMAP_BLOCK_SIZE,
+						     VMEMMAP_BLOCK_SIZE,
+						     MEMBLOCK_ALLOC_ACCESSIBLE);
+			if (!phys)
 				return -ENOMEM;
+			stat->remote++;
+		}
 
-			pmd_set_huge(pmdp, __pa(p), __pgprot(PROT_SECT_NORMAL));
-		} else
-			vmemmap_verify((pte_t *)pmdp, node, addr, next);
-	} while (addr = next, addr != end);
+		__create_pgd_mapping(init_mm.pgd, phys, addr,
+				     VMEMMAP_BLOCK_SIZE, PAGE_KERNEL,
+				     early_pgtable_alloc, NO_CONT_MAPPINGS);
+		stat->mapped += VMEMMAP_BLOCK_SIZE;
+		stat->blocks++;
+	}
 
 	return 0;
 }
-#endif	/* CONFIG_ARM64_64K_PAGES */
-void vmemmap_free(unsigned long start, unsigned long end,
-		struct vmem_altmap *altmap)
-{
-}
-#endif
 
 static inline pud_t *fixmap_pud(unsigned long addr)
 {
@@ -957,10 +1040,3 @@ int pud_free_pmd_page(pud_t *pudp, unsigned long addr)
 	pmd_free(NULL, table);
 	return 1;
 }
-
-void __init map_vmemmap(pgd_t *pgdp, phys_addr_t phys, 
-								unsigned long virt, size_t size)
-{
-	__create_pgd_mapping(pgdp, phys, virt, size,
-			PAGE_KERNEL, early_pgtable_alloc, NO_CONT_MAPPINGS);
-}
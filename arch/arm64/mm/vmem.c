@@ -1,22 +1,39 @@
 #include <linux/numa.h>
 #include <linux/memblock.h>
+#include <linux/mm.h>
+
+#include <asm/mmzone.h>
 
 void vmemmap_init(void)
 {
 	int nid;
 	size_t size;
 	unsigned long virt;
-	phys_addr_t phys;
+	struct vmemmap_stat stat;
 
 	/* Finally register nodes. */
 	for_each_node_mask(nid, &numa_nodes_parsed) {
 		unsigned long start_pfn, end_pfn;
 
 		get_pfn_range_for_nid(nid, &start_pfn, &end_pfn);
+		if (start_pfn >= end_pfn)
+			continue;
 
 		size = (end_pfn - start_pfn) * sizeof(struct page);
 		virt = (unsigned long)pfn_to_page(start_pfn);
-		phys = memblock_phys_alloc(size, PAGE_SIZE);
-		map_vmemmap(init_mm.pgd, phys, virt, size);
+
+		memset(&stat, 0, sizeof(stat));
+		if (vmemmap_populate(virt, virt + size, nid, &stat))
+			panic("Failed to map memmap for node %d\n", nid);
+
+		/*
+		 * Report what the node's struct pages cost: the memmap proper,
+		 * the memory mapped to back it and the TLB entries needed to
+		 * cover it (one per block, against one per page without
+		 * section mappings).
+		 */
+		pr_info("vmemmap: node %d: memmap %zu KB, mapped %lu KB in %lu TLB entries (%lu with base pages), %lu off-node\n",
+			nid, size >> 10, stat.mapped >> 10, stat.blocks,
+			DIV_ROUND_UP(size, PAGE_SIZE), stat.remote);
 	}
-}
\ No newline at end of file
+}
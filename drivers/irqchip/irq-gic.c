@@ -255,42 +255,274 @@ static int gic_set_affinity(struct irq_data *d, const struct cpumask *mask_val,
 {
 	void __iomem *reg = gic_dist_base(d) + GIC_DIST_TARGET + (gic_irq(d) & ~3);
 	unsigned int cpu, shift = (gic_irq(d) % 4) * 8;
-	u32 val, mask;
+	u32 val, mask, bit;
 	unsigned long flags;
 
 	if (!force)
-	;
-	//	cpu = cpumask_any_and(mask_val, cpu_online_mask);
+		cpu = cpumask_any_and(mask_val, cpu_online_mask);
 	else
 		cpu = cpumask_first(mask_val);
 
-	//if (cpu >= NR_GIC_CPU_IF || cpu >= nr_possible_cpu_ids)
-	//	return -EINVAL;
+	/*
+	 * GICD_ITARGETSR has a bit for each of the first NR_GIC_CPU_IF
+	 * cpu interfaces only, anything above cannot be targeted at all.
+	 */
+	if (cpu >= NR_GIC_CPU_IF || cpu >= nr_possible_cpu_ids)
+		return -EINVAL;
 
 	gic_lock_irqsave(flags);
 	mask = 0xff << shift;
-	//bit = gic_cpu_map[cpu] << shift;
+	bit = gic_cpu_map[cpu] << shift;
 	val = readl_relaxed(reg) & ~mask;
-	//writel_relaxed(val | bit, reg);
+	writel_relaxed(val | bit, reg);
 	gic_unlock_irqrestore(flags);
 
-	//irq_data_update_effective_affinity(d, cpumask_of(cpu));
+	irq_data_update_effective_affinity(d, cpumask_of(cpu));
 
 	return IRQ_SET_MASK_OK_DONE;
 }
 #endif
 
+#ifdef CONFIG_TEST_GIC_SGI_DISPATCH
+#include <linux/boot_test.h>
+#include <linux/hrtimer.h>
+#include <asm/arch_timer.h>
+
+/*
+ * While the test runs, SGI 15 is mapped in the GIC domain like a PPI and
+ * gic_handle_irq() sends it through handle_domain_irq(). A self-SGI then
+ * goes down the whole dispatch path, from the GICD_SGIR write through the
+ * hwirq to descriptor lookup to the handler.
+ */
+#define GIC_SGI_TEST		15
+#define GIC_SGI_TEST_GROW	3
+#define GIC_SGI_TEST_READ_NS	5000
+
+static bool gic_sgi_test_armed;
+static DEFINE_PER_CPU(unsigned int, gic_sgi_test_taken);
+static struct irq_desc *gic_sgi_test_desc __initdata;
+static unsigned int gic_sgi_test_virq __initdata;
+static unsigned int gic_sgi_test_reads __initdata;
+static unsigned int gic_sgi_test_stale __initdata;
+
+static inline bool gic_sgi_test_irq(u32 irqnr)
+{
+	return unlikely(irqnr == GIC_SGI_TEST && READ_ONCE(gic_sgi_test_armed));
+}
+
+static irqreturn_t gic_sgi_test_handler(int irq, void *dev_id)
+{
+	unsigned int *taken = dev_id;
+
+	WRITE_ONCE(*taken, *taken + 1);
+	return IRQ_HANDLED;
+}
+
+/* Send a self-SGI and give it 10ms to reach the handler */
+static bool __init gic_sgi_test_send(void __iomem *dist)
+{
+	unsigned int *taken = this_cpu_ptr(&gic_sgi_test_taken);
+	unsigned int before = READ_ONCE(*taken);
+	u64 t0 = arch_counter_get_cntvct();
+	u64 timeout = arch_timer_get_cntfrq() / 100;
+
+	/* TargetListFilter 0b10: forward to the requesting cpu only */
+	writel_relaxed(2 << 24 | GIC_SGI_TEST, dist + GIC_DIST_SOFTINT);
+	while (READ_ONCE(*taken) == before) {
+		if (arch_counter_get_cntvct() - t0 > timeout)
+			return false;
+		cpu_relax();
+	}
+	return true;
+}
+
+/* Reads the SGI descriptor back from interrupt context, like the entry path */
+static enum hrtimer_restart __init gic_sgi_test_reader(struct hrtimer *timer)
+{
+	gic_sgi_test_reads++;
+	if (irq_to_desc(gic_sgi_test_virq) != gic_sgi_test_desc)
+		gic_sgi_test_stale++;
+	hrtimer_forward_now(timer, ns_to_ktime(GIC_SGI_TEST_READ_NS));
+	return HRTIMER_RESTART;
+}
+
+/*
+ * Grow the descriptor table by allocating past its end, with the reader
+ * timer firing meanwhile. One landing between the table being copied and
+ * published reads the old table, which must stay intact.
+ */
+static void __init gic_sgi_test_grow(struct boot_test *t, void __iomem *dist)
+{
+	int grown[GIC_SGI_TEST_GROW];
+	struct hrtimer reader;
+	int i, from = 512;
+
+	hrtimer_init(&reader, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	reader.function = gic_sgi_test_reader;
+	hrtimer_start(&reader, ns_to_ktime(GIC_SGI_TEST_READ_NS),
+		      HRTIMER_MODE_REL);
+
+	for (i = 0; i < GIC_SGI_TEST_GROW; i++) {
+		grown[i] = irq_alloc_descs_from(from, 1, first_online_node);
+		if (!BOOT_TEST_EXPECT(t, grown[i] >= from))
+			break;
+		BOOT_TEST_EXPECT(t, irq_to_desc(gic_sgi_test_virq) ==
+				    gic_sgi_test_desc);
+		BOOT_TEST_EXPECT(t, gic_sgi_test_send(dist));
+		from = 2 * grown[i];
+	}
+
+	hrtimer_cancel(&reader);
+	BOOT_TEST_EXPECT(t, gic_sgi_test_reads);
+	BOOT_TEST_EXPECT(t, !gic_sgi_test_stale);
+
+	while (--i >= 0)
+		irq_free_desc(grown[i]);
+}
+
+static void __init gic_sgi_test(struct boot_test *t)
+{
+	struct gic_chip_data *gic = &gic_data[0];
+	void __iomem *dist = gic_data_dist_base(gic);
+	unsigned int virq;
+
+	/*
+	 * The chip's EOI writes the bare SGI number, which only matches
+	 * the IAR value of a self-SGI sent from cpu interface 0.
+	 */
+	if (!gic->domain || gic_cpu_map[smp_processor_id()] != 1)
+		return;
+
+	virq = irq_create_mapping(gic->domain, GIC_SGI_TEST);
+	if (!BOOT_TEST_EXPECT(t, virq))
+		return;
+	gic_sgi_test_virq = virq;
+	gic_sgi_test_desc = irq_to_desc(virq);
+	BOOT_TEST_EXPECT(t, irq_resolve_mapping(gic->domain, GIC_SGI_TEST) ==
+			    gic_sgi_test_desc);
+
+	if (!BOOT_TEST_EXPECT(t, !request_percpu_irq(virq, gic_sgi_test_handler,
+						     "gic-sgi-test",
+						     &gic_sgi_test_taken)))
+		goto out_dispose;
+	enable_percpu_irq(virq, IRQ_TYPE_NONE);
+	WRITE_ONCE(gic_sgi_test_armed, true);
+
+	if (BOOT_TEST_EXPECT(t, gic_sgi_test_send(dist)))
+		gic_sgi_test_grow(t, dist);
+
+	WRITE_ONCE(gic_sgi_test_armed, false);
+	disable_percpu_irq(virq);
+	free_percpu_irq(virq, &gic_sgi_test_taken);
+
+out_dispose:
+	irq_dispose_mapping(virq);
+}
+boot_test(gic_sgi_test);
+#else
+static inline bool gic_sgi_test_irq(u32 irqnr)
+{
+	return false;
+}
+#endif /* CONFIG_TEST_GIC_SGI_DISPATCH */
+
+/*
+ * Batched acknowledgement, only with split EOI/deactivate (EOImode1).
+ *
+ * Writing GIC_CPU_EOI right after the GIC_CPU_INTACK read only drops the
+ * running priority, so the next read can acknowledge another interrupt of
+ * the same priority while the first one stays active. Up to gic_batch_max
+ * interrupts are drained that way and then dispatched behind a single isb.
+ * Deactivation happens in the irq chip's eoi callback as usual, except for
+ * oneshot threaded interrupts, which stay active (and so can not fire
+ * again) until their thread has run. When a batch comes back full, the
+ * non-acknowledging GIC_CPU_HIGHPRI tells whether another one is worth
+ * starting, instead of an acknowledge that may just return spurious.
+ */
+#define GIC_BATCH_MAX		16
+
+static DEFINE_STATIC_KEY_FALSE(gic_batch_key);
+static unsigned int gic_batch_max;
+
+static int __init gic_batch_setup(char *str)
+{
+	int ret;
+
+	if (!str)
+		return -EINVAL;
+
+	ret = kstrtouint(str, 0, &gic_batch_max);
+	if (ret)
+		return ret;
+
+	gic_batch_max = min_t(unsigned int, gic_batch_max, GIC_BATCH_MAX);
+	return 0;
+}
+early_param("irqchip.gicv2_batch", gic_batch_setup);
+
+static inline bool gic_batch_pending(void __iomem *cpu_base)
+{
+	u32 irqnr = readl_relaxed(cpu_base + GIC_CPU_HIGHPRI) &
+		    GICC_IAR_INT_ID_MASK;
+
+	return irqnr < 1020;
+}
+
+static void gic_handle_irq_batch(struct gic_chip_data *gic,
+				 struct pt_regs *regs)
+{
+	void __iomem *cpu_base = gic_data_cpu_base(gic);
+	u32 batch[GIC_BATCH_MAX];
+	u32 irqstat, irqnr;
+	unsigned int i, n;
+
+	do {
+		for (n = 0; n < gic_batch_max; n++) {
+			irqstat = readl_relaxed(cpu_base + GIC_CPU_INTACK);
+			if ((irqstat & GICC_IAR_INT_ID_MASK) >= 1020)
+				break;
+			writel_relaxed(irqstat, cpu_base + GIC_CPU_EOI);
+			batch[n] = irqstat;
+		}
+		if (!n)
+			return;
+
+		isb();
+		for (i = 0; i < n; i++) {
+			irqstat = batch[i];
+			irqnr = irqstat & GICC_IAR_INT_ID_MASK;
+
+			if (likely(irqnr > 15) || gic_sgi_test_irq(irqnr)) {
+				handle_domain_irq(gic->domain, irqnr, regs);
+				continue;
+			}
+
+			writel_relaxed(irqstat, cpu_base + GIC_CPU_DEACTIVATE);
+#ifdef CONFIG_SMP
+			/* Pairs with the write barrier in gic_raise_softirq */
+			smp_rmb();
+			handle_IPI(irqnr, regs);
+#endif
+		}
+	} while (n == gic_batch_max && gic_batch_pending(cpu_base));
+}
+
 static void __exception_irq_entry gic_handle_irq(struct pt_regs *regs)
 {
 	u32 irqstat, irqnr;
 	struct gic_chip_data *gic = &gic_data[0];
 	void __iomem *cpu_base = gic_data_cpu_base(gic);
 
+	if (static_branch_unlikely(&gic_batch_key)) {
+		gic_handle_irq_batch(gic, regs);
+		return;
+	}
+
 	do {
 		irqstat = readl_relaxed(cpu_base + GIC_CPU_INTACK);
 		irqnr = irqstat & GICC_IAR_INT_ID_MASK;
 
-		if (likely(irqnr > 15 && irqnr < 1020)) {
+		if (likely(irqnr > 15 && irqnr < 1020) || gic_sgi_test_irq(irqnr)) {
 			if (static_branch_likely(&supports_deactivate_key))
 				writel_relaxed(irqstat, cpu_base + GIC_CPU_EOI);
 			isb();
@@ -322,7 +554,8 @@ static void gic_handle_cascade_irq(struct irq_desc *desc)
 {
 	struct gic_chip_data *chip_data = irq_desc_get_handler_data(desc);
 	struct irq_chip *chip = irq_desc_get_chip(desc);
-	unsigned int cascade_irq, gic_irq;
+	struct irq_desc *cascade_desc;
+	unsigned int gic_irq;
 	unsigned long status;
 
 	chained_irq_enter(chip, desc);
@@ -333,12 +566,12 @@ static void gic_handle_cascade_irq(struct irq_desc *desc)
 	if (gic_irq == GICC_INT_SPURIOUS)
 		goto out;
 
-	cascade_irq = irq_find_mapping(chip_data->domain, gic_irq);
-	if (unlikely(gic_irq < 32 || gic_irq > 1020)) {
+	cascade_desc = irq_resolve_mapping(chip_data->domain, gic_irq);
+	if (unlikely(gic_irq < 32 || gic_irq > 1020 || !cascade_desc)) {
 		handle_bad_irq(desc);
 	} else {
 		isb();
-		generic_handle_irq(cascade_irq);
+		generic_handle_irq_desc(cascade_desc);
 	}
 
  out:
@@ -643,6 +876,9 @@ static void gic_init_chip(struct gic_chip_data *gic, struct device *dev,
 		gic->chip.irq_mask = gic_eoimode1_mask_irq;
 		gic->chip.irq_eoi = gic_eoimode1_eoi_irq;
 		gic->chip.irq_set_vcpu_affinity = gic_irq_set_vcpu_affinity;
+		/* Threaded handlers are deactivated once their thread ran */
+		if (gic_batch_max > 1)
+			gic->chip.flags |= IRQCHIP_EOI_THREADED;
 	}
 
 #ifdef CONFIG_SMP
@@ -783,6 +1019,12 @@ static int __init __gic_init_bases(struct gic_chip_data *gic,
 		set_handle_irq(gic_handle_irq);
 		if (static_branch_likely(&supports_deactivate_key))
 			pr_info("GIC: Using split EOI/Deactivate mode\n");
+		if (static_branch_likely(&supports_deactivate_key) &&
+		    gic_batch_max > 1) {
+			static_branch_enable(&gic_batch_key);
+			pr_info("GIC: Acknowledging up to %u interrupts per batch\n",
+				gic_batch_max);
+		}
 	}
 
 	if (static_branch_likely(&supports_deactivate_key) && gic == &gic_data[0]) {
@@ -55,11 +55,21 @@ void putc_q(const char c)
     plat.putc(&plat, c);
 }
 
+int uart_console_ready(void)
+{
+	return uart_init_done;
+}
+
 void puts_q(const char *str)
 {
 	if (!uart_init_done)
 		return;
 
+	if (plat.puts) {
+		plat.puts(&plat, str);
+		return;
+	}
+
 	while (*str) {
 		putc_q(*str++);
 	}
@@ -64,6 +64,8 @@ struct tty_uart_platdata {
 	void (*init)(struct tty_uart_platdata *plat, int port, int baudrate);
 	int (*getc)(struct tty_uart_platdata *plat);
 	void (*putc)(struct tty_uart_platdata *plat, const char ch);
+	/* optional, queues a whole string at once */
+	void (*puts)(struct tty_uart_platdata *plat, const char *str);
 	int (*pending)(struct tty_uart_platdata *plat, bool input);
 	/**
 	 * getconfig() - Get the uart configuration
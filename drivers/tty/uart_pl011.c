@@ -19,7 +19,13 @@
  * (C) Copyright 2016 Marcel Ziswiler <marcel.ziswiler@toradex.com>
  */
 #include <linux/kernel.h>
+#include <linux/init.h>
 #include <linux/io.h>
+#include <linux/interrupt.h>
+#include <linux/spinlock.h>
+#include <linux/of.h>
+#include <linux/of_address.h>
+#include <linux/of_irq.h>
 
 #include <asm/early_ioremap.h>
 
@@ -43,8 +49,15 @@ struct pl01x_regs {
 	u32	pl011_fbrd;	/* 0x28 Fractional baud rate register */
 	u32	pl011_lcrh;	/* 0x2C Line control register */
 	u32	pl011_cr;	/* 0x30 Control register */
+	u32	pl011_ifls;	/* 0x34 Interrupt FIFO level select */
+	u32	pl011_imsc;	/* 0x38 Interrupt mask set/clear */
+	u32	pl011_ris;	/* 0x3C Raw interrupt status */
+	u32	pl011_mis;	/* 0x40 Masked interrupt status */
+	u32	pl011_icr;	/* 0x44 Interrupt clear register */
 };
 
+#define UART_PL011_PERIPHID2		0xFE8
+
 
 #define UART_PL01x_RSR_OE               0x08
 #define UART_PL01x_RSR_BE               0x04
@@ -132,6 +145,14 @@ struct pl01x_regs {
 #define UART_PL011_IMSC_DCDMIM          (1 << 2)
 #define UART_PL011_IMSC_CTSMIM          (1 << 1)
 #define UART_PL011_IMSC_RIMIM           (1 << 0)
+#define UART_PL011_IMSC_ALL             0x7FF
+
+#define UART_PL011_IFLS_RX1_8           (0 << 3)
+#define UART_PL011_IFLS_RX4_8           (2 << 3)
+#define UART_PL011_IFLS_TX1_8           (0 << 0)
+#define UART_PL011_IFLS_TX4_8           (2 << 0)
+
+#define UART_PL011_DR_ERROR             0xF00
 
 enum pl01x_type {
 	TYPE_PL010,
@@ -289,6 +310,9 @@ static int pl01x_generic_setbrg(struct pl01x_regs *regs, enum pl01x_type type,
 	return 0;
 }
 
+#define PL011_PHYS_BASE		0x9000000
+#define PL011_MAP_SIZE		0x1000
+
 static void pl01x_serial_init_baud(int baudrate)
 {
 	int clock = 0;
@@ -297,7 +321,7 @@ static void pl01x_serial_init_baud(int baudrate)
 	pl01x_type = TYPE_PL011;
 	clock = 150000000;
 
-	virt_base = early_ioremap(0x9000000, 0x1000);
+	virt_base = early_ioremap(PL011_PHYS_BASE, PL011_MAP_SIZE);
 	if (!virt_base)
 		return;
 
@@ -307,6 +331,43 @@ static void pl01x_serial_init_baud(int baudrate)
 	pl01x_generic_setbrg(base_regs, pl01x_type, clock, baudrate);
 }
 
+static bool pl01x_remapped;
+
+/*
+ * The console comes up through an early_ioremap() fixmap slot, long
+ * before ioremap() works. Move it to a permanent mapping, from the DT
+ * node when there is one, as soon as initcalls run and give the slot
+ * back. Interrupt driven mode is only set up on the permanent mapping.
+ */
+static int __init pl01x_serial_remap(void)
+{
+	struct pl01x_regs *early_regs = base_regs;
+	struct pl01x_regs *regs = NULL;
+	struct device_node *np;
+	unsigned long flags;
+
+	if (!early_regs)
+		return 0;
+
+	np = of_find_compatible_node(NULL, NULL, "arm,pl011");
+	if (np)
+		regs = (struct pl01x_regs *)of_iomap(np, 0);
+	if (!regs)
+		regs = (struct pl01x_regs *)ioremap(PL011_PHYS_BASE,
+						    PL011_MAP_SIZE);
+	if (!regs)
+		return -ENOMEM;
+
+	local_irq_save(flags);
+	base_regs = regs;
+	pl01x_remapped = true;
+	local_irq_restore(flags);
+
+	early_iounmap((void __iomem *)early_regs, PL011_MAP_SIZE);
+	return 0;
+}
+arch_initcall(pl01x_serial_remap);
+
 /*
  * Integrator AP has two UARTs, we use the first one, at 38400-8-N-1
  * Integrator CP has two UARTs, use the first one, at 38400-8-N-1
@@ -317,16 +378,270 @@ static void pl01x_serial_init(struct tty_uart_platdata *plat, int port, int baud
 	pl01x_serial_init_baud(115200);
 }
 
+/*
+ * Interrupt driven mode. Once the interrupt line is known, output goes
+ * through a TX ring that the interrupt handler moves into the FIFO a
+ * FIFO's worth at a time, and input is collected into an RX ring from
+ * the RX level and receive timeout interrupts. Until then, and whenever
+ * the caller has interrupts disabled (e.g. on panic), the port is
+ * polled as before.
+ */
+#define PL011_TX_RING_SIZE	4096
+#define PL011_RX_RING_SIZE	256
+
+struct pl011_ring {
+	unsigned int head;	/* written by the producer */
+	unsigned int tail;	/* written by the consumer */
+};
+
+#define PL011_RING_CNT(r, size)		(((r)->head - (r)->tail) & ((size) - 1))
+#define PL011_RING_SPACE(r, size)	(((r)->tail - (r)->head - 1) & ((size) - 1))
+
+static char pl011_tx_buf[PL011_TX_RING_SIZE];
+static char pl011_rx_buf[PL011_RX_RING_SIZE];
+static struct pl011_ring pl011_tx, pl011_rx;
+
+static DEFINE_SPINLOCK(pl011_lock);
+static bool pl011_irq_mode;
+static unsigned int pl011_imsc;
+static unsigned int pl011_fifo_size = 16;
+static unsigned long pl011_rx_dropped;
+
+/* PL011 r1p5 and later have 32 byte FIFOs, earlier ones 16 */
+static unsigned int pl011_read_fifo_size(void)
+{
+	u32 periphid2 = readl((void __iomem *)base_regs + UART_PL011_PERIPHID2);
+
+	return ((periphid2 >> 4) & 0xf) >= 3 ? 32 : 16;
+}
+
+/* How much can be written without checking the flags again */
+static unsigned int pl011_tx_room(void)
+{
+	u32 fr = readl(&base_regs->fr);
+
+	if (fr & UART_PL01x_FR_TXFE)
+		return pl011_fifo_size;
+	if (fr & UART_PL01x_FR_TXFF)
+		return 0;
+	return 1;
+}
+
+/*
+ * Move as much of the TX ring into the FIFO as fits. From the TX
+ * interrupt the FIFO is known to be at or below its 1/8 level, so the
+ * rest of it is filled without reading the flag register per byte.
+ * Returns the number of bytes still queued. Called with pl011_lock held.
+ */
+static unsigned int pl011_tx_chars(bool from_irq)
+{
+	unsigned int room;
+
+	room = from_irq ? pl011_fifo_size - pl011_fifo_size / 8 :
+			  pl011_tx_room();
+
+	while (PL011_RING_CNT(&pl011_tx, PL011_TX_RING_SIZE)) {
+		if (!room) {
+			room = pl011_tx_room();
+			if (!room)
+				break;
+		}
+		writel(pl011_tx_buf[pl011_tx.tail], &base_regs->dr);
+		pl011_tx.tail = (pl011_tx.tail + 1) & (PL011_TX_RING_SIZE - 1);
+		room--;
+	}
+
+	return PL011_RING_CNT(&pl011_tx, PL011_TX_RING_SIZE);
+}
+
+static void pl011_tx_queue(char c)
+{
+	while (!PL011_RING_SPACE(&pl011_tx, PL011_TX_RING_SIZE)) {
+		/* the ring is full: push bytes out by hand to make room */
+		pl011_tx_chars(false);
+		cpu_relax();
+	}
+
+	pl011_tx_buf[pl011_tx.head] = c;
+	pl011_tx.head = (pl011_tx.head + 1) & (PL011_TX_RING_SIZE - 1);
+}
+
+/*
+ * Prime the FIFO from the ring and leave the rest to the TX interrupt,
+ * which only fires on the FIFO level dropping through the threshold and
+ * so has to be armed with data already in flight.
+ */
+static void pl011_tx_start(unsigned long flags)
+{
+	if (!pl011_tx_chars(false))
+		return;
+
+	if (irqs_disabled_flags(flags)) {
+		/* nobody will take the interrupt soon, finish by polling */
+		while (pl011_tx_chars(false))
+			cpu_relax();
+		return;
+	}
+
+	if (!(pl011_imsc & UART_PL011_IMSC_TXIM)) {
+		pl011_imsc |= UART_PL011_IMSC_TXIM;
+		writel(pl011_imsc, &base_regs->pl011_imsc);
+	}
+}
+
+static void pl011_rx_chars(void)
+{
+	unsigned int data;
+
+	while (!(readl(&base_regs->fr) & UART_PL01x_FR_RXFE)) {
+		data = readl(&base_regs->dr);
+		if (data & UART_PL011_DR_ERROR) {
+			writel(0xFFFFFFFF, &base_regs->ecr);
+			continue;
+		}
+
+		if (!PL011_RING_SPACE(&pl011_rx, PL011_RX_RING_SIZE)) {
+			pl011_rx_dropped++;
+			continue;
+		}
+		pl011_rx_buf[pl011_rx.head] = data;
+		pl011_rx.head = (pl011_rx.head + 1) & (PL011_RX_RING_SIZE - 1);
+	}
+}
+
+static irqreturn_t pl011_int(int irq, void *dev_id)
+{
+	unsigned int status;
+	unsigned long flags;
+
+	/* forced threaded under threadirqs, so interrupts may be on */
+	spin_lock_irqsave(&pl011_lock, flags);
+
+	status = readl(&base_regs->pl011_mis);
+	if (!status) {
+		spin_unlock_irqrestore(&pl011_lock, flags);
+		return IRQ_NONE;
+	}
+
+	/* TX is cleared by refilling the FIFO, RX by draining it */
+	writel(status & ~UART_PL011_IMSC_TXIM, &base_regs->pl011_icr);
+
+	if (status & (UART_PL011_IMSC_RXIM | UART_PL011_IMSC_RTIM))
+		pl011_rx_chars();
+
+	if ((status & UART_PL011_IMSC_TXIM) && !pl011_tx_chars(true)) {
+		pl011_imsc &= ~UART_PL011_IMSC_TXIM;
+		writel(pl011_imsc, &base_regs->pl011_imsc);
+	}
+
+	spin_unlock_irqrestore(&pl011_lock, flags);
+
+	return IRQ_HANDLED;
+}
+
+static int __init pl011_irq_init(void)
+{
+	struct device_node *np;
+	unsigned long flags;
+	unsigned int irq;
+	int ret;
+
+	if (!pl01x_remapped || pl01x_type != TYPE_PL011)
+		return 0;
+
+	np = of_find_compatible_node(NULL, NULL, "arm,pl011");
+	if (!np)
+		return 0;
+
+	irq = irq_of_parse_and_map(np, 0);
+	if (!irq) {
+		pr_warn("uart-pl011: no interrupt, staying in polled mode\n");
+		return 0;
+	}
+
+	pl011_fifo_size = pl011_read_fifo_size();
+	writel(UART_PL011_IFLS_RX4_8 | UART_PL011_IFLS_TX1_8,
+	       &base_regs->pl011_ifls);
+	writel(0, &base_regs->pl011_imsc);
+	writel(UART_PL011_IMSC_ALL, &base_regs->pl011_icr);
+
+	ret = request_irq(irq, pl011_int, 0, "uart-pl011", base_regs);
+	if (ret) {
+		pr_warn("uart-pl011: failed to request irq %u: %d\n", irq, ret);
+		return ret;
+	}
+
+	spin_lock_irqsave(&pl011_lock, flags);
+	pl011_irq_mode = true;
+	pl011_imsc = UART_PL011_IMSC_RXIM | UART_PL011_IMSC_RTIM;
+	writel(pl011_imsc, &base_regs->pl011_imsc);
+	spin_unlock_irqrestore(&pl011_lock, flags);
+
+	pr_info("uart-pl011: interrupt driven on irq %u, %u byte FIFO\n",
+		irq, pl011_fifo_size);
+	return 0;
+}
+device_initcall(pl011_irq_init);
+
 static void pl01x_serial_putc(struct tty_uart_platdata *plat, const char c)
 {
+	unsigned long flags;
+
+	if (!pl011_irq_mode) {
+		if (c == '\n')
+			while (pl01x_putc(base_regs, '\r') == -EAGAIN);
+
+		while (pl01x_putc(base_regs, c) == -EAGAIN);
+		return;
+	}
+
+	spin_lock_irqsave(&pl011_lock, flags);
 	if (c == '\n')
-		while (pl01x_putc(base_regs, '\r') == -EAGAIN);
+		pl011_tx_queue('\r');
+	pl011_tx_queue(c);
+	pl011_tx_start(flags);
+	spin_unlock_irqrestore(&pl011_lock, flags);
+}
+
+/* Queue a whole string under one lock, then start the FIFO once */
+static void pl01x_serial_puts(struct tty_uart_platdata *plat, const char *s)
+{
+	unsigned long flags;
+
+	if (!pl011_irq_mode) {
+		while (*s)
+			pl01x_serial_putc(plat, *s++);
+		return;
+	}
 
-	while (pl01x_putc(base_regs, c) == -EAGAIN);
+	spin_lock_irqsave(&pl011_lock, flags);
+	for (; *s; s++) {
+		if (*s == '\n')
+			pl011_tx_queue('\r');
+		pl011_tx_queue(*s);
+	}
+	pl011_tx_start(flags);
+	spin_unlock_irqrestore(&pl011_lock, flags);
 }
 
 static int pl01x_serial_getc(struct tty_uart_platdata *plat)
 {
+	unsigned long flags;
+	int ch;
+
+	while (pl011_irq_mode) {
+		spin_lock_irqsave(&pl011_lock, flags);
+		if (PL011_RING_CNT(&pl011_rx, PL011_RX_RING_SIZE)) {
+			ch = (unsigned char)pl011_rx_buf[pl011_rx.tail];
+			pl011_rx.tail = (pl011_rx.tail + 1) &
+					(PL011_RX_RING_SIZE - 1);
+			spin_unlock_irqrestore(&pl011_lock, flags);
+			return ch;
+		}
+		spin_unlock_irqrestore(&pl011_lock, flags);
+		cpu_relax();
+	}
+
 	while (1) {
 		int ch = pl01x_getc(base_regs);
 
@@ -341,6 +656,9 @@ static int pl01x_serial_getc(struct tty_uart_platdata *plat)
 
 static int pl01x_serial_tstc(struct tty_uart_platdata *plat, bool input)
 {
+	if (pl011_irq_mode)
+		return PL011_RING_CNT(&pl011_rx, PL011_RX_RING_SIZE) != 0;
+
 	return pl01x_tstc(base_regs);
 }
 
@@ -365,6 +683,7 @@ struct tty_uart_platdata plat = {
 	.init = pl01x_serial_init,
 	.getc = pl01x_serial_getc,
 	.putc = pl01x_serial_putc,
+	.puts = pl01x_serial_puts,
 	.pending = pl01x_serial_tstc,
 	.port = 0,
 	.nr_port = 0,
@@ -19,6 +19,7 @@
  */
 #ifndef HAVE_ARCH_BUG
 #define BUG() do { \
+	oops_enter(); \
 	printk("BUG: failure at %s:%d/%s()!\n", __FILE__, __LINE__, __func__); \
 	panic("BUG!"); \
 } while (0)
@@ -36,7 +37,9 @@
  */
 #ifndef HAVE_ARCH_WARN
 #define __WARN() do { \
-	printk("WARNING: warn at %s:%d/%s()!\n", __FILE__, __LINE__, __func__); } while (0)
+	oops_enter(); \
+	printk("WARNING: warn at %s:%d/%s()!\n", __FILE__, __LINE__, __func__); \
+	oops_exit(); } while (0)
 #define __WARN_printf(arg...)	do { printk(arg); __WARN(); } while (0)
 #endif
 
@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LINUX_BOOT_TEST_H
+#define _LINUX_BOOT_TEST_H
+
+/*
+ * Boot-time self tests, see the "Boot-time self tests" menu in
+ * lib/Kconfig.debug.
+ *
+ * A test is a function taking a struct boot_test, registered with
+ * boot_test(), which runs it as a late initcall. It reports its checks
+ * through BOOT_TEST_EXPECT(); a failed check is printed with its
+ * location as it happens, and a single summary line follows the test.
+ */
+#include <linux/init.h>
+#include <linux/printk.h>
+#include <linux/types.h>
+
+struct boot_test {
+	const char	*name;
+	unsigned int	checks;
+	unsigned int	failed;
+};
+
+static inline bool __boot_test_expect(struct boot_test *t, bool ok,
+				      const char *cond, const char *func,
+				      int line)
+{
+	t->checks++;
+	if (!ok) {
+		t->failed++;
+		pr_err("%s: %s:%d: expected %s\n", t->name, func, line, cond);
+	}
+	return ok;
+}
+
+/* Evaluates to @cond, so that a test can stop after a failed check */
+#define BOOT_TEST_EXPECT(t, cond)					\
+	__boot_test_expect(t, !!(cond), #cond, __func__, __LINE__)
+
+static inline void boot_test_report(struct boot_test *t)
+{
+	if (t->failed)
+		pr_err("%s: %u of %u checks failed\n",
+		       t->name, t->failed, t->checks);
+	else
+		pr_info("%s: all %u checks passed\n", t->name, t->checks);
+}
+
+#define boot_test(fn)							\
+static int __init fn##_run(void)					\
+{									\
+	struct boot_test t = { .name = #fn };				\
+									\
+	fn(&t);								\
+	boot_test_report(&t);						\
+	return 0;							\
+}									\
+late_initcall(fn##_run)
+
+#endif /* _LINUX_BOOT_TEST_H */
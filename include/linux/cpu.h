@@ -15,6 +15,7 @@
 #define _LINUX_CPU_H_
 
 #include <linux/device.h>
+#include <linux/cpuhotplug.h>
 
 struct cpu {
 	int node_id;		/* The node which contains the CPU */
@@ -27,6 +28,10 @@ struct cpu {
 
 extern void boot_cpu_init(void);
 
+void cpu_startup_entry(enum cpuhp_state state);
+
+void arch_cpu_idle(void);
+
 #include <asm/cpu.h>
 
 #endif /* _LINUX_CPU_H_ */
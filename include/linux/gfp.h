@@ -19,8 +19,10 @@
 #define ___GFP_ZERO				BIT(3)
 #define ___GFP_THISNODE			BIT(4)
 #define ___GFP_NOWARN			BIT(5)
+#define ___GFP_DIRECT_RECLAIM	BIT(6)
+#define ___GFP_NORETRY			BIT(7)
 
-#define ___GFP_BITS_SHIFT		6
+#define ___GFP_BITS_SHIFT		8
 
 /* If the above are modified, __GFP_BITS_SHIFT may need updating */
 
@@ -41,15 +43,32 @@
 #define __GFP_ZERO	((__force gfp_t)___GFP_ZERO)	/* Return zeroed page on success */
 #define __GFP_THISNODE	((__force gfp_t)___GFP_THISNODE)
 #define __GFP_NOWARN	((__force gfp_t)___GFP_NOWARN)
+/*
+ * The caller may wait for memory to be reclaimed. There is no reclaim yet,
+ * so failing the fast path is fatal for such order-0 allocations; without
+ * it the allocation simply fails.
+ */
+#define __GFP_DIRECT_RECLAIM	((__force gfp_t)___GFP_DIRECT_RECLAIM)
+/* Fail rather than retry or reclaim when the freelists come up short */
+#define __GFP_NORETRY	((__force gfp_t)___GFP_NORETRY)
 
 #define __GFP_BITS_SHIFT ___GFP_BITS_SHIFT
 #define __GFP_BITS_MASK ((__force gfp_t)((1 << __GFP_BITS_SHIFT) - 1))
 
 #define GFP_DMA		(__GFP_DMA)
-#define GFP_KERNEL	(__GFP_NORMAL)
+#define GFP_KERNEL	(__GFP_NORMAL | __GFP_DIRECT_RECLAIM)
 #define GFP_MOVABLE		(__GFP_MOVABLE)
 
+/*
+ * Callers that must not block: without GFP_KERNEL, allocators that can
+ * populate memory lazily (e.g. percpu) only hand out what is ready, and
+ * the page allocator fails rather than reclaim.
+ */
+#define GFP_NOWAIT	((__force gfp_t)0)
+
 #define GFP_USER	(GFP_KERNEL)
+#define GFP_TRANSHUGE_LIGHT	((GFP_USER | __GFP_NOWARN) & ~__GFP_DIRECT_RECLAIM)
+#define GFP_TRANSHUGE	(GFP_TRANSHUGE_LIGHT | __GFP_DIRECT_RECLAIM)
 
 static inline enum zone_type gfp_zone(gfp_t flags)
 {
@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LINUX_HUGE_MM_H
+#define _LINUX_HUGE_MM_H
+
+/*
+ * Transparent huge pages for private anonymous memory, see
+ * mm/huge_memory.c. Included from linux/mm.h.
+ */
+
+enum thp_stat_item {
+	THP_FAULT_ALLOC,
+	THP_FAULT_FALLBACK,
+	THP_COLLAPSE_ALLOC,
+	THP_COLLAPSE_ALLOC_FAILED,
+	THP_SCAN_FULL,
+	NR_THP_STATS
+};
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#define HPAGE_PMD_SHIFT PMD_SHIFT
+#define HPAGE_PMD_SIZE	((1UL) << HPAGE_PMD_SHIFT)
+#define HPAGE_PMD_MASK	(~(HPAGE_PMD_SIZE - 1))
+
+#define HPAGE_PMD_ORDER (HPAGE_PMD_SHIFT-PAGE_SHIFT)
+#define HPAGE_PMD_NR (1<<HPAGE_PMD_ORDER)
+
+/* mm->flags bit: the mm is on the khugepaged scan list */
+#define MMF_VM_HUGEPAGE		17
+
+extern bool transparent_hugepage_enabled;
+
+/*
+ * Can the naturally aligned huge page around @address be mapped
+ * by a single pmd inside @vma?
+ */
+static inline bool transhuge_vma_suitable(struct vm_area_struct *vma,
+		unsigned long address)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+
+	if (!transparent_hugepage_enabled)
+		return false;
+	if (!vma_is_anonymous(vma) || (vma->vm_flags & VM_SHARED))
+		return false;
+	return haddr >= vma->vm_start && haddr + HPAGE_PMD_SIZE <= vma->vm_end;
+}
+
+extern vm_fault_t do_huge_pmd_anonymous_page(struct vm_fault *vmf);
+extern void huge_pmd_set_accessed(struct vm_fault *vmf, pmd_t orig_pmd);
+
+extern void khugepaged_enter(struct vm_area_struct *vma);
+extern void khugepaged_exit(struct mm_struct *mm);
+
+extern void show_thp_stats(void);
+#else /* CONFIG_TRANSPARENT_HUGEPAGE */
+static inline bool transhuge_vma_suitable(struct vm_area_struct *vma,
+		unsigned long address)
+{
+	return false;
+}
+
+static inline vm_fault_t do_huge_pmd_anonymous_page(struct vm_fault *vmf)
+{
+	return VM_FAULT_FALLBACK;
+}
+
+static inline void huge_pmd_set_accessed(struct vm_fault *vmf,
+		pmd_t orig_pmd)
+{
+}
+
+static inline void khugepaged_enter(struct vm_area_struct *vma)
+{
+}
+
+static inline void khugepaged_exit(struct mm_struct *mm)
+{
+}
+
+static inline void show_thp_stats(void)
+{
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
+#endif /* _LINUX_HUGE_MM_H */
@@ -226,6 +226,7 @@ struct obs_kernel_param {
 
 /* Defined in init/main.c */
 extern char __initdata boot_command_line[];
+extern int do_one_initcall(initcall_t fn);
 
 /* used by init/main.c */
 void setup_arch(char **);
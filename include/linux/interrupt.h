@@ -125,6 +125,30 @@ extern int arch_early_irq_init(void);
 #if defined(CONFIG_SMP)
 
 extern cpumask_t * irq_default_affinity;
+
+extern int __irq_set_affinity(unsigned int irq, const struct cpumask *cpumask,
+			      bool force);
+
+/**
+ * irq_set_affinity - Set the irq affinity of a given irq
+ * @irq:	Interrupt to set affinity
+ * @cpumask:	cpumask
+ *
+ * Fails if cpumask does not contain an online CPU
+ */
+static inline int
+irq_set_affinity(unsigned int irq, const struct cpumask *cpumask)
+{
+	return __irq_set_affinity(irq, cpumask, false);
+}
+
+extern int irq_can_set_affinity(unsigned int irq);
+#endif
+
+#ifdef CONFIG_IRQ_BALANCE
+extern void irq_balance_dump(void);
+#else
+static inline void irq_balance_dump(void) { }
 #endif
 
 /* PLEASE, avoid to allocate new softirqs, if you need not _really_ high
@@ -707,7 +707,7 @@ struct cpumask *irq_data_get_effective_affinity_mask(struct irq_data *d)
 	return d->common->effective_affinity;
 }
 static inline void irq_data_update_effective_affinity(struct irq_data *d,
-						      struct cpumask *m)
+						      const struct cpumask *m)
 {
 	cpumask_copy(d->common->effective_affinity, m);
 }
@@ -931,6 +931,18 @@ extern int irq_set_chip_data(unsigned int irq, void *data);
 /* Handling of unhandled and spurious interrupts: */
 extern void note_interrupt(struct irq_desc *desc, irqreturn_t action_ret);
 
+#ifdef CONFIG_IRQ_HISTOGRAM
+extern void irq_hist_enable(bool on);
+extern void irq_hist_dump(unsigned int irq);
+extern void irq_hist_dump_all(void);
+extern void irq_hist_reset(void);
+#else
+static inline void irq_hist_enable(bool on) { }
+static inline void irq_hist_dump(unsigned int irq) { }
+static inline void irq_hist_dump_all(void) { }
+static inline void irq_hist_reset(void) { }
+#endif
+
 /*
  * Built-in IRQ handlers for various IRQ types,
  * callable via desc->handle_irq()
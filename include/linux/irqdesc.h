@@ -10,6 +10,8 @@
 #include <linux/wait.h>
 #include <linux/mutex.h>
 
+struct irq_hist;
+
 /**
  * struct irq_desc - interrupt descriptor
  * @irq_common_data:	per irq and chip data passed down to chip functions
@@ -44,6 +46,8 @@
  * @dir:		/proc/irq/ procfs entry
  * @debugfs_file:	dentry for the debugfs file
  * @name:		flow handler name for /proc/interrupts output
+ * @hist:		per cpu handler duration and arrival histograms
+ * @balance_count:	interrupt count seen by the last balancing pass
  */
 struct irq_desc {
 	struct irq_common_data	irq_common_data;
@@ -75,6 +79,12 @@ struct irq_desc {
 	int			parent_irq;
 	struct module		*owner;
 	const char		*name;
+#ifdef CONFIG_IRQ_HISTOGRAM
+	struct irq_hist __percpu *hist;
+#endif
+#ifdef CONFIG_IRQ_BALANCE
+	unsigned int		balance_count;
+#endif
 } ____cacheline_internodealigned_in_smp;
 
 static inline struct irq_desc *irq_data_to_desc(struct irq_data *data)
@@ -115,6 +115,7 @@ struct irq_domain_ops {
 extern struct irq_domain_ops irq_generic_chip_ops;
 
 struct irq_domain_chip_generic;
+struct irq_desc;
 
 /**
  * struct irq_domain - Hardware interrupt number translation object
@@ -140,7 +141,9 @@ struct irq_domain_chip_generic;
  *                         support direct mapping
  * @revmap_size: Size of the linear map table @linear_revmap[]
  * @revmap_tree: Radix map tree for hwirqs that don't fit in the linear map
- * @linear_revmap: Linear table of hwirq->virq reverse mappings
+ * @linear_revmap: Linear table of hwirq->irq_desc reverse mappings, so the
+ *                 interrupt entry path gets from a hwirq to its descriptor
+ *                 with a single load
  */
 struct irq_domain {
 	struct list_head link;
@@ -162,7 +165,7 @@ struct irq_domain {
 	unsigned int revmap_size;
 	struct radix_tree_root revmap_tree;
 	struct mutex revmap_tree_mutex;
-	unsigned int linear_revmap[];
+	struct irq_desc __rcu *linear_revmap[];
 };
 
 /* Irq domain flags */
@@ -366,24 +369,12 @@ extern unsigned int irq_create_mapping(struct irq_domain *host,
 extern unsigned int irq_create_fwspec_mapping(struct irq_fwspec *fwspec);
 extern void irq_dispose_mapping(unsigned int virq);
 
-/**
- * irq_linear_revmap() - Find a linux irq from a hw irq number.
- * @domain: domain owning this hardware interrupt
- * @hwirq: hardware irq number in that domain space
- *
- * This is a fast path alternative to irq_find_mapping() that can be
- * called directly by irq controller code to save a handful of
- * instructions. It is always safe to call, but won't find irqs mapped
- * using the radix tree.
- */
-static inline unsigned int irq_linear_revmap(struct irq_domain *domain,
-					     irq_hw_number_t hwirq)
-{
-	return hwirq < domain->revmap_size ? domain->linear_revmap[hwirq] : 0;
-}
-
+extern unsigned int irq_linear_revmap(struct irq_domain *domain,
+				      irq_hw_number_t hwirq);
 extern unsigned int irq_find_mapping(struct irq_domain *host,
 				     irq_hw_number_t hwirq);
+extern struct irq_desc *irq_resolve_mapping(struct irq_domain *domain,
+					    irq_hw_number_t hwirq);
 extern unsigned int irq_create_direct_mapping(struct irq_domain *host);
 extern int irq_create_strict_mappings(struct irq_domain *domain,
 				      unsigned int irq_base,
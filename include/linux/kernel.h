@@ -280,6 +280,8 @@ static inline void might_fault(void) { }
 
 __printf(1, 2)
 void panic(const char *fmt, ...) __noreturn __cold;
+void oops_enter(void);
+void oops_exit(void);
 
 void do_exit(long error_code)
 	__noreturn;
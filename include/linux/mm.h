@@ -35,8 +35,104 @@
 #define lm_alias(x)	__va(__pa_symbol(x))
 #endif
 
+/*
+ * vm_flags in vm_area_struct, see mm_types.h.
+ * When changing, update vm_get_page_prot() in mm/mmap.c.
+ */
+#define VM_NONE		0x00000000
+
+#define VM_READ		0x00000001	/* currently active flags */
+#define VM_WRITE	0x00000002
+#define VM_EXEC		0x00000004
+#define VM_SHARED	0x00000008
+
+#define VM_GROWSDOWN	0x00000100	/* general info on the segment */
+#define VM_LOCKED	0x00002000
+
+#define VM_ACCESS_FLAGS	(VM_READ | VM_WRITE | VM_EXEC)
+
+/*
+ * mapping from the currently active vm_flags protection bits (the
+ * low four bits) to a page protection mask..
+ */
+extern pgprot_t protection_map[16];
+
+extern pgprot_t vm_get_page_prot(unsigned long vm_flags);
+
+static inline bool vma_is_anonymous(struct vm_area_struct *vma)
+{
+	/* Nothing but anonymous memory can be mapped into user space yet */
+	return true;
+}
+
+extern struct vm_area_struct *find_vma(struct mm_struct *mm, unsigned long addr);
+extern int insert_vm_struct(struct mm_struct *mm, struct vm_area_struct *vma);
+
+#define FAULT_FLAG_WRITE	0x01	/* Fault was a write access */
+#define FAULT_FLAG_USER		0x02	/* The fault originated in userspace */
+#define FAULT_FLAG_INSTRUCTION  0x04	/* The fault was during an instruction fetch */
+
+typedef unsigned int vm_fault_t;
+
+#define VM_FAULT_OOM		0x000001
+#define VM_FAULT_SIGBUS		0x000002
+#define VM_FAULT_SIGSEGV	0x000004
+#define VM_FAULT_NOPAGE		0x000100	/* ->fault installed the pte */
+#define VM_FAULT_FALLBACK	0x000800	/* huge page fault failed, fall back to small */
+
+#define VM_FAULT_ERROR	(VM_FAULT_OOM | VM_FAULT_SIGBUS | VM_FAULT_SIGSEGV)
+
+/*
+ * Fault types accounted by the fault-latency statistics. A permission
+ * fault is any fault taken on an already present pte (write protection
+ * or access flag), the other two are demand faults on a missing pte.
+ */
+enum mm_fault_type {
+	MM_FAULT_READ,
+	MM_FAULT_WRITE,
+	MM_FAULT_PERM,
+	NR_MM_FAULT_TYPES
+};
+
+/*
+ * vm_fault is filled by the pagefault handler and passed to the anonymous
+ * fault helpers in mm/memory.c.
+ */
+struct vm_fault {
+	struct vm_area_struct *vma;	/* Target VMA */
+	unsigned int flags;		/* FAULT_FLAG_xxx flags */
+	unsigned long address;		/* Faulting virtual address */
+	pmd_t *pmd;			/* Pointer to pmd entry matching
+					 * the 'address' */
+	pte_t *pte;			/* Pointer to pte entry matching
+					 * the 'address' */
+	pte_t orig_pte;			/* Value of PTE at the time of fault */
+	enum mm_fault_type type;	/* Accounting class of this fault */
+};
+
+extern vm_fault_t handle_mm_fault(struct vm_area_struct *vma,
+			unsigned long address, unsigned int flags);
+
+#include <linux/huge_mm.h>
+
+/*
+ * Number of bytes around the faulting address that an anonymous read
+ * fault maps to the zero page in one go, see do_fault_around() in mm/memory.c.
+ */
+extern unsigned long fault_around_bytes;
+
+extern void show_mm_fault_stats(void);
+extern void reset_mm_fault_stats(void);
+
 extern void free_area_init_nodes(unsigned long *max_zone_pfn);
 
+/*
+ * Pre-zeroed page pool, refilled from the idle loop and consumed by
+ * order-0 __GFP_ZERO allocations. See mm/zero_pool.c.
+ */
+extern bool zero_pool_refill(void);
+extern void show_zero_pool_stats(void);
+
 extern void adjust_managed_page_count(struct page *page, long count);
 extern void mem_init(void);
 extern void mem_init_print_info(const char *str);
@@ -180,6 +276,28 @@ static inline void pgtable_page_dtor(struct page *page)
 	__ClearPageTable(page);
 }
 
+int __pud_alloc(struct mm_struct *mm, pgd_t *pgd, unsigned long address);
+int __pmd_alloc(struct mm_struct *mm, pud_t *pud, unsigned long address);
+int __pte_alloc_kernel(pmd_t *pmd);
+
+static inline pud_t *pud_alloc(struct mm_struct *mm, pgd_t *pgd,
+			       unsigned long address)
+{
+	return (unlikely(pgd_none(*pgd)) && __pud_alloc(mm, pgd, address)) ?
+		NULL : pud_offset(pgd, address);
+}
+
+static inline pmd_t *pmd_alloc(struct mm_struct *mm, pud_t *pud,
+			       unsigned long address)
+{
+	return (unlikely(pud_none(*pud)) && __pmd_alloc(mm, pud, address)) ?
+		NULL : pmd_offset(pud, address);
+}
+
+#define pte_alloc_kernel(pmd, address)			\
+	((unlikely(pmd_none(*(pmd))) && __pte_alloc_kernel(pmd))? \
+		NULL: pte_offset_kernel(pmd, address))
+
 static inline bool debug_pagealloc_enabled(void)
 {
 	return false;
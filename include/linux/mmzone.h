@@ -221,6 +221,14 @@ typedef struct pglist_data {
 
 	spinlock_t lru_lock;
 
+	/*
+	 * Pages zeroed ahead of time by idle CPUs, handed out first to
+	 * order-0 __GFP_ZERO allocations. See mm/zero_pool.c.
+	 */
+	spinlock_t zero_pool_lock;
+	struct list_head zero_pool;
+	unsigned long nr_zero_pool;
+
 	unsigned long flags;
 } pg_data_t;
 
@@ -7,6 +7,8 @@
  * Rewritten again by Rusty Russell, 2002
  */
 
+#include <linux/init.h>
+
 struct module {
 
 };
@@ -26,5 +28,8 @@ static inline void module_put(struct module *module)
 
 #define module_name(mod) "kernel"
 
+/* Everything is built in, so module_init() is just a device initcall */
+#define module_init(x)	__initcall(x);
+
 
 #endif /* _LINUX_MODULE_H */
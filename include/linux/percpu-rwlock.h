@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LINUX_PERCPU_RWLOCK_H
+#define _LINUX_PERCPU_RWLOCK_H
+
+#include <linux/compiler.h>
+#include <linux/percpu.h>
+#include <linux/preempt.h>
+#include <linux/spinlock.h>
+
+#include <asm/barrier.h>
+
+/*
+ * A reader-writer spinlock for read-mostly data. Readers only bump a
+ * counter of their own cpu and never write a shared cache line while no
+ * writer is around; a writer raises ->writer and then waits for the
+ * counter of every possible cpu to drain.
+ *
+ * Read sections run with preemption disabled, so a reader unlocks on the
+ * cpu it locked on. They must not nest, and writers must not be called
+ * with a read section of the same lock held or from a context that can
+ * interrupt one.
+ */
+struct percpu_rwlock {
+	unsigned int __percpu	*read_count;
+	int			writer;
+	raw_spinlock_t		wlock;
+};
+
+#define __PERCPU_RWLOCK_INIT(name, rc)					\
+{									\
+	.read_count	= &rc,						\
+	.writer		= 0,						\
+	.wlock		= __RAW_SPIN_LOCK_UNLOCKED(name.wlock),		\
+}
+
+#define DEFINE_STATIC_PERCPU_RWLOCK(name)				\
+static DEFINE_PER_CPU(unsigned int, __percpu_rwlock_rc_##name);		\
+static struct percpu_rwlock name =					\
+	__PERCPU_RWLOCK_INIT(name, __percpu_rwlock_rc_##name)
+
+extern int percpu_init_rwlock(struct percpu_rwlock *rw);
+extern void percpu_free_rwlock(struct percpu_rwlock *rw);
+
+extern void __percpu_read_lock_slowpath(struct percpu_rwlock *rw);
+extern void percpu_write_lock(struct percpu_rwlock *rw);
+extern void percpu_write_unlock(struct percpu_rwlock *rw);
+
+static inline void percpu_read_lock(struct percpu_rwlock *rw)
+{
+	preempt_disable();
+	this_cpu_inc(*rw->read_count);
+	/*
+	 * Order the increment before the ->writer load, pairs with the
+	 * barrier in percpu_write_lock() between setting ->writer and
+	 * reading the counters: either we see the writer or it sees us.
+	 */
+	smp_mb();
+	if (unlikely(READ_ONCE(rw->writer)))
+		__percpu_read_lock_slowpath(rw);
+}
+
+static inline void percpu_read_unlock(struct percpu_rwlock *rw)
+{
+	/* Keep the read section before the decrement the writer waits on */
+	smp_mb();
+	this_cpu_dec(*rw->read_count);
+	preempt_enable();
+}
+
+#endif /* _LINUX_PERCPU_RWLOCK_H */
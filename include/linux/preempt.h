@@ -78,7 +78,14 @@ do { \
 #define in_nmi()		(0)
 #define in_task()		(0)
 
-#define PREEMPT_DISABLE_OFFSET	0
+/*
+ * preempt_disable() always counts, so schedule() runs with one level
+ * of preemption disabled. New tasks start with two, which
+ * finish_task_switch() and schedule_tail() drop.
+ */
+#define PREEMPT_DISABLE_OFFSET	1
+
+#define FORK_PREEMPT_COUNT	(2*PREEMPT_DISABLE_OFFSET + PREEMPT_ENABLED)
 /*
  * Check whether we were atomic before we did preempt_disable():
  * (used by the scheduler)
@@ -10,6 +10,8 @@
 extern const char linux_banner[];
 extern const char linux_proc_banner[];
 
+extern int oops_in_progress;	/* If set, an oops, panic(), BUG() or die() is in progress */
+
 static inline int printk_get_level(const char *buffer)
 {
 	if (buffer[0] == KERN_SOH_ASCII && buffer[1]) {
@@ -140,6 +142,9 @@ int printk(const char *fmt, ...);
 
 __printf(1, 2) void dump_stack_set_arch_desc(const char *fmt, ...);
 
+bool printk_flush_idle(void);
+void console_flush_on_panic(void);
+
 extern asmlinkage void dump_stack(void) __cold;
 #else
 static inline __printf(1, 0)
@@ -158,6 +163,15 @@ static inline __printf(1, 2) void dump_stack_set_arch_desc(const char *fmt, ...)
 {
 }
 
+static inline bool printk_flush_idle(void)
+{
+	return false;
+}
+
+static inline void console_flush_on_panic(void)
+{
+}
+
 static inline void dump_stack(void)
 {
 }
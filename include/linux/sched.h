@@ -21,6 +21,8 @@
 #include <asm/current.h>
 #include <asm/thread_info.h>
 
+struct sched_param;
+
 /*
  * Task state bitmask. NOTE! These bits are also
  * encoded in fs/proc/array.c: get_task_state().
@@ -620,6 +622,9 @@ struct task_struct {
 	 */
 	char				comm[TASK_COMM_LEN];
 
+	/* struct kthread of kernel threads, see kernel/kthread.c: */
+	void				*worker_private;
+
 		/* Protection of the PI data structures: */
 	raw_spinlock_t			pi_lock;
 
@@ -669,6 +674,29 @@ static inline pid_t task_pid_nr(struct task_struct *tsk)
 #define PF_FREEZER_SKIP		0x40000000	/* Freezer should not count it as freezable */
 #define PF_SUSPEND_TASK		0x80000000      /* This thread called freeze_processes() and should not be frozen */
 
+#ifdef CONFIG_SMP
+extern void do_set_cpus_allowed(struct task_struct *p, const struct cpumask *new_mask);
+extern int set_cpus_allowed_ptr(struct task_struct *p, const struct cpumask *new_mask);
+extern unsigned long wait_task_inactive(struct task_struct *, long match_state);
+#else
+static inline void do_set_cpus_allowed(struct task_struct *p, const struct cpumask *new_mask)
+{
+}
+static inline int set_cpus_allowed_ptr(struct task_struct *p, const struct cpumask *new_mask)
+{
+	if (!cpumask_is_set(0, new_mask))
+		return -EINVAL;
+	return 0;
+}
+static inline unsigned long wait_task_inactive(struct task_struct *p, long match_state)
+{
+	return 1;
+}
+#endif
+
+extern int sched_setscheduler(struct task_struct *, int, const struct sched_param *);
+extern int sched_setscheduler_nocheck(struct task_struct *, int, const struct sched_param *);
+
 static inline struct thread_info *task_thread_info(struct task_struct *task)
 {
 	return &task->thread_info;
@@ -10,22 +10,16 @@
 #include <linux/sched.h>
 #include <uapi/linux/sched/types.h>
 
-static inline void put_task_struct(struct task_struct *t)
-{
+extern void fork_init(void);
 
-}
+extern int sched_fork(unsigned long clone_flags, struct task_struct *p);
 
-static inline __printf(4, 5)
-struct task_struct *kthread_create_on_node(int (*threadfn)(void *data),
-					   void *data,
-					   int node,
-					   const char namefmt[], ...) { return NULL; }
+extern int copy_thread(unsigned long, unsigned long, unsigned long,
+			struct task_struct *);
+extern struct task_struct *copy_kernel_thread(int (*fn)(void *), void *arg,
+					      int node);
 
-#define kthread_create(threadfn, data, namefmt, arg...) \
-	kthread_create_on_node(threadfn, data, NUMA_NO_NODE, namefmt, ##arg)
-
-/* TODO */
-static inline int kthread_stop(struct task_struct *k) { return 0; }
+extern void __noreturn do_task_dead(void);
 
 extern int wake_up_state(struct task_struct *tsk, unsigned int state);
 extern int wake_up_process(struct task_struct *tsk);
@@ -33,6 +27,14 @@ extern void wake_up_new_task(struct task_struct *tsk);
 
 #define get_task_struct(tsk) do { atomic_inc(&(tsk)->usage); } while(0)
 
+extern void __put_task_struct(struct task_struct *t);
+
+static inline void put_task_struct(struct task_struct *t)
+{
+	if (atomic_dec_and_test(&t->usage))
+		__put_task_struct(t);
+}
+
 /* Attach to any functions which should be ignored in wchan output. */
 #define __sched		__attribute__((__section__(".sched.text")))
 
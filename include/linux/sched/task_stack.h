@@ -9,6 +9,15 @@
 #include <linux/sched.h>
 #include <linux/magic.h>
 
+/*
+ * The stack of a task that might exit goes away with its task_struct;
+ * hold a reference while using it.
+ */
+static inline void *task_stack_page(const struct task_struct *task)
+{
+	return task->stack;
+}
+
 static inline unsigned long *end_of_stack(const struct task_struct *task)
 {
 	return task->stack;
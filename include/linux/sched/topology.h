@@ -28,6 +28,38 @@
 #define SD_PREFER_SIBLING	0x1000	/* Prefer to place tasks in a sibling domain */
 #define SD_OVERLAP		0x2000	/* sched_domains of this level overlap */
 #define SD_NUMA			0x4000	/* cross-node balancing */
+
+#include <linux/numa.h>
+#include <asm/topology.h>
+
+#ifdef CONFIG_SCHED_SMT
+static inline int cpu_smt_flags(void)
+{
+	return SD_SHARE_CPUCAPACITY | SD_SHARE_PKG_RESOURCES;
+}
+
+static inline const struct cpumask *cpu_smt_mask(int cpu)
+{
+	return topology_sibling_cpumask(cpu);
+}
+#endif
+
+#ifdef CONFIG_SCHED_MC
+static inline int cpu_core_flags(void)
+{
+	return SD_SHARE_PKG_RESOURCES;
+}
+#endif
+
+static inline int cpu_numa_flags(void)
+{
+	return SD_NUMA;
+}
+
+static inline const struct cpumask *cpu_cpu_mask(int cpu)
+{
+	return cpumask_of_node(cpu_to_node(cpu));
+}
 #endif
 
 struct sched_domain_shared {
@@ -55,6 +87,7 @@ struct sched_domain {
 	int nohz_idle;			/* NOHZ IDLE status */
 	int flags;			/* See SD_* */
 	int level;
+	char *name;			/* topology level, see sd_init() */
 
 	/* Runtime fields. */
 	unsigned long last_balance;	/* init to jiffies. units in jiffies */
@@ -114,11 +147,47 @@ struct sched_domain_attr {
 	int relax_domain_level;
 };
 
+#define SD_ATTR_INIT	(struct sched_domain_attr) {	\
+	.relax_domain_level = -1,			\
+}
+
+#ifdef CONFIG_SMP
+extern void partition_sched_domains(int ndoms_new, cpumask_t *doms_new[],
+				    struct sched_domain_attr *dattr_new);
+
+/* Allocate an array of sched domains, for partition_sched_domains(). */
+cpumask_t **alloc_sched_domains(unsigned int ndoms);
+void free_sched_domains(cpumask_t **doms, unsigned int ndoms);
+
+typedef const struct cpumask *(*sched_domain_mask_f)(int cpu);
+typedef int (*sched_domain_flags_f)(void);
+
+#define SDTL_OVERLAP	0x01
+
+struct sd_data {
+	struct sched_domain *__percpu *sd;
+	struct sched_domain_shared *__percpu *sds;
+	struct sched_group *__percpu *sg;
+	struct sched_group_capacity *__percpu *sgc;
+};
+
+struct sched_domain_topology_level {
+	sched_domain_mask_f mask;
+	sched_domain_flags_f sd_flags;
+	int		    flags;
+	int		    numa_level;
+	struct sd_data      data;
+	char                *name;
+};
+
+#define SD_INIT_NAME(type)		.name = #type
+#else
 static inline void
 partition_sched_domains(int ndoms_new, cpumask_t *doms_new[],
 			struct sched_domain_attr *dattr_new)
 {
 }
+#endif
 
 #ifdef CONFIG_SMP
 bool cpus_share_cache(int this_cpu, int that_cpu);
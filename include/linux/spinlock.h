@@ -321,4 +321,14 @@ extern int _atomic_dec_and_lock(atomic_t *atomic, spinlock_t *lock);
 #define atomic_dec_and_lock(atomic, lock) \
 		__cond_lock(lock, _atomic_dec_and_lock(atomic, lock))
 
+#ifdef CONFIG_QUEUED_LOCK_STAT
+extern void qstat_enable(bool on);
+extern void qstat_dump(void);
+extern void qstat_reset(void);
+#else
+static inline void qstat_enable(bool on) { }
+static inline void qstat_dump(void) { }
+static inline void qstat_reset(void) { }
+#endif
+
 #endif /* __LINUX_SPINLOCK_H */
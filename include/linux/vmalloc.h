@@ -72,6 +72,26 @@ static inline size_t get_vm_area_size(const struct vm_struct *area)
 
 }
 
+extern struct vm_struct *find_vm_area(const void *addr);
+extern void free_vm_area(struct vm_struct *area);
+extern int map_vm_area(struct vm_struct *area, pgprot_t prot,
+			struct page **pages);
+extern int map_kernel_range_noflush(unsigned long start, unsigned long size,
+				    pgprot_t prot, struct page **pages);
+extern void unmap_kernel_range_noflush(unsigned long addr, unsigned long size);
+extern void unmap_kernel_range(unsigned long addr, unsigned long size);
+
+extern struct page *vmalloc_to_page(const void *addr);
+extern unsigned long vmalloc_to_pfn(const void *addr);
+
+#ifdef CONFIG_SMP
+struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
+				     const size_t *sizes, int nr_vms,
+				     size_t align);
+
+void pcpu_free_vm_areas(struct vm_struct **vms, int nr_vms);
+#endif
+
 #ifdef CONFIG_MMU
 #define VMALLOC_TOTAL (VMALLOC_END - VMALLOC_START)
 #else
@@ -25,6 +25,7 @@
 #include <linux/interrupt.h>
 #include <linux/irq.h>
 #include <linux/jump_label.h>
+#include <linux/sched/task.h>
 #include <linux/sched/task_stack.h>
 #include <linux/init_task.h>
 #include <linux/cpu.h>
@@ -35,6 +36,7 @@
 #include <linux/delay.h>
 #include <linux/random.h>
 #include <linux/vmalloc.h>
+#include <linux/sort.h>
 
 #include <asm/memory.h>
 #include <asm/sections.h>
@@ -99,6 +101,219 @@ void __init parse_early_param(void)
 	done = 1;
 }
 
+#ifdef CONFIG_BOOT_TIMELINE
+/*
+ * Boot timeline: every start_kernel() phase and initcall is timed with
+ * the architected counter, which runs from reset and needs no set up,
+ * and recorded in a static table. The table is printed slowest first
+ * once boot is done, flagging anything over boot_timeline_budget=<us>.
+ */
+#define BOOT_TIMELINE_ENTRIES	256
+
+struct boot_timeline_entry {
+	const char *name;
+	void *fn;
+	u64 start;
+	u64 cycles;
+};
+
+static struct boot_timeline_entry boot_timeline[BOOT_TIMELINE_ENTRIES] __initdata;
+static unsigned int boot_timeline_nr __initdata;
+static unsigned int boot_timeline_dropped __initdata;
+static unsigned long boot_timeline_budget __initdata;
+
+static int __init boot_timeline_budget_setup(char *arg)
+{
+	if (!arg)
+		return -EINVAL;
+	return kstrtoul(arg, 0, &boot_timeline_budget);
+}
+early_param("boot_timeline_budget", boot_timeline_budget_setup);
+
+static void __init boot_timeline_add(const char *name, void *fn, u64 start)
+{
+	u64 now = arch_timer_read_counter();
+	struct boot_timeline_entry *e;
+
+	if (boot_timeline_nr == BOOT_TIMELINE_ENTRIES) {
+		boot_timeline_dropped++;
+		return;
+	}
+
+	e = &boot_timeline[boot_timeline_nr++];
+	e->name = name;
+	e->fn = fn;
+	e->start = start;
+	e->cycles = now - start;
+}
+
+#define boot_phase(call)						\
+	do {								\
+		u64 __start = arch_timer_read_counter();		\
+									\
+		call;							\
+		boot_timeline_add(#call, NULL, __start);		\
+	} while (0)
+
+static int __init boot_timeline_cmp(const void *a, const void *b)
+{
+	const struct boot_timeline_entry *ea = a, *eb = b;
+
+	if (ea->cycles == eb->cycles)
+		return 0;
+	return ea->cycles < eb->cycles ? 1 : -1;
+}
+
+static u64 __init boot_timeline_us(u64 cycles, u32 rate)
+{
+	return div_u64(cycles * USEC_PER_SEC, rate);
+}
+
+static void __init boot_timeline_dump(void)
+{
+	u32 rate = arch_timer_get_rate();
+	struct boot_timeline_entry *e;
+	u64 first, last = 0, us;
+	unsigned int i;
+
+	if (!boot_timeline_nr)
+		return;
+	if (!rate) {
+		pr_warn("boot timeline: no counter rate, not reporting\n");
+		return;
+	}
+
+	/* recorded in order, so the first entry started first */
+	first = boot_timeline[0].start;
+	for (i = 0; i < boot_timeline_nr; i++)
+		last = max(last, boot_timeline[i].start +
+				 boot_timeline[i].cycles);
+
+	sort(boot_timeline, boot_timeline_nr, sizeof(boot_timeline[0]),
+	     boot_timeline_cmp, NULL);
+
+	pr_info("boot timeline: %u entries, %llu us from first to last\n",
+		boot_timeline_nr, boot_timeline_us(last - first, rate));
+	for (i = 0; i < boot_timeline_nr; i++) {
+		const char *what;
+		char buf[32];
+
+		e = &boot_timeline[i];
+		us = boot_timeline_us(e->cycles, rate);
+		what = e->name;
+		if (!what) {
+			snprintf(buf, sizeof(buf), "%pS", e->fn);
+			what = buf;
+		}
+
+		if (boot_timeline_budget && us > boot_timeline_budget)
+			pr_warn("  %8llu us at +%llu us: %s over budget\n", us,
+				boot_timeline_us(e->start - first, rate), what);
+		else
+			pr_info("  %8llu us at +%llu us: %s\n", us,
+				boot_timeline_us(e->start - first, rate), what);
+	}
+	if (boot_timeline_dropped)
+		pr_info("  %u more entries not recorded\n",
+			boot_timeline_dropped);
+}
+#else
+static inline void boot_timeline_add(const char *name, void *fn, u64 start)
+{
+}
+
+#define boot_phase(call)	call
+
+static inline void boot_timeline_dump(void)
+{
+}
+#endif
+
+int __init do_one_initcall(initcall_t fn)
+{
+	int count = preempt_count();
+	u64 start = arch_timer_read_counter();
+	char msgbuf[64];
+	int ret;
+
+	ret = fn();
+	boot_timeline_add(NULL, fn, start);
+
+	msgbuf[0] = 0;
+
+	if (preempt_count() != count) {
+		sprintf(msgbuf, "preemption imbalance ");
+		preempt_count_set(count);
+	}
+	if (irqs_disabled()) {
+		strlcat(msgbuf, "disabled interrupts ", sizeof(msgbuf));
+		local_irq_enable();
+	}
+	WARN(msgbuf[0], "initcall %pF returned with %s\n", fn, msgbuf);
+
+	return ret;
+}
+
+extern initcall_entry_t __initcall_start[];
+extern initcall_entry_t __initcall0_start[];
+extern initcall_entry_t __initcall1_start[];
+extern initcall_entry_t __initcall2_start[];
+extern initcall_entry_t __initcall3_start[];
+extern initcall_entry_t __initcall4_start[];
+extern initcall_entry_t __initcall5_start[];
+extern initcall_entry_t __initcall6_start[];
+extern initcall_entry_t __initcall7_start[];
+extern initcall_entry_t __initcall_end[];
+
+static initcall_entry_t *initcall_levels[] __initdata = {
+	__initcall0_start,
+	__initcall1_start,
+	__initcall2_start,
+	__initcall3_start,
+	__initcall4_start,
+	__initcall5_start,
+	__initcall6_start,
+	__initcall7_start,
+	__initcall_end,
+};
+
+/* Keep these in sync with initcalls in include/linux/init.h */
+static const char *initcall_level_names[] __initdata = {
+	"pure",
+	"core",
+	"postcore",
+	"arch",
+	"subsys",
+	"fs",
+	"device",
+	"late",
+};
+
+static void __init do_initcall_level(int level)
+{
+	initcall_entry_t *fn;
+
+	pr_debug("initcall level %s\n", initcall_level_names[level]);
+	for (fn = initcall_levels[level]; fn < initcall_levels[level+1]; fn++)
+		do_one_initcall(initcall_from_entry(fn));
+}
+
+static void __init do_initcalls(void)
+{
+	int level;
+
+	for (level = 0; level < ARRAY_SIZE(initcall_levels) - 1; level++)
+		do_initcall_level(level);
+}
+
+static void __init do_pre_smp_initcalls(void)
+{
+	initcall_entry_t *fn;
+
+	for (fn = __initcall_start; fn < __initcall0_start; fn++)
+		do_one_initcall(initcall_from_entry(fn));
+}
+
 /*
  * Set up kernel memory allocators
  */
@@ -106,6 +321,7 @@ static void __init mm_init(void)
 {
 	mem_init();
 	kmem_cache_init();
+	pgtable_cache_init();
 	vmalloc_init();
 }
 extern unsigned long long notrace sched_clock(void);
@@ -125,44 +341,55 @@ asmlinkage __visible void __init start_kernel(void)
 	boot_cpu_init();
 
 	pr_notice("%s", linux_banner);
-	setup_arch(&command_line);
+	boot_phase(setup_arch(&command_line));
 
 	setup_nr_cpu_ids();
-	setup_per_cpu_areas();
+	boot_phase(setup_per_cpu_areas());
 	smp_prepare_boot_cpu();	/* arch-specific boot-cpu hooks */
 
-	build_all_zonelists();
+	boot_phase(build_all_zonelists());
 
 	pr_notice("Kernel command line: %s\n", boot_command_line);
 	parse_early_param();
 
 	jump_label_init();
 
-	mm_init();
+	boot_phase(mm_init());
 
-	setup_per_cpu_pageset();
+	boot_phase(setup_per_cpu_pageset());
 
 	/*
 	 * Set up the scheduler prior starting any interrupts (such as the
 	 * timer interrupt). Full topology setup happens at smp_init()
 	 * time - but meanwhile we still have a functioning scheduler.
 	 */
-	sched_init();
+	boot_phase(sched_init());
+	boot_phase(fork_init());
 
-	radix_tree_init();
+	boot_phase(radix_tree_init());
 
 	/* init some links before init_ISA_irqs() */
-	early_irq_init();
-	init_IRQ();
-
-	time_init();
-	timekeeping_init();
-	hrtimers_init();
-	tick_init_highres();
-	generic_sched_clock_init();
+	boot_phase(early_irq_init());
+	boot_phase(init_IRQ());
+
+	boot_phase(time_init());
+	boot_phase(timekeeping_init());
+	boot_phase(hrtimers_init());
+	boot_phase(tick_init_highres());
+	boot_phase(generic_sched_clock_init());
 	WARN(!irqs_disabled(), "Interrupts were enabled early\n");
 
 	local_irq_enable();
 
-	while(1);
+	do_pre_smp_initcalls();
+
+	boot_phase(sched_init_smp());
+
+	do_initcalls();
+
+	boot_timeline_dump();
+
+	/* Call into cpu_idle with preempt disabled */
+	preempt_disable();
+	cpu_startup_entry(CPUHP_ONLINE);
 }
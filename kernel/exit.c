@@ -1,6 +1,39 @@
+/*
+ *  linux/kernel/exit.c
+ *
+ *  Copyright (C) 1991, 1992  Linus Torvalds
+ */
+
 #include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <linux/preempt.h>
+#include <linux/sched.h>
+#include <linux/sched/task.h>
 
-void do_exit(long error_code)
+/*
+ * Only kernel threads ever exit. Nobody waits to reap them, so the task
+ * goes straight to EXIT_DEAD and the final reference is dropped by
+ * finish_task_switch() once we have switched away for the last time.
+ */
+void __noreturn do_exit(long code)
 {
+	struct task_struct *tsk = current;
+
+	if (unlikely(in_interrupt()))
+		panic("Aiee, killing interrupt handler!");
+	if (unlikely(is_idle_task(tsk)))
+		panic("Attempted to kill the idle task!");
+
+	if (unlikely(tsk->flags & PF_EXITING)) {
+		pr_alert("Fixing recursive fault but reboot is needed!\n");
+		tsk->state = TASK_UNINTERRUPTIBLE;
+		schedule();
+	}
+
+	tsk->flags |= PF_EXITING;
+	tsk->exit_code = code;
+	tsk->exit_state = EXIT_DEAD;
 
+	preempt_disable();
+	do_task_dead();
 }
@@ -12,7 +12,44 @@
  */
 
 #include <linux/sched.h>
+#include <linux/sched/task.h>
 #include <linux/sched/task_stack.h>
+#include <linux/atomic.h>
+#include <linux/cache.h>
+#include <linux/err.h>
+#include <linux/gfp.h>
+#include <linux/init.h>
+#include <linux/kthread.h>
+#include <linux/slab.h>
+
+/* SLAB cache for task_struct structures (tsk->stack is separate) */
+static struct kmem_cache *task_struct_cachep;
+
+/* There is no pid namespace yet, kernel threads just count up */
+static atomic_t last_pid = ATOMIC_INIT(0);
+
+static inline struct task_struct *alloc_task_struct_node(int node)
+{
+	return kmem_cache_alloc_node(task_struct_cachep, GFP_KERNEL, node);
+}
+
+static inline void free_task_struct(struct task_struct *tsk)
+{
+	kmem_cache_free(task_struct_cachep, tsk);
+}
+
+static unsigned long *alloc_thread_stack_node(struct task_struct *tsk, int node)
+{
+	struct page *page = alloc_pages_node(node, GFP_KERNEL | __GFP_ZERO,
+					     THREAD_SIZE_ORDER);
+
+	return page ? page_address(page) : NULL;
+}
+
+static inline void free_thread_stack(struct task_struct *tsk)
+{
+	__free_pages(virt_to_page(tsk->stack), THREAD_SIZE_ORDER);
+}
 
 void set_task_stack_end_magic(struct task_struct *tsk)
 {
@@ -22,3 +59,90 @@ void set_task_stack_end_magic(struct task_struct *tsk)
 	*stackend = STACK_END_MAGIC;	/* for overflow detection */
 }
 
+static void free_task(struct task_struct *tsk)
+{
+	free_thread_stack(tsk);
+	if (tsk->flags & PF_KTHREAD)
+		free_kthread_struct(tsk);
+	free_task_struct(tsk);
+}
+
+void __put_task_struct(struct task_struct *tsk)
+{
+	WARN_ON(!tsk->exit_state);
+	WARN_ON(atomic_read(&tsk->usage));
+	WARN_ON(tsk == current);
+
+	free_task(tsk);
+}
+
+void __init fork_init(void)
+{
+	task_struct_cachep = kmem_cache_create("task_struct",
+			sizeof(struct task_struct), L1_CACHE_BYTES,
+			SLAB_PANIC, NULL);
+}
+
+/*
+ * Only kernel threads exist, so this is the part of copy_process() that
+ * applies to them: a copy of current with its own stack, reset to a
+ * SCHED_NORMAL task that may run anywhere. The caller wakes it up with
+ * wake_up_new_task().
+ */
+struct task_struct *copy_kernel_thread(int (*fn)(void *), void *arg, int node)
+{
+	struct task_struct *p;
+	unsigned long *stack;
+	int retval;
+
+	p = alloc_task_struct_node(node);
+	if (!p)
+		return ERR_PTR(-ENOMEM);
+
+	stack = alloc_thread_stack_node(p, node);
+	if (!stack) {
+		free_task_struct(p);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	*p = *current;
+	p->stack = stack;
+	set_task_stack_end_magic(p);
+	p->thread_info.flags = 0;
+
+	atomic_set(&p->usage, 1);
+	p->flags = PF_KTHREAD;
+	p->worker_private = NULL;
+	p->mm = NULL;
+	p->active_mm = NULL;
+	p->pid = p->tgid = atomic_inc_return(&last_pid);
+	p->exit_state = 0;
+	p->exit_code = 0;
+	p->nvcsw = p->nivcsw = 0;
+	p->utime = p->stime = p->gtime = 0;
+	p->wake_q.next = NULL;
+	raw_spin_lock_init(&p->pi_lock);
+
+	/* Whatever current runs as, the child starts out as a plain task */
+	p->policy = SCHED_NORMAL;
+	p->static_prio = NICE_TO_PRIO(0);
+	p->rt_priority = 0;
+	p->sched_reset_on_fork = 1;
+	cpumask_copy(&p->cpus_allowed, cpu_possible_mask);
+	p->nr_cpus_allowed = nr_possible_cpu_ids;
+
+	retval = sched_fork(0, p);
+	if (retval)
+		goto bad_fork_free;
+
+	retval = copy_thread(0, (unsigned long)fn, (unsigned long)arg, p);
+	if (retval)
+		goto bad_fork_free;
+
+	return p;
+
+bad_fork_free:
+	free_thread_stack(p);
+	free_task_struct(p);
+	return ERR_PTR(retval);
+}
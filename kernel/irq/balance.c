@@ -0,0 +1,368 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * In-kernel interrupt affinity balancing
+ *
+ * Every irqbalance= interval the irqbalance kthread samples how many
+ * interrupts each cpu took and how many each device interrupt raised
+ * since the previous pass, both from kstat. The heaviest interrupts are
+ * then moved, one cpu at a time, from cpus above the average load to the
+ * least loaded cpu of the device's NUMA node, as long as that lowers the
+ * load of the busier of the two.
+ *
+ * Cpus listed in irqbalance_banned= run latency critical work and never
+ * receive a balanced interrupt; interrupts found on them are moved away.
+ * Interrupts that are per cpu, managed, flagged IRQF_NOBALANCING or whose
+ * affinity was set by someone else are left alone. When the irq chip
+ * refuses a target, e.g. a GICv2 cpu interface beyond the eighth, the
+ * next best cpu is tried instead.
+ *
+ * Each decision is printed and kept in a small log which, together with
+ * the loads seen by the last pass, irq_balance_dump() prints again.
+ */
+#include <linux/hrtimer.h>
+#include <linux/irq.h>
+#include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/math64.h>
+#include <linux/numa.h>
+#include <linux/sched/clock.h>
+#include <linux/spinlock.h>
+#include <linux/time64.h>
+
+#include "internal.h"
+
+/* Heaviest interrupts considered, and moved at most, in one pass */
+#define IRQ_BALANCE_CANDIDATES	16
+#define IRQ_BALANCE_MAX_MOVES	4
+/* Interrupts slower than this are not worth moving */
+#define IRQ_BALANCE_MIN_RATE	100
+#define IRQ_BALANCE_LOG		32
+
+struct irq_balance_candidate {
+	struct irq_desc	*desc;
+	unsigned int	delta;
+};
+
+struct irq_balance_decision {
+	u64		time;
+	unsigned int	irq;
+	int		from;
+	int		to;
+	unsigned long	rate;		/* irqs per second */
+	const char	*why;
+};
+
+static unsigned int irq_balance_interval = 10 * MSEC_PER_SEC;
+static cpumask_t irq_balance_banned;
+
+static DEFINE_RAW_SPINLOCK(irq_balance_lock);
+static u64 irq_balance_last;
+static unsigned long irq_balance_passes;
+static unsigned long irq_balance_moves;
+
+/* Interrupts whose affinity is ours to change */
+static DECLARE_BITMAP(irqs_balanced, IRQ_BITMAP_BITS);
+
+static unsigned long irq_balance_sum[NR_CPUS];
+static unsigned long irq_balance_load[NR_CPUS];
+
+static struct irq_balance_decision irq_balance_log[IRQ_BALANCE_LOG];
+static unsigned int irq_balance_log_next;
+
+static int __init irq_balance_setup(char *str)
+{
+	if (!str)
+		return -EINVAL;
+
+	return kstrtouint(str, 0, &irq_balance_interval);
+}
+early_param("irqbalance", irq_balance_setup);
+
+static int __init irq_balance_banned_setup(char *str)
+{
+	if (!str)
+		return -EINVAL;
+
+	return cpulist_parse(str, &irq_balance_banned);
+}
+early_param("irqbalance_banned", irq_balance_banned_setup);
+
+static bool irq_balance_movable(unsigned int irq, struct irq_desc *desc)
+{
+	struct irq_data *d = irq_desc_get_irq_data(desc);
+
+	if (!desc->action || !irqd_can_balance(d) || irqd_affinity_is_managed(d))
+		return false;
+	if (!d->chip || !d->chip->irq_set_affinity)
+		return false;
+
+	return !irqd_affinity_was_set(d) || test_bit(irq, irqs_balanced);
+}
+
+static unsigned int irq_balance_count(struct irq_desc *desc)
+{
+	unsigned int sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *per_cpu_ptr(desc->kstat_irqs, cpu);
+	return sum;
+}
+
+/* Keep the IRQ_BALANCE_CANDIDATES heaviest interrupts, heaviest first */
+static void irq_balance_add(struct irq_balance_candidate *cand,
+			    struct irq_desc *desc, unsigned int delta)
+{
+	int i = IRQ_BALANCE_CANDIDATES - 1;
+
+	if (delta <= cand[i].delta)
+		return;
+
+	for (; i > 0 && cand[i - 1].delta < delta; i--)
+		cand[i] = cand[i - 1];
+	cand[i].desc = desc;
+	cand[i].delta = delta;
+}
+
+static int irq_balance_current_cpu(struct irq_desc *desc)
+{
+	struct irq_data *d = irq_desc_get_irq_data(desc);
+	int cpu;
+
+	cpu = cpumask_first(irq_data_get_effective_affinity_mask(d));
+	if (cpu >= nr_possible_cpu_ids)
+		cpu = cpumask_first_and(irq_data_get_affinity_mask(d),
+					cpu_online_mask);
+	return cpu;
+}
+
+static int irq_balance_least_loaded(const cpumask_t *mask)
+{
+	unsigned long min = ULONG_MAX;
+	int cpu, best = nr_possible_cpu_ids;
+
+	for_each_cpu_mask(cpu, mask) {
+		if (irq_balance_load[cpu] < min) {
+			min = irq_balance_load[cpu];
+			best = cpu;
+		}
+	}
+	return best;
+}
+
+static void irq_balance_record(u64 now, unsigned int irq, int from, int to,
+			       unsigned long rate, const char *why)
+{
+	struct irq_balance_decision *dec;
+
+	dec = &irq_balance_log[irq_balance_log_next++ % IRQ_BALANCE_LOG];
+	dec->time = now;
+	dec->irq = irq;
+	dec->from = from;
+	dec->to = to;
+	dec->rate = rate;
+	dec->why = why;
+
+	pr_info("irqbalance: irq %u %lu/s cpu%d -> cpu%d (%s)\n",
+		irq, rate, from, to, why);
+}
+
+/*
+ * Move @desc off @from onto the least loaded cpu of @allowed that the
+ * irq chip accepts, provided it ends up less loaded than @from is now.
+ */
+static int irq_balance_move(struct irq_desc *desc, int from,
+			    const cpumask_t *allowed, unsigned int delta,
+			    bool must)
+{
+	unsigned int irq = irq_desc_get_irq(desc);
+	cpumask_t targets;
+	int to;
+
+	cpumask_copy(&targets, allowed);
+	cpumask_clear_cpu(from, &targets);
+
+	while ((to = irq_balance_least_loaded(&targets)) < nr_possible_cpu_ids) {
+		if (!must &&
+		    irq_balance_load[to] + delta >= irq_balance_load[from])
+			break;
+
+		if (!__irq_set_affinity(irq, cpumask_of(to), false)) {
+			set_bit(irq, irqs_balanced);
+			irq_balance_load[from] -= min_t(unsigned long, delta,
+							irq_balance_load[from]);
+			irq_balance_load[to] += delta;
+			return to;
+		}
+		cpumask_clear_cpu(to, &targets);
+	}
+
+	return -1;
+}
+
+static void irq_balance_pass(u64 now)
+{
+	struct irq_balance_candidate cand[IRQ_BALANCE_CANDIDATES] = { };
+	u64 elapsed = now - irq_balance_last;
+	unsigned long total = 0, avg;
+	cpumask_t allowed, node_allowed;
+	unsigned int irq, moves = 0;
+	int cpu, i;
+
+	cpumask_complement(&allowed, &irq_balance_banned);
+	cpumask_and(&allowed, &allowed, cpu_online_mask);
+
+	for_each_possible_cpu(cpu) {
+		unsigned long sum = READ_ONCE(kstat_cpu(cpu).irqs_sum);
+
+		irq_balance_load[cpu] = sum - irq_balance_sum[cpu];
+		irq_balance_sum[cpu] = sum;
+		if (cpumask_is_set(cpu, &allowed))
+			total += irq_balance_load[cpu];
+	}
+
+	for_each_active_irq(irq) {
+		struct irq_desc *desc = irq_to_desc(irq);
+		unsigned int count, delta;
+
+		if (!desc || !desc->kstat_irqs)
+			continue;
+
+		count = irq_balance_count(desc);
+		delta = count - desc->balance_count;
+		desc->balance_count = count;
+
+		if (delta && irq_balance_movable(irq, desc))
+			irq_balance_add(cand, desc, delta);
+	}
+
+	/* The first pass only takes the snapshot the next one compares to */
+	if (!irq_balance_passes++ || cpumask_empty(&allowed) || !elapsed)
+		goto out;
+
+	avg = total / cpumask_weight(&allowed);
+
+	for (i = 0; i < IRQ_BALANCE_CANDIDATES && cand[i].desc; i++) {
+		struct irq_desc *desc = cand[i].desc;
+		int node = irq_desc_get_node(desc);
+		unsigned long rate;
+		const char *why;
+		bool must;
+		int to;
+
+		rate = div64_u64((u64)cand[i].delta * NSEC_PER_SEC, elapsed);
+		cpu = irq_balance_current_cpu(desc);
+		if (cpu >= nr_possible_cpu_ids)
+			continue;
+
+		cpumask_copy(&node_allowed, &allowed);
+		if (node != NUMA_NO_NODE &&
+		    cpumask_intersects(&allowed, cpumask_of_node(node)))
+			cpumask_and(&node_allowed, &node_allowed,
+				    cpumask_of_node(node));
+
+		if (cpumask_is_set(cpu, &irq_balance_banned)) {
+			why = "banned cpu";
+			must = true;
+		} else if (!cpumask_is_set(cpu, &node_allowed)) {
+			why = "remote node";
+			must = true;
+		} else if (rate >= IRQ_BALANCE_MIN_RATE &&
+			   irq_balance_load[cpu] > avg) {
+			why = "load";
+			must = false;
+		} else {
+			continue;
+		}
+
+		to = irq_balance_move(desc, cpu, &node_allowed, cand[i].delta, must);
+		if (to < 0)
+			continue;
+
+		irq_balance_record(now, irq_desc_get_irq(desc), cpu, to, rate, why);
+		if (++moves >= IRQ_BALANCE_MAX_MOVES)
+			break;
+	}
+	irq_balance_moves += moves;
+out:
+	irq_balance_last = now;
+}
+
+/*
+ * Body of the "irqbalance" kthread: a pass, then sleep for the interval.
+ * The lock is taken irqsave, as irq_balance_dump() may be called from
+ * any context.
+ */
+static int irq_balance_thread(void *none)
+{
+	ktime_t interval = ms_to_ktime(irq_balance_interval);
+	unsigned long flags;
+
+	while (!kthread_should_stop()) {
+		raw_spin_lock_irqsave(&irq_balance_lock, flags);
+		irq_balance_pass(sched_clock());
+		raw_spin_unlock_irqrestore(&irq_balance_lock, flags);
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop())
+			schedule_hrtimeout(&interval, HRTIMER_MODE_REL);
+		__set_current_state(TASK_RUNNING);
+	}
+
+	return 0;
+}
+
+static int __init irq_balance_init(void)
+{
+	struct task_struct *k;
+
+	if (!irq_balance_interval)
+		return 0;
+
+	k = kthread_run(irq_balance_thread, NULL, "irqbalance");
+	if (IS_ERR(k)) {
+		pr_err("irqbalance: failed to start: %ld\n", PTR_ERR(k));
+		return PTR_ERR(k);
+	}
+
+	return 0;
+}
+subsys_initcall(irq_balance_init);
+
+/**
+ * irq_balance_dump - print the balancing report
+ *
+ * The interrupt load of every online cpu as seen by the last pass,
+ * followed by the most recent balancing decisions, oldest first.
+ */
+void irq_balance_dump(void)
+{
+	unsigned long flags;
+	unsigned int i;
+	int cpu;
+
+	raw_spin_lock_irqsave(&irq_balance_lock, flags);
+
+	pr_info("irqbalance: %lu passes every %u ms, %lu moves, banned cpus %*pbl\n",
+		irq_balance_passes, irq_balance_interval, irq_balance_moves,
+		cpumask_pr_args(&irq_balance_banned));
+
+	for_each_online_cpu(cpu)
+		pr_info("irqbalance: cpu%d node %d: %lu irqs in last pass\n",
+			cpu, cpu_to_node(cpu), irq_balance_load[cpu]);
+
+	i = irq_balance_log_next > IRQ_BALANCE_LOG ?
+		irq_balance_log_next - IRQ_BALANCE_LOG : 0;
+	for (; i < irq_balance_log_next; i++) {
+		struct irq_balance_decision *dec =
+			&irq_balance_log[i % IRQ_BALANCE_LOG];
+
+		pr_info("irqbalance: [%llu ms] irq %u %lu/s cpu%d -> cpu%d (%s)\n",
+			div_u64(dec->time, NSEC_PER_MSEC), dec->irq, dec->rate,
+			dec->from, dec->to, dec->why);
+	}
+
+	raw_spin_unlock_irqrestore(&irq_balance_lock, flags);
+}
@@ -177,9 +177,13 @@ irqreturn_t handle_irq_event_percpu(struct irq_desc *desc)
 {
 	irqreturn_t retval;
 	unsigned int flags = 0;
+	u64 start = irq_hist_start();
 
 	retval = __handle_irq_event_percpu(desc, &flags);
 
+	if (start)
+		irq_hist_record(desc, start);
+
 	//add_interrupt_randomness(desc->irq_data.irq, flags);
 
 	if (!noirqdebug)
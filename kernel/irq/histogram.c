@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Per-cpu histograms of interrupt handler duration and arrival rate
+ *
+ * handle_irq_event_percpu() stamps each interrupt with the architected
+ * counter before running its actions and accounts it here afterwards,
+ * in the per-cpu struct irq_hist of the descriptor. Nothing is shared
+ * between cpus, so recording takes no lock and no atomic operation.
+ *
+ * Recording is off until the "irqhist" boot parameter or
+ * irq_hist_enable() turns it on. irq_hist_dump() prints the histograms
+ * of one interrupt, irq_hist_dump_all() those of every interrupt seen
+ * so far, and irq_hist_reset() clears them. The tree has no debugfs, so
+ * these are kernel calls rather than files; everything recorded during
+ * boot is dumped and cleared once at the end of it.
+ *
+ * "irqstorm=<rate>" also enables recording, and note_interrupt() then
+ * throttles a line that fires more than <rate> times a second on one cpu,
+ * see irq_hist_storm().
+ */
+#include <linux/irq.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
+#include <linux/string.h>
+#include <linux/time64.h>
+#include <linux/timex.h>
+
+#include <clocksource/arm_arch_timer.h>
+
+#include "internal.h"
+
+#define IRQ_HIST_BUCKETS	32
+
+/* Arrival rate is checked over windows of this length */
+#define IRQ_STORM_WINDOW_MS	10
+
+struct irq_hist {
+	u64	count;
+	u64	last;			/* arrival of the previous interrupt */
+	u64	total;			/* ticks spent in the actions */
+	u64	max;
+	u32	dur[IRQ_HIST_BUCKETS];	/* by fls64() of the handler duration */
+	u32	gap[IRQ_HIST_BUCKETS];	/* by fls64() of the inter-arrival time */
+	u64	window_start;		/* see irq_hist_storm() */
+	u32	window_count;
+};
+
+bool irq_hist_enabled __read_mostly;
+
+static unsigned int irq_storm_rate __read_mostly;
+static u64 irq_storm_window __read_mostly;
+static u32 irq_storm_limit __read_mostly;
+
+static int __init irq_hist_setup(char *str)
+{
+	irq_hist_enabled = true;
+	return 0;
+}
+early_param("irqhist", irq_hist_setup);
+
+static int __init irq_storm_setup(char *str)
+{
+	unsigned int rate;
+
+	if (!str || kstrtouint(str, 0, &rate) || !rate)
+		return -EINVAL;
+
+	irq_storm_rate = rate;
+	irq_hist_enabled = true;
+	return 0;
+}
+early_param("irqstorm", irq_storm_setup);
+
+void irq_hist_enable(bool on)
+{
+	WRITE_ONCE(irq_hist_enabled, on);
+}
+
+int irq_hist_alloc(struct irq_desc *desc)
+{
+	desc->hist = alloc_percpu(struct irq_hist);
+	return desc->hist ? 0 : -ENOMEM;
+}
+
+void irq_hist_free(struct irq_desc *desc)
+{
+	free_percpu(desc->hist);
+	desc->hist = NULL;
+}
+
+void irq_hist_record(struct irq_desc *desc, u64 start)
+{
+	struct irq_hist *h = this_cpu_ptr(desc->hist);
+	u64 dur = get_cycles() - start;
+
+	if (h->last)
+		h->gap[min(fls64(start - h->last), IRQ_HIST_BUCKETS - 1)]++;
+	h->last = start;
+
+	h->count++;
+	h->total += dur;
+	if (dur > h->max)
+		h->max = dur;
+	h->dur[min(fls64(dur), IRQ_HIST_BUCKETS - 1)]++;
+}
+
+/**
+ * irq_hist_storm - check the arrival rate of an interrupt on this cpu
+ * @desc:	the interrupt description structure for this irq
+ *
+ * Called from note_interrupt() for every interrupt handled. Counts the
+ * arrivals within the current IRQ_STORM_WINDOW_MS window and returns true
+ * once they exceed the "irqstorm=" rate.
+ */
+bool irq_hist_storm(struct irq_desc *desc)
+{
+	struct irq_hist *h;
+	u64 now;
+
+	if (!irq_storm_window || !READ_ONCE(irq_hist_enabled))
+		return false;
+
+	h = this_cpu_ptr(desc->hist);
+	now = get_cycles();
+	if (now - h->window_start > irq_storm_window) {
+		h->window_start = now;
+		h->window_count = 0;
+	}
+
+	return ++h->window_count > irq_storm_limit;
+}
+
+static int __init irq_storm_init(void)
+{
+	u32 rate = arch_timer_get_rate();
+
+	if (!irq_storm_rate || !rate)
+		return 0;
+
+	irq_storm_limit = max(irq_storm_rate / (MSEC_PER_SEC / IRQ_STORM_WINDOW_MS), 1U);
+	irq_storm_window = div_u64((u64)rate * IRQ_STORM_WINDOW_MS, MSEC_PER_SEC);
+	irq_storm_throttle_init();
+
+	pr_info("irqhist: throttling lines above %u irqs/s per cpu\n",
+		irq_storm_rate);
+	return 0;
+}
+core_initcall(irq_storm_init);
+
+static u64 irq_hist_ns(u64 ticks)
+{
+	u32 khz = arch_timer_get_rate() / 1000;
+
+	return khz ? div_u64(ticks * (NSEC_PER_SEC / 1000), khz) : ticks;
+}
+
+static void irq_hist_print(unsigned int irq, int cpu, const char *what,
+			   const u32 *bucket)
+{
+	char buf[IRQ_HIST_BUCKETS * 20];
+	int i, len = 0;
+
+	for (i = 0; i < IRQ_HIST_BUCKETS; i++) {
+		if (!bucket[i])
+			continue;
+		if (i == IRQ_HIST_BUCKETS - 1)
+			len += scnprintf(buf + len, sizeof(buf) - len, " >=%llu:%u",
+					 irq_hist_ns(1ULL << (i - 1)), bucket[i]);
+		else
+			len += scnprintf(buf + len, sizeof(buf) - len, " <%llu:%u",
+					 irq_hist_ns(1ULL << i), bucket[i]);
+	}
+	pr_info("irqhist: %u/cpu%d %s ns%s\n", irq, cpu, what,
+		len ? buf : " empty");
+}
+
+/**
+ * irq_hist_dump - print the histograms of an interrupt
+ * @irq:	Interrupt number
+ *
+ * One line with the count, average and maximum handler time per cpu the
+ * interrupt fired on, followed by its handler duration and inter-arrival
+ * histograms.
+ */
+void irq_hist_dump(unsigned int irq)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+	int cpu;
+
+	if (!desc || !desc->hist)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct irq_hist *h = per_cpu_ptr(desc->hist, cpu);
+
+		if (!h->count)
+			continue;
+
+		pr_info("irqhist: %u/cpu%d %s: %llu irqs, %llu ns avg, %llu ns max\n",
+			irq, cpu, desc->action ? desc->action->name : "-",
+			h->count, irq_hist_ns(div64_u64(h->total, h->count)),
+			irq_hist_ns(h->max));
+		irq_hist_print(irq, cpu, "handler", h->dur);
+		irq_hist_print(irq, cpu, "inter-arrival", h->gap);
+	}
+}
+
+void irq_hist_dump_all(void)
+{
+	unsigned int irq;
+
+	for_each_active_irq(irq)
+		irq_hist_dump(irq);
+}
+
+/*
+ * Recording is paused while the histograms are cleared; an interrupt
+ * being accounted concurrently on another cpu may still be miscounted.
+ */
+void irq_hist_reset(void)
+{
+	bool enabled = READ_ONCE(irq_hist_enabled);
+	unsigned int irq;
+	int cpu;
+
+	WRITE_ONCE(irq_hist_enabled, false);
+	for_each_active_irq(irq) {
+		struct irq_desc *desc = irq_to_desc(irq);
+
+		if (!desc || !desc->hist)
+			continue;
+		for_each_possible_cpu(cpu)
+			memset(per_cpu_ptr(desc->hist, cpu), 0,
+			       sizeof(struct irq_hist));
+	}
+	WRITE_ONCE(irq_hist_enabled, enabled);
+}
+
+static int __init irq_hist_boot_dump(void)
+{
+	if (!irq_hist_enabled)
+		return 0;
+
+	pr_info("irqhist: interrupts during boot\n");
+	irq_hist_dump_all();
+	irq_hist_reset();
+
+	return 0;
+}
+late_initcall(irq_hist_boot_dump);
@@ -11,6 +11,7 @@
 
 #include <linux/irqdesc.h>
 #include <linux/kernel_stat.h>
+#include <linux/timex.h>
 
 #define istate core_internal_state__do_not_mess_with_it
 
@@ -227,6 +228,30 @@ static inline void irq_setup_timings(struct irq_desc *desc,
 				     struct irqaction *act) {};
 static inline void record_irq_time(struct irq_desc *desc) {}
 
+#ifdef CONFIG_IRQ_HISTOGRAM
+extern bool irq_hist_enabled;
+
+extern int irq_hist_alloc(struct irq_desc *desc);
+extern void irq_hist_free(struct irq_desc *desc);
+extern void irq_hist_record(struct irq_desc *desc, u64 start);
+extern bool irq_hist_storm(struct irq_desc *desc);
+extern void irq_storm_throttle_init(void);
+
+/* Counter value to hand to irq_hist_record(), or 0 when not recording */
+static inline u64 irq_hist_start(void)
+{
+	if (!READ_ONCE(irq_hist_enabled))
+		return 0;
+	return get_cycles() ?: 1;
+}
+#else
+static inline int irq_hist_alloc(struct irq_desc *desc) { return 0; }
+static inline void irq_hist_free(struct irq_desc *desc) { }
+static inline void irq_hist_record(struct irq_desc *desc, u64 start) { }
+static inline bool irq_hist_storm(struct irq_desc *desc) { return false; }
+static inline u64 irq_hist_start(void) { return 0; }
+#endif
+
 static inline void register_irq_proc(unsigned int irq, struct irq_desc *desc) { }
 static inline void unregister_irq_proc(unsigned int irq, struct irq_desc *desc) { }
 static inline void register_handler_proc(unsigned int irq,
@@ -12,8 +12,10 @@
 #include <linux/interrupt.h>
 #include <linux/irq.h>
 #include <linux/slab.h>
-#include <linux/radix-tree.h>
 #include <linux/bitmap.h>
+#include <linux/log2.h>
+#include <linux/overflow.h>
+#include <linux/rcupdate.h>
 #include <linux/irqdomain.h>
 #include <linux/lockdep.h>
 #include <linux/mutex.h>
@@ -55,15 +57,17 @@ static void __init init_irq_default_affinity(void)
 #ifdef CONFIG_SMP
 static int alloc_masks(struct irq_desc *desc, int node)
 {
-	//if (!zalloc_cpumask_var_node(&desc->irq_common_data.affinity,
-	//			     GFP_KERNEL, node))
-	//	return -ENOMEM;
+	desc->irq_common_data.affinity = kzalloc_node(cpumask_size(),
+						      GFP_KERNEL, node);
+	if (!desc->irq_common_data.affinity)
+		return -ENOMEM;
 
-	//if (!zalloc_cpumask_var_node(&desc->irq_common_data.effective_affinity,
-	//			     GFP_KERNEL, node)) {
-		//free_cpumask_var(desc->irq_common_data.affinity);
-	//	return -ENOMEM;
-	//}
+	desc->irq_common_data.effective_affinity = kzalloc_node(cpumask_size(),
+								GFP_KERNEL, node);
+	if (!desc->irq_common_data.effective_affinity) {
+		kfree(desc->irq_common_data.affinity);
+		return -ENOMEM;
+	}
 
 	return 0;
 }
@@ -73,7 +77,7 @@ static void desc_smp_init(struct irq_desc *desc, int node,
 {
 	if (!affinity)
 		affinity = irq_default_affinity;
-//	cpumask_copy(desc->irq_common_data.affinity, affinity);
+	cpumask_copy(desc->irq_common_data.affinity, affinity);
 
 	desc->irq_common_data.node = node;
 }
@@ -115,28 +119,92 @@ int nr_irqs = NR_IRQS;
 
 static DECLARE_BITMAP(allocated_irqs, IRQ_BITMAP_BITS);
 
-static RADIX_TREE(irq_desc_tree, GFP_KERNEL);
+static DEFINE_MUTEX(sparse_irq_lock);
+
+/*
+ * Descriptors are looked up by irq number on every interrupt, so they
+ * live in a flat array indexed by it instead of a radix tree. The array
+ * grows in powers of two up to IRQ_BITMAP_BITS: a larger copy is
+ * published with rcu_assign_pointer(), so readers in interrupt context
+ * never take a lock. Updates are serialized by sparse_irq_lock.
+ *
+ * A reader may still hold the previous table after the new one is
+ * published, and synchronize_rcu() doesn't wait for it here, so a
+ * superseded table is retired for good instead of freed. With the size
+ * doubling each time, all retired tables together stay smaller than the
+ * largest one.
+ */
+struct irq_desc_table {
+	unsigned int		size;
+	struct irq_desc		*descs[];
+};
+
+#define IRQ_DESC_TABLE_MIN	64
+
+static struct irq_desc_table __rcu *irq_desc_table;
 
-static void irq_insert_desc(unsigned int irq, struct irq_desc *desc)
+static int irq_grow_desc_table(unsigned int irq)
 {
-	radix_tree_insert(&irq_desc_tree, irq, desc);
+	struct irq_desc_table *old, *new;
+	unsigned int size;
+
+	old = rcu_dereference_raw(irq_desc_table);
+	size = max_t(unsigned int, roundup_pow_of_two(irq + 1),
+		     IRQ_DESC_TABLE_MIN);
+	size = min_t(unsigned int, size, IRQ_BITMAP_BITS);
+
+	new = kzalloc(struct_size(new, descs, size), GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+
+	new->size = size;
+	if (old)
+		memcpy(new->descs, old->descs, old->size * sizeof(old->descs[0]));
+
+	/* Never freed, see above */
+	rcu_assign_pointer(irq_desc_table, new);
+	return 0;
+}
+
+static int irq_insert_desc(unsigned int irq, struct irq_desc *desc)
+{
+	struct irq_desc_table *table = rcu_dereference_raw(irq_desc_table);
+
+	if (!table || irq >= table->size) {
+		int ret = irq_grow_desc_table(irq);
+
+		if (ret)
+			return ret;
+		table = rcu_dereference_raw(irq_desc_table);
+	}
+
+	/* Publish the initialized descriptor, pairs with irq_to_desc() */
+	smp_store_release(&table->descs[irq], desc);
+	return 0;
 }
 
 struct irq_desc *irq_to_desc(unsigned int irq)
 {
-	return radix_tree_lookup(&irq_desc_tree, irq);
+	struct irq_desc_table *table = rcu_dereference_raw(irq_desc_table);
+
+	if (unlikely(!table || irq >= table->size))
+		return NULL;
+	return READ_ONCE(table->descs[irq]);
 }
 
 static void delete_irq_desc(unsigned int irq)
 {
-	radix_tree_delete(&irq_desc_tree, irq);
+	struct irq_desc_table *table = rcu_dereference_raw(irq_desc_table);
+
+	if (table && irq < table->size)
+		WRITE_ONCE(table->descs[irq], NULL);
 }
 
 #ifdef CONFIG_SMP
 static void free_masks(struct irq_desc *desc)
 {
-	//free_cpumask_var(desc->irq_common_data.affinity);
-	//free_cpumask_var(desc->irq_common_data.effective_affinity);
+	kfree(desc->irq_common_data.affinity);
+	kfree(desc->irq_common_data.effective_affinity);
 }
 #else
 static inline void free_masks(struct irq_desc *desc) { }
@@ -144,12 +212,12 @@ static inline void free_masks(struct irq_desc *desc) { }
 
 void irq_lock_sparse(void)
 {
-	/* TODO */
+	mutex_lock(&sparse_irq_lock);
 }
 
 void irq_unlock_sparse(void)
 {
-	/* TODO */
+	mutex_unlock(&sparse_irq_lock);
 }
 
 static struct irq_desc *alloc_desc(int irq, int node, unsigned int flags,
@@ -169,6 +237,9 @@ static struct irq_desc *alloc_desc(int irq, int node, unsigned int flags,
 	if (alloc_masks(desc, node))
 		goto err_kstat;
 
+	if (irq_hist_alloc(desc))
+		goto err_masks;
+
 	raw_spin_lock_init(&desc->lock);
 	lockdep_set_class(&desc->lock, &irq_desc_lock_class);
 	mutex_init(&desc->request_mutex);
@@ -179,6 +250,8 @@ static struct irq_desc *alloc_desc(int irq, int node, unsigned int flags,
 
 	return desc;
 
+err_masks:
+	free_masks(desc);
 err_kstat:
 	free_percpu(desc->kstat_irqs);
 err_desc:
@@ -188,6 +261,7 @@ err_desc:
 
 static void irq_release(struct irq_desc *desc)
 {
+	irq_hist_free(desc);
 	free_masks(desc);
 	free_percpu(desc->kstat_irqs);
 	kfree(desc);
@@ -249,7 +323,10 @@ static int alloc_descs(unsigned int start, unsigned int cnt, int node,
 		desc = alloc_desc(start + i, node, flags, mask, owner);
 		if (!desc)
 			goto err;
-		irq_insert_desc(start + i, desc);
+		if (irq_insert_desc(start + i, desc)) {
+			irq_release(desc);
+			goto err;
+		}
 	}
 	bitmap_set(allocated_irqs, start, cnt);
 	return start;
@@ -292,7 +369,8 @@ int __init early_irq_init(void)
 	for (i = 0; i < initcnt; i++) {
 		desc = alloc_desc(i, node, 0, NULL, NULL);
 		set_bit(i, allocated_irqs);
-		irq_insert_desc(i, desc);
+		if (irq_insert_desc(i, desc))
+			panic("Unable to allocate the irq descriptor table\n");
 	}
 	return arch_early_irq_init();
 }
@@ -325,23 +403,25 @@ int __handle_domain_irq(struct irq_domain *domain, unsigned int hwirq,
 			bool lookup, struct pt_regs *regs)
 {
 	struct pt_regs *old_regs = set_irq_regs(regs);
-	unsigned int irq = hwirq;
+	struct irq_desc *desc;
 	int ret = 0;
 
 	irq_enter();
 
 	if (lookup)
-		irq = irq_find_mapping(domain, hwirq);
+		desc = irq_resolve_mapping(domain, hwirq);
+	else
+		desc = likely(hwirq) ? irq_to_desc(hwirq) : NULL;
 
 	/*
 	 * Some hardware gives randomly wrong interrupts.  Rather
 	 * than crashing, do something sensible.
 	 */
-	if (unlikely(!irq || irq >= nr_irqs)) {
-		ack_bad_irq(irq);
+	if (unlikely(!desc)) {
+		ack_bad_irq(hwirq);
 		ret = -EINVAL;
 	} else {
-		generic_handle_irq(irq);
+		generic_handle_irq_desc(desc);
 	}
 
 	irq_exit();
@@ -363,12 +443,12 @@ void irq_free_descs(unsigned int from, unsigned int cnt)
 	if (from >= nr_irqs || (from + cnt) > nr_irqs)
 		return;
 
-	//mutex_lock(&sparse_irq_lock);
+	mutex_lock(&sparse_irq_lock);
 	for (i = 0; i < cnt; i++)
 		free_desc(from + i);
 
 	bitmap_clear(allocated_irqs, from, cnt);
-	//mutex_unlock(&sparse_irq_lock);
+	mutex_unlock(&sparse_irq_lock);
 }
 
 /**
@@ -406,7 +486,7 @@ __irq_alloc_descs(int irq, unsigned int from, unsigned int cnt, int node,
 		from = arch_dynirq_lower_bound(from);
 	}
 
-	//mutex_lock(&sparse_irq_lock);
+	mutex_lock(&sparse_irq_lock);
 
 	start = bitmap_find_next_zero_area(allocated_irqs, IRQ_BITMAP_BITS,
 					   from, cnt, 0);
@@ -421,7 +501,7 @@ __irq_alloc_descs(int irq, unsigned int from, unsigned int cnt, int node,
 	}
 	ret = alloc_descs(start, cnt, node, affinity, owner);
 unlock:
-	//mutex_unlock(&sparse_irq_lock);
+	mutex_unlock(&sparse_irq_lock);
 	return ret;
 }
 
@@ -9,6 +9,8 @@
 #include <linux/irqnr.h>
 #include <linux/irqdesc.h>
 #include <linux/irqdomain.h>
+#include <linux/overflow.h>
+#include <linux/rcupdate.h>
 #include <linux/slab.h>
 #include <linux/mutex.h>
 
@@ -121,7 +123,7 @@ struct irq_domain *__irq_domain_add(struct fwnode_handle *fwnode, int size,
 
 	static atomic_t unknown_domains;
 
-	domain = kzalloc_node(sizeof(*domain) + (sizeof(unsigned int) * size),
+	domain = kzalloc_node(struct_size(domain, linear_revmap, size),
 			      GFP_KERNEL, of_node_to_nid(of_node));
 	if (WARN_ON(!domain))
 		return NULL;
@@ -422,7 +424,7 @@ static void irq_domain_clear_mapping(struct irq_domain *domain,
 				     irq_hw_number_t hwirq)
 {
 	if (hwirq < domain->revmap_size) {
-		domain->linear_revmap[hwirq] = 0;
+		WRITE_ONCE(domain->linear_revmap[hwirq], NULL);
 	} else {
 		mutex_lock(&domain->revmap_tree_mutex);
 		radix_tree_delete(&domain->revmap_tree, hwirq);
@@ -435,7 +437,8 @@ static void irq_domain_set_mapping(struct irq_domain *domain,
 				   struct irq_data *irq_data)
 {
 	if (hwirq < domain->revmap_size) {
-		domain->linear_revmap[hwirq] = irq_data->irq;
+		rcu_assign_pointer(domain->linear_revmap[hwirq],
+				   irq_to_desc(irq_data->irq));
 	} else {
 		mutex_lock(&domain->revmap_tree_mutex);
 		radix_tree_insert(&domain->revmap_tree, hwirq, irq_data);
@@ -841,7 +844,7 @@ unsigned int irq_find_mapping(struct irq_domain *domain,
 
 	/* Check if the hwirq is in the linear revmap. */
 	if (hwirq < domain->revmap_size)
-		return domain->linear_revmap[hwirq];
+		return irq_linear_revmap(domain, hwirq);
 
 	rcu_read_lock();
 	data = radix_tree_lookup(&domain->revmap_tree, hwirq);
@@ -849,6 +852,50 @@ unsigned int irq_find_mapping(struct irq_domain *domain,
 	return data ? data->irq : 0;
 }
 
+/**
+ * irq_linear_revmap() - Find a linux irq from a hw irq number.
+ * @domain: domain owning this hardware interrupt
+ * @hwirq: hardware irq number in that domain space
+ *
+ * This is a fast path alternative to irq_find_mapping() that can be
+ * called directly by irq controller code to save a handful of
+ * instructions. It is always safe to call, but won't find irqs mapped
+ * using the radix tree.
+ */
+unsigned int irq_linear_revmap(struct irq_domain *domain,
+			       irq_hw_number_t hwirq)
+{
+	struct irq_desc *desc;
+
+	if (hwirq >= domain->revmap_size)
+		return 0;
+
+	desc = rcu_dereference_raw(domain->linear_revmap[hwirq]);
+	return desc ? irq_desc_get_irq(desc) : 0;
+}
+
+/**
+ * irq_resolve_mapping() - Find the irq descriptor of a hw irq number.
+ * @domain: domain owning this hardware interrupt, NULL for the default one
+ * @hwirq: hardware irq number in that domain space
+ *
+ * This is what the interrupt entry path uses. A hwirq in the linear
+ * revmap costs one load, anything else goes through irq_find_mapping()
+ * and irq_to_desc(). Called from interrupt context, the descriptor stays
+ * valid until the mapping is disposed of and a grace period has passed.
+ */
+struct irq_desc *irq_resolve_mapping(struct irq_domain *domain,
+				     irq_hw_number_t hwirq)
+{
+	unsigned int irq;
+
+	if (likely(domain && hwirq < domain->revmap_size))
+		return rcu_dereference_raw(domain->linear_revmap[hwirq]);
+
+	irq = irq_find_mapping(domain, hwirq);
+	return irq ? irq_to_desc(irq) : NULL;
+}
+
 /**
  * irq_domain_xlate_onecell() - Generic xlate for direct one cell bindings
  *
@@ -9,20 +9,210 @@
 #include <linux/module.h>
 #include <linux/interrupt.h>
 #include <linux/moduleparam.h>
+#include <linux/hrtimer.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
 
 #include "internal.h"
 
 bool noirqdebug __read_mostly;
 
+/*
+ * If 99,900 of the previous 100,000 interrupts have not been handled
+ * then assume that the IRQ is stuck in some manner. Drop a diagnostic
+ * and try to turn the IRQ off.
+ */
+static void __report_bad_irq(struct irq_desc *desc, irqreturn_t action_ret)
+{
+	unsigned int irq = irq_desc_get_irq(desc);
+	struct irqaction *action;
+	unsigned long flags;
+
+	if (action_ret != IRQ_HANDLED && action_ret != IRQ_NONE) {
+		printk(KERN_ERR "irq event %d: bogus return value %x\n",
+				irq, action_ret);
+	} else {
+		printk(KERN_ERR "irq %d: nobody cared\n", irq);
+	}
+	dump_stack();
+	printk(KERN_ERR "handlers:\n");
+
+	/*
+	 * We need to take desc->lock here. note_interrupt() is called
+	 * w/o desc->lock held, but IRQ_PROGRESS set. We might race
+	 * with something else removing an action. It's ok to take
+	 * desc->lock here. See synchronize_irq().
+	 */
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	for_each_action_of_desc(desc, action) {
+		printk(KERN_ERR "[<%p>] %pf", action->handler, action->handler);
+		if (action->thread_fn)
+			printk(KERN_CONT " threaded [<%p>] %pf",
+					action->thread_fn, action->thread_fn);
+		printk(KERN_CONT "\n");
+	}
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+}
+
+static void report_bad_irq(struct irq_desc *desc, irqreturn_t action_ret)
+{
+	static int count = 100;
+
+	if (count > 0) {
+		count--;
+		__report_bad_irq(desc, action_ret);
+	}
+}
+
+static inline int bad_action_ret(irqreturn_t action_ret)
+{
+	unsigned int r = action_ret;
+
+	if (likely(r <= (IRQ_HANDLED | IRQ_WAKE_THREAD)))
+		return 0;
+	return 1;
+}
+
+#ifdef CONFIG_IRQ_HISTOGRAM
+/* How long a line found storming stays disabled */
+#define IRQ_STORM_BACKOFF_MS	100
+
+static DECLARE_BITMAP(irqs_throttled, IRQ_BITMAP_BITS);
+static struct hrtimer irq_storm_timer;
+
+static enum hrtimer_restart irq_storm_unthrottle(struct hrtimer *timer)
+{
+	unsigned int irq;
+
+	for_each_set_bit(irq, irqs_throttled, IRQ_BITMAP_BITS) {
+		struct irq_desc *desc = irq_to_desc(irq);
+		unsigned long flags;
+
+		clear_bit(irq, irqs_throttled);
+		if (!desc)
+			continue;
+
+		raw_spin_lock_irqsave(&desc->lock, flags);
+		if (desc->istate & IRQS_SPURIOUS_DISABLED) {
+			desc->istate &= ~IRQS_SPURIOUS_DISABLED;
+			__enable_irq(desc);
+		}
+		raw_spin_unlock_irqrestore(&desc->lock, flags);
+	}
+
+	return HRTIMER_NORESTART;
+}
+
+void __init irq_storm_throttle_init(void)
+{
+	hrtimer_init(&irq_storm_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	irq_storm_timer.function = irq_storm_unthrottle;
+}
+
+/*
+ * Disable a line that fires faster than the "irqstorm=" rate and have
+ * irq_storm_timer turn it back on IRQ_STORM_BACKOFF_MS later, so that a
+ * misbehaving device cannot keep a cpu in hard interrupt context.
+ */
+static void irq_storm_throttle(struct irq_desc *desc)
+{
+	unsigned int irq = irq_desc_get_irq(desc);
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	if (desc->istate & IRQS_SPURIOUS_DISABLED) {
+		raw_spin_unlock_irqrestore(&desc->lock, flags);
+		return;
+	}
+	desc->istate |= IRQS_SPURIOUS_DISABLED;
+	desc->depth++;
+	irq_disable(desc);
+	set_bit(irq, irqs_throttled);
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+
+	pr_warn("irq %u: interrupt storm, disabled for %d ms\n",
+		irq, IRQ_STORM_BACKOFF_MS);
+
+	if (!hrtimer_active(&irq_storm_timer))
+		hrtimer_start(&irq_storm_timer, ms_to_ktime(IRQ_STORM_BACKOFF_MS),
+			      HRTIMER_MODE_REL);
+}
+#else
+static inline void irq_storm_throttle(struct irq_desc *desc) { }
+#endif
+
 void note_interrupt(struct irq_desc *desc, irqreturn_t action_ret)
 {
-	/* TODO */
-	WARN_ON(1);
+	if (desc->istate & IRQS_POLL_INPROGRESS ||
+	    irq_settings_is_polled(desc))
+		return;
+
+	if (bad_action_ret(action_ret)) {
+		report_bad_irq(desc, action_ret);
+		return;
+	}
+
+	if (irq_hist_storm(desc)) {
+		irq_storm_throttle(desc);
+		return;
+	}
+
+	/*
+	 * A threaded handler returning IRQ_HANDLED proves nothing about
+	 * the hard interrupt that woke it. Upstream defers the accounting
+	 * of IRQ_WAKE_THREAD to the next interrupt; here such interrupts
+	 * are simply not counted against the line.
+	 */
+	if (action_ret & IRQ_WAKE_THREAD)
+		return;
+
+	if (unlikely(action_ret == IRQ_NONE)) {
+		/*
+		 * If we are seeing only the odd spurious IRQ caused by
+		 * bus asynchronicity then don't eventually trigger an error,
+		 * otherwise the counter becomes a doomsday timer for otherwise
+		 * working systems
+		 */
+		if (time_after(jiffies, desc->last_unhandled + HZ/10))
+			desc->irqs_unhandled = 1;
+		else
+			desc->irqs_unhandled++;
+		desc->last_unhandled = jiffies;
+	}
+
+	desc->irq_count++;
+	if (likely(desc->irq_count < 100000))
+		return;
+
+	desc->irq_count = 0;
+	if (unlikely(desc->irqs_unhandled > 99900)) {
+		/*
+		 * The interrupt is stuck
+		 */
+		__report_bad_irq(desc, action_ret);
+		/*
+		 * Now kill the IRQ
+		 */
+		printk(KERN_EMERG "Disabling IRQ #%d\n", irq_desc_get_irq(desc));
+		desc->istate |= IRQS_SPURIOUS_DISABLED;
+		desc->depth++;
+		irq_disable(desc);
+	}
+	desc->irqs_unhandled = 0;
 }
 
+static int __init noirqdebug_setup(char *str)
+{
+	noirqdebug = 1;
+	printk(KERN_INFO "IRQ lockup detection disabled\n");
+
+	return 0;
+}
+early_param("noirqdebug", noirqdebug_setup);
+
 bool irq_wait_for_poll(struct irq_desc *desc)
 {
 	WARN_ON(1);
-	
+
 	return false;
 }
@@ -0,0 +1,534 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* Kernel thread helper functions.
+ *   Copyright (C) 2004 IBM Corporation, Rusty Russell.
+ *
+ * Creation is done directly from the caller: there is no kthreadd to hand
+ * requests to, the new task is copied from current and reset by
+ * copy_kernel_thread(). There are no completions either, so a caller
+ * waiting for a thread to start, park or exit sleeps on a bit in
+ * struct kthread and is woken by the thread once it is set.
+ */
+#include <linux/sched.h>
+#include <linux/sched/task.h>
+#include <linux/kthread.h>
+#include <linux/cpumask.h>
+#include <linux/err.h>
+#include <linux/kernel.h>
+#include <linux/numa.h>
+#include <linux/slab.h>
+
+struct kthread {
+	unsigned long flags;
+	unsigned int cpu;
+	int (*threadfn)(void *);
+	void *data;
+	int result;
+	/* The one task waiting for a bit in ->flags, see kthread_wait_bit() */
+	struct task_struct *waiter;
+};
+
+enum KTHREAD_BITS {
+	KTHREAD_IS_PER_CPU = 0,
+	KTHREAD_SHOULD_STOP,
+	KTHREAD_SHOULD_PARK,
+	KTHREAD_STARTED,
+	KTHREAD_PARKED,
+	KTHREAD_EXITED,
+};
+
+static inline struct kthread *to_kthread(struct task_struct *k)
+{
+	WARN_ON(!(k->flags & PF_KTHREAD));
+	return k->worker_private;
+}
+
+void free_kthread_struct(struct task_struct *k)
+{
+	struct kthread *kthread = to_kthread(k);
+
+	k->worker_private = NULL;
+	kfree(kthread);
+}
+
+/*
+ * Wait until @bit is set in @kthread->flags. Every thread is created,
+ * parked and stopped by one task at a time, so a single waiter is all
+ * that is needed. The idle task runs the initcalls and must not leave
+ * the runqueue: it keeps yielding until the thread has set the bit.
+ */
+static void kthread_wait_bit(struct kthread *kthread, int bit)
+{
+	bool idle = is_idle_task(current);
+
+	WRITE_ONCE(kthread->waiter, current);
+	for (;;) {
+		if (!idle)
+			set_current_state(TASK_UNINTERRUPTIBLE);
+		else
+			smp_mb();
+		if (test_bit(bit, &kthread->flags))
+			break;
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+	WRITE_ONCE(kthread->waiter, NULL);
+}
+
+static void kthread_signal_bit(struct kthread *kthread, int bit)
+{
+	struct task_struct *waiter;
+
+	set_bit(bit, &kthread->flags);
+	/* Pairs with the barrier in set_current_state() of the waiter */
+	smp_mb__after_atomic();
+	waiter = READ_ONCE(kthread->waiter);
+	if (waiter)
+		wake_up_process(waiter);
+}
+
+/**
+ * kthread_should_stop - should this kthread return now?
+ *
+ * When someone calls kthread_stop() on your kthread, it will be woken
+ * and this will return true.  You should then return, and your return
+ * value will be passed through to kthread_stop().
+ */
+bool kthread_should_stop(void)
+{
+	return test_bit(KTHREAD_SHOULD_STOP, &to_kthread(current)->flags);
+}
+
+/**
+ * kthread_should_park - should this kthread park now?
+ *
+ * When someone calls kthread_park() on your kthread, it will be woken
+ * and this will return true.  You should then do the necessary
+ * cleanup and call kthread_parkme()
+ *
+ * Similar to kthread_should_stop(), but this keeps the thread alive
+ * and in a park position. kthread_unpark() "restarts" the thread and
+ * calls the thread function again.
+ */
+bool kthread_should_park(void)
+{
+	return test_bit(KTHREAD_SHOULD_PARK, &to_kthread(current)->flags);
+}
+
+/**
+ * kthread_data - return data value specified on kthread creation
+ * @task: kthread task in question
+ *
+ * Return the data value specified when kthread @task was created.
+ * The caller is responsible for ensuring the validity of @task when
+ * calling this function.
+ */
+void *kthread_data(struct task_struct *task)
+{
+	return to_kthread(task)->data;
+}
+
+static void __kthread_parkme(struct kthread *self)
+{
+	for (;;) {
+		/*
+		 * TASK_PARKED is a special state; we must serialize against
+		 * possible pending wakeups to avoid store-store collisions on
+		 * task->state.
+		 *
+		 * Such a collision might possibly result in the task state
+		 * changing from TASK_PARKED and us failing the
+		 * wait_task_inactive() in kthread_park().
+		 */
+		set_special_state(TASK_PARKED);
+		if (!test_bit(KTHREAD_SHOULD_PARK, &self->flags))
+			break;
+
+		kthread_signal_bit(self, KTHREAD_PARKED);
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+}
+
+void kthread_parkme(void)
+{
+	__kthread_parkme(to_kthread(current));
+}
+
+static void __noreturn kthread_exit(struct kthread *self, int result)
+{
+	self->result = result;
+	kthread_signal_bit(self, KTHREAD_EXITED);
+	do_exit(0);
+}
+
+static int kthread(void *_self)
+{
+	struct kthread *self = _self;
+	int ret;
+
+	/* OK, tell the creator we're here and wait to be woken up */
+	__set_current_state(TASK_UNINTERRUPTIBLE);
+	kthread_signal_bit(self, KTHREAD_STARTED);
+	schedule();
+
+	ret = -EINTR;
+	if (!test_bit(KTHREAD_SHOULD_STOP, &self->flags)) {
+		__kthread_parkme(self);
+		ret = self->threadfn(self->data);
+	}
+	kthread_exit(self, ret);
+}
+
+/**
+ * kthread_create_on_node - create a kthread.
+ * @threadfn: the function to run until signal_pending(current).
+ * @data: data ptr for @threadfn.
+ * @node: task and thread structures for the thread are allocated on this node
+ * @namefmt: printf-style name for the thread.
+ *
+ * Description: This helper function creates and names a kernel
+ * thread.  The thread will be stopped: use wake_up_process() to start
+ * it.  See also kthread_run().  The new thread has SCHED_NORMAL policy and
+ * is affine to all CPUs.
+ *
+ * If thread is going to be bound on a particular cpu, give its node
+ * in @node, to get NUMA affinity for kthread stack, or else give NUMA_NO_NODE.
+ * When woken, the thread will run @threadfn() with @data as its
+ * argument. @threadfn() can either call do_exit() directly if it is a
+ * standalone thread for which no one will call kthread_stop(), or
+ * return when 'kthread_should_stop()' is true (which means
+ * kthread_stop() has been called).  The return value should be zero
+ * or a negative error number; it will be passed to kthread_stop().
+ *
+ * Returns a task_struct or ERR_PTR(-ENOMEM).
+ */
+struct task_struct *kthread_create_on_node(int (*threadfn)(void *data),
+					   void *data, int node,
+					   const char namefmt[],
+					   ...)
+{
+	struct task_struct *task;
+	struct kthread *self;
+	va_list args;
+
+	self = kzalloc(sizeof(*self), GFP_KERNEL);
+	if (!self)
+		return ERR_PTR(-ENOMEM);
+
+	self->threadfn = threadfn;
+	self->data = data;
+
+	task = copy_kernel_thread(kthread, self, node);
+	if (IS_ERR(task)) {
+		kfree(self);
+		return task;
+	}
+	task->worker_private = self;
+
+	va_start(args, namefmt);
+	vsnprintf(task->comm, sizeof(task->comm), namefmt, args);
+	va_end(args);
+
+	/* Let it run up to its first sleep so kthread_bind() can move it */
+	wake_up_new_task(task);
+	kthread_wait_bit(self, KTHREAD_STARTED);
+
+	return task;
+}
+
+static void __kthread_bind_mask(struct task_struct *p, const struct cpumask *mask, long state)
+{
+	unsigned long flags;
+
+	if (!wait_task_inactive(p, state)) {
+		WARN_ON(1);
+		return;
+	}
+
+	/* It's safe because the task is inactive. */
+	raw_spin_lock_irqsave(&p->pi_lock, flags);
+	do_set_cpus_allowed(p, mask);
+	p->flags |= PF_NO_SETAFFINITY;
+	raw_spin_unlock_irqrestore(&p->pi_lock, flags);
+}
+
+static void __kthread_bind(struct task_struct *p, unsigned int cpu, long state)
+{
+	__kthread_bind_mask(p, cpumask_of(cpu), state);
+}
+
+void kthread_bind_mask(struct task_struct *p, const struct cpumask *mask)
+{
+	__kthread_bind_mask(p, mask, TASK_UNINTERRUPTIBLE);
+}
+
+/**
+ * kthread_bind - bind a just-created kthread to a cpu.
+ * @p: thread created by kthread_create().
+ * @cpu: cpu (might not be online, must be possible) for @k to run on.
+ *
+ * Description: This function is equivalent to set_cpus_allowed(),
+ * except that @cpu doesn't need to be online, and the thread must be
+ * stopped (i.e., just returned from kthread_create()).
+ */
+void kthread_bind(struct task_struct *p, unsigned int cpu)
+{
+	__kthread_bind(p, cpu, TASK_UNINTERRUPTIBLE);
+}
+
+/**
+ * kthread_create_on_cpu - Create a cpu bound kthread
+ * @threadfn: the function to run until signal_pending(current).
+ * @data: data ptr for @threadfn.
+ * @cpu: The cpu on which the thread should be bound,
+ * @namefmt: printf-style name for the thread. Format is restricted
+ *	     to "name.*%u". Code fills in cpu number.
+ *
+ * Description: This helper function creates and names a kernel thread
+ * The thread will be woken and put into park mode.
+ */
+struct task_struct *kthread_create_on_cpu(int (*threadfn)(void *data),
+					  void *data, unsigned int cpu,
+					  const char *namefmt)
+{
+	struct task_struct *p;
+
+	p = kthread_create_on_node(threadfn, data, cpu_to_node(cpu), namefmt,
+				   cpu);
+	if (IS_ERR(p))
+		return p;
+	kthread_bind(p, cpu);
+	/* CPU hotplug need to bind once again when unparking the thread. */
+	set_bit(KTHREAD_IS_PER_CPU, &to_kthread(p)->flags);
+	to_kthread(p)->cpu = cpu;
+	return p;
+}
+
+/**
+ * kthread_unpark - unpark a thread created by kthread_create().
+ * @k:		thread created by kthread_create().
+ *
+ * Sets kthread_should_park() for @k to return false, wakes it, and
+ * waits for it to return. If the thread is marked percpu then its
+ * bound to the cpu again.
+ */
+void kthread_unpark(struct task_struct *k)
+{
+	struct kthread *kthread = to_kthread(k);
+
+	/* Not parked, e.g. kthread_stop() on a running thread */
+	if (!test_bit(KTHREAD_SHOULD_PARK, &kthread->flags))
+		return;
+
+	clear_bit(KTHREAD_SHOULD_PARK, &kthread->flags);
+	/*
+	 * Newly created kthread was parked when the CPU was offline.
+	 * The binding was lost and we need to set it again.
+	 */
+	if (test_bit(KTHREAD_IS_PER_CPU, &kthread->flags))
+		__kthread_bind(k, kthread->cpu, TASK_PARKED);
+
+	/*
+	 * __kthread_parkme() will either see !SHOULD_PARK or get the wakeup.
+	 */
+	wake_up_state(k, TASK_PARKED);
+}
+
+/**
+ * kthread_park - park a thread created by kthread_create().
+ * @k: thread created by kthread_create().
+ *
+ * Sets kthread_should_park() for @k to return true, wakes it, and
+ * waits for it to return. This can also be called after kthread_create()
+ * instead of calling wake_up_process(): the thread will park without
+ * calling threadfn().
+ *
+ * Returns 0 if the thread is parked, -ENOSYS if the thread exited.
+ * If called by the kthread itself just the park bit is set.
+ */
+int kthread_park(struct task_struct *k)
+{
+	struct kthread *kthread = to_kthread(k);
+
+	if (WARN_ON(k->flags & PF_EXITING))
+		return -ENOSYS;
+
+	if (WARN_ON_ONCE(test_bit(KTHREAD_SHOULD_PARK, &kthread->flags)))
+		return -EBUSY;
+
+	clear_bit(KTHREAD_PARKED, &kthread->flags);
+	set_bit(KTHREAD_SHOULD_PARK, &kthread->flags);
+	if (k != current) {
+		wake_up_process(k);
+		/*
+		 * Wait for __kthread_parkme() to set PARKED, and then for
+		 * the thread to actually get off the CPU.
+		 */
+		kthread_wait_bit(kthread, KTHREAD_PARKED);
+		WARN_ON_ONCE(!wait_task_inactive(k, TASK_PARKED));
+	}
+
+	return 0;
+}
+
+/**
+ * kthread_stop - stop a thread created by kthread_create().
+ * @k: thread created by kthread_create().
+ *
+ * Sets kthread_should_stop() for @k to return true, wakes it, and
+ * waits for it to exit. This can also be called after kthread_create()
+ * instead of calling wake_up_process(): the thread will exit without
+ * calling threadfn().
+ *
+ * If threadfn() may call do_exit() itself, the caller must ensure
+ * task_struct can't go away.
+ *
+ * Returns the result of threadfn(), or %-EINTR if wake_up_process()
+ * was never called.
+ */
+int kthread_stop(struct task_struct *k)
+{
+	struct kthread *kthread;
+	int ret;
+
+	get_task_struct(k);
+	kthread = to_kthread(k);
+	set_bit(KTHREAD_SHOULD_STOP, &kthread->flags);
+	kthread_unpark(k);
+	wake_up_process(k);
+	kthread_wait_bit(kthread, KTHREAD_EXITED);
+	ret = kthread->result;
+	put_task_struct(k);
+
+	return ret;
+}
+
+#ifdef CONFIG_TEST_KTHREAD
+#include <linux/boot_test.h>
+
+#define KTHREAD_TEST_RESULT	42
+
+/* Counts its calls in *@data */
+static int __init kthread_test_fn(void *data)
+{
+	int *runs = data;
+
+	WRITE_ONCE(*runs, *runs + 1);
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+		if (kthread_should_park()) {
+			__set_current_state(TASK_RUNNING);
+			kthread_parkme();
+			continue;
+		}
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return KTHREAD_TEST_RESULT;
+}
+
+/*
+ * A woken thread only gets to its function once it is scheduled. The
+ * initcalls run in the idle task, which stays runnable while yielding.
+ */
+static void __init kthread_test_wait_run(int *runs)
+{
+	while (!READ_ONCE(*runs))
+		schedule();
+}
+
+/* A thread stopped before it was ever woken never runs its function */
+static void __init kthread_test_stop_unwoken(struct boot_test *t)
+{
+	struct task_struct *k;
+	int runs = 0;
+
+	k = kthread_create(kthread_test_fn, &runs, "kthread_test");
+	if (!BOOT_TEST_EXPECT(t, !IS_ERR(k)))
+		return;
+
+	BOOT_TEST_EXPECT(t, kthread_data(k) == &runs);
+	BOOT_TEST_EXPECT(t, kthread_stop(k) == -EINTR);
+	BOOT_TEST_EXPECT(t, !runs);
+}
+
+/* Unparking a thread that isn't parked does nothing, stopping still works */
+static void __init kthread_test_stop_running(struct boot_test *t)
+{
+	struct task_struct *k;
+	int runs = 0;
+
+	k = kthread_run(kthread_test_fn, &runs, "kthread_test");
+	if (!BOOT_TEST_EXPECT(t, !IS_ERR(k)))
+		return;
+	kthread_test_wait_run(&runs);
+
+	kthread_unpark(k);
+	BOOT_TEST_EXPECT(t, kthread_stop(k) == KTHREAD_TEST_RESULT);
+	BOOT_TEST_EXPECT(t, runs == 1);
+}
+
+/*
+ * A thread parked instead of woken runs its function only once
+ * unparked, and can be stopped while parked.
+ */
+static void __init kthread_test_park_unwoken(struct boot_test *t)
+{
+	struct task_struct *k;
+	int runs = 0;
+
+	k = kthread_create(kthread_test_fn, &runs, "kthread_test");
+	if (!BOOT_TEST_EXPECT(t, !IS_ERR(k)))
+		return;
+
+	BOOT_TEST_EXPECT(t, !kthread_park(k));
+	BOOT_TEST_EXPECT(t, !runs);
+	kthread_unpark(k);
+	kthread_test_wait_run(&runs);
+
+	BOOT_TEST_EXPECT(t, !kthread_park(k));
+	BOOT_TEST_EXPECT(t, kthread_stop(k) == KTHREAD_TEST_RESULT);
+	BOOT_TEST_EXPECT(t, runs == 1);
+}
+
+/*
+ * A per-cpu thread that lost its binding while parked, as on cpu
+ * hotplug, is bound again on unpark and carries on where it parked.
+ */
+static void __init kthread_test_percpu_rebind(struct boot_test *t)
+{
+	unsigned int cpu = smp_processor_id();
+	struct task_struct *k;
+	unsigned long flags;
+	int runs = 0;
+
+	k = kthread_create_on_cpu(kthread_test_fn, &runs, cpu,
+				  "kthread_test/%u");
+	if (!BOOT_TEST_EXPECT(t, !IS_ERR(k)))
+		return;
+	wake_up_process(k);
+	kthread_test_wait_run(&runs);
+
+	BOOT_TEST_EXPECT(t, !kthread_park(k));
+	raw_spin_lock_irqsave(&k->pi_lock, flags);
+	do_set_cpus_allowed(k, cpu_possible_mask);
+	raw_spin_unlock_irqrestore(&k->pi_lock, flags);
+
+	kthread_unpark(k);
+	BOOT_TEST_EXPECT(t, cpumask_equal(&k->cpus_allowed, cpumask_of(cpu)));
+	BOOT_TEST_EXPECT(t, kthread_stop(k) == KTHREAD_TEST_RESULT);
+	BOOT_TEST_EXPECT(t, runs == 1);
+}
+
+static void __init kthread_test(struct boot_test *t)
+{
+	kthread_test_stop_unwoken(t);
+	kthread_test_stop_running(t);
+	kthread_test_park_unwoken(t);
+	kthread_test_percpu_rebind(t);
+}
+boot_test(kthread_test);
+#endif /* CONFIG_TEST_KTHREAD */
@@ -0,0 +1,218 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Per-cpu reader-writer spinlock
+ *
+ * Readers take the lock with a per-cpu increment and a full barrier, so
+ * concurrent readers on different cpus share no cache line. Writers are
+ * serialized by ->wlock, stop new readers with ->writer and then wait
+ * for the read counter of every possible cpu to drop to zero.
+ */
+#include <linux/percpu-rwlock.h>
+#include <linux/cpumask.h>
+#include <linux/errno.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/printk.h>
+
+#include <asm/processor.h>
+
+int percpu_init_rwlock(struct percpu_rwlock *rw)
+{
+	rw->read_count = alloc_percpu(unsigned int);
+	if (unlikely(!rw->read_count))
+		return -ENOMEM;
+
+	rw->writer = 0;
+	raw_spin_lock_init(&rw->wlock);
+	return 0;
+}
+
+void percpu_free_rwlock(struct percpu_rwlock *rw)
+{
+	free_percpu(rw->read_count);
+	rw->read_count = NULL;
+}
+
+/**
+ * __percpu_read_lock_slowpath - wait out a writer
+ * @rw: Pointer to the percpu rwlock
+ *
+ * Called with our counter raised and preemption disabled after a writer
+ * was seen. Back the counter out so the writer can finish, and retry
+ * once it has dropped the lock.
+ */
+void __percpu_read_lock_slowpath(struct percpu_rwlock *rw)
+{
+	for (;;) {
+		this_cpu_dec(*rw->read_count);
+
+		while (READ_ONCE(rw->writer))
+			cpu_relax();
+
+		this_cpu_inc(*rw->read_count);
+		smp_mb();
+		if (likely(!READ_ONCE(rw->writer)))
+			return;
+	}
+}
+
+/**
+ * percpu_write_lock - acquire the percpu rwlock for writing
+ * @rw: Pointer to the percpu rwlock
+ */
+void percpu_write_lock(struct percpu_rwlock *rw)
+{
+	int cpu;
+
+	raw_spin_lock(&rw->wlock);
+	WRITE_ONCE(rw->writer, 1);
+	/* Pairs with the barrier in percpu_read_lock() */
+	smp_mb();
+
+	for_each_possible_cpu(cpu) {
+		unsigned int *count = per_cpu_ptr(rw->read_count, cpu);
+
+		while (READ_ONCE(*count))
+			cpu_relax();
+	}
+
+	/* Order the drained read sections before our stores */
+	smp_mb();
+}
+
+/**
+ * percpu_write_unlock - release the percpu rwlock held for writing
+ * @rw: Pointer to the percpu rwlock
+ */
+void percpu_write_unlock(struct percpu_rwlock *rw)
+{
+	smp_store_release(&rw->writer, 0);
+	raw_spin_unlock(&rw->wlock);
+}
+
+#ifdef CONFIG_TEST_PERCPU_RWLOCK
+#include <linux/boot_test.h>
+#include <linux/hrtimer.h>
+
+/*
+ * Only the boot cpu runs, so the other side of the lock is played by an
+ * hrtimer firing while the test spins in the lock.
+ */
+#define PERCPU_RWLOCK_TEST_DELAY_NS	NSEC_PER_MSEC
+
+DEFINE_STATIC_PERCPU_RWLOCK(percpu_rwlock_test_lock);
+
+static struct hrtimer percpu_rwlock_test_timer __initdata;
+static unsigned int percpu_rwlock_test_cpu __initdata;
+/* what the timer saw of the other side when it fired */
+static int percpu_rwlock_test_seen __initdata;
+
+static void __init percpu_rwlock_test_after_delay(
+		enum hrtimer_restart (*fn)(struct hrtimer *))
+{
+	hrtimer_init(&percpu_rwlock_test_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL);
+	percpu_rwlock_test_timer.function = fn;
+	hrtimer_start(&percpu_rwlock_test_timer,
+		      ns_to_ktime(PERCPU_RWLOCK_TEST_DELAY_NS),
+		      HRTIMER_MODE_REL);
+}
+
+/* The reader on percpu_rwlock_test_cpu leaves its section */
+static enum hrtimer_restart __init
+percpu_rwlock_test_reader_exit(struct hrtimer *timer)
+{
+	struct percpu_rwlock *rw = &percpu_rwlock_test_lock;
+
+	percpu_rwlock_test_seen = READ_ONCE(rw->writer);
+	smp_mb();
+	WRITE_ONCE(*per_cpu_ptr(rw->read_count, percpu_rwlock_test_cpu), 0);
+
+	return HRTIMER_NORESTART;
+}
+
+/* A writer waits for a reader on any possible cpu, online or not */
+static void __init percpu_rwlock_test_write_waits(struct boot_test *t)
+{
+	struct percpu_rwlock *rw = &percpu_rwlock_test_lock;
+	unsigned int *count;
+
+	percpu_rwlock_test_cpu = cpumask_last(cpu_possible_mask);
+	count = per_cpu_ptr(rw->read_count, percpu_rwlock_test_cpu);
+	WRITE_ONCE(*count, 1);
+	percpu_rwlock_test_seen = 0;
+
+	percpu_rwlock_test_after_delay(percpu_rwlock_test_reader_exit);
+	percpu_write_lock(rw);
+	hrtimer_cancel(&percpu_rwlock_test_timer);
+
+	/* ->writer was up while the reader was still inside */
+	BOOT_TEST_EXPECT(t, percpu_rwlock_test_seen == 1);
+	BOOT_TEST_EXPECT(t, !READ_ONCE(*count));
+	percpu_write_unlock(rw);
+	BOOT_TEST_EXPECT(t, !READ_ONCE(rw->writer));
+}
+
+/* The writer drops the lock, having seen this cpu's counter */
+static enum hrtimer_restart __init
+percpu_rwlock_test_writer_exit(struct hrtimer *timer)
+{
+	struct percpu_rwlock *rw = &percpu_rwlock_test_lock;
+
+	percpu_rwlock_test_seen = READ_ONCE(*this_cpu_ptr(rw->read_count));
+	smp_store_release(&rw->writer, 0);
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * A reader finding a writer backs its counter out while it waits, or
+ * the writer could never drain the counters, and holds the lock with
+ * its counter raised again once the writer is gone.
+ */
+static void __init percpu_rwlock_test_read_backs_out(struct boot_test *t)
+{
+	struct percpu_rwlock *rw = &percpu_rwlock_test_lock;
+
+	WRITE_ONCE(rw->writer, 1);
+	percpu_rwlock_test_seen = -1;
+
+	percpu_rwlock_test_after_delay(percpu_rwlock_test_writer_exit);
+	percpu_read_lock(rw);
+	hrtimer_cancel(&percpu_rwlock_test_timer);
+
+	BOOT_TEST_EXPECT(t, percpu_rwlock_test_seen == 0);
+	BOOT_TEST_EXPECT(t, this_cpu_read(*rw->read_count) == 1);
+	percpu_read_unlock(rw);
+	BOOT_TEST_EXPECT(t, this_cpu_read(*rw->read_count) == 0);
+}
+
+/* A dynamically set up lock starts out with no reader on any cpu */
+static void __init percpu_rwlock_test_dynamic(struct boot_test *t)
+{
+	struct percpu_rwlock rw;
+	bool drained = true;
+	unsigned int cpu;
+
+	if (!BOOT_TEST_EXPECT(t, !percpu_init_rwlock(&rw)))
+		return;
+
+	for_each_possible_cpu(cpu)
+		drained &= !*per_cpu_ptr(rw.read_count, cpu);
+	BOOT_TEST_EXPECT(t, drained);
+	BOOT_TEST_EXPECT(t, !rw.writer);
+
+	percpu_write_lock(&rw);
+	percpu_write_unlock(&rw);
+	percpu_free_rwlock(&rw);
+	BOOT_TEST_EXPECT(t, !rw.read_count);
+}
+
+static void __init percpu_rwlock_test(struct boot_test *t)
+{
+	percpu_rwlock_test_write_waits(t);
+	percpu_rwlock_test_read_backs_out(t);
+	percpu_rwlock_test_dynamic(t);
+}
+boot_test(percpu_rwlock_test);
+#endif /* CONFIG_TEST_PERCPU_RWLOCK */
@@ -20,7 +20,7 @@
  *          Peter Zijlstra <peterz@infradead.org>
  */
 
-#ifndef _GEN_PV_LOCK_SLOWPATH
+#if !defined(_GEN_PV_LOCK_SLOWPATH) && !defined(_GEN_CNA_LOCK_SLOWPATH)
 
 #include <linux/smp.h>
 #include <linux/bug.h>
@@ -80,15 +80,17 @@
 /*
  * On 64-bit architectures, the mcs_spinlock structure will be 16 bytes in
  * size and four of them will fit nicely in one 64-byte cacheline. For
- * pvqspinlock, however, we need more space for extra data. To accommodate
- * that, we insert two more long words to pad it up to 32 bytes. IOW, only
- * two of them can fit in a cacheline in this case. That is OK as it is rare
- * to have more than 2 levels of slowpath nesting in actual use. We don't
- * want to penalize pvqspinlocks to optimize for a rare case in native
- * qspinlocks.
+ * the NUMA-aware slowpath, however, we need more space for extra data. To
+ * accommodate that, we insert two more long words to pad it up to 32
+ * bytes. IOW, only two of them can fit in a cacheline in this case. That
+ * is OK as it is rare to have more than 2 levels of slowpath nesting in
+ * actual use.
  */
 struct qnode {
 	struct mcs_spinlock mcs;
+#ifdef CONFIG_NUMA_AWARE_SPINLOCKS
+	long reserved[2];
+#endif
 };
 
 /*
@@ -291,7 +293,32 @@ static __always_inline u32  __pv_wait_head_or_lock(struct qspinlock *lock,
 #define pv_kick_node		__pv_kick_node
 #define pv_wait_head_or_lock	__pv_wait_head_or_lock
 
-#endif /* _GEN_PV_LOCK_SLOWPATH */
+/*
+ * The native MCS queue is strictly FIFO: the last waiter clears the tail,
+ * anyone else hands the queue head to its successor.
+ */
+static __always_inline bool __try_clear_tail(struct qspinlock *lock, u32 val,
+					     struct mcs_spinlock *node)
+{
+	return atomic_try_cmpxchg_relaxed(&lock->val, &val, _Q_LOCKED_VAL);
+}
+
+static __always_inline void __mcs_pass_lock(struct mcs_spinlock *node,
+					    struct mcs_spinlock *next)
+{
+	arch_mcs_spin_unlock_contended(&next->locked);
+}
+
+#define try_clear_tail		__try_clear_tail
+#define mcs_pass_lock		__mcs_pass_lock
+
+#ifdef CONFIG_NUMA_AWARE_SPINLOCKS
+/* Set at boot when waiters should be ordered by node, see qspinlock_cna.h */
+static bool numa_spinlock __ro_after_init;
+void __cna_queued_spin_lock_slowpath(struct qspinlock *lock, u32 val);
+#endif
+
+#endif /* !_GEN_PV_LOCK_SLOWPATH && !_GEN_CNA_LOCK_SLOWPATH */
 
 /**
  * queued_spin_lock_slowpath - acquire the queued spinlock
@@ -317,11 +344,21 @@ static __always_inline u32  __pv_wait_head_or_lock(struct qspinlock *lock,
 void queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 {
 	struct mcs_spinlock *prev, *next, *node;
+	u64 qstat_start;
 	u32 old, tail;
 	int idx;
 
 	BUILD_BUG_ON(CONFIG_NR_CPUS >= (1U << _Q_TAIL_CPU_BITS));
 
+#if defined(CONFIG_NUMA_AWARE_SPINLOCKS) && !defined(_GEN_CNA_LOCK_SLOWPATH)
+	if (numa_spinlock) {
+		__cna_queued_spin_lock_slowpath(lock, val);
+		return;
+	}
+#endif
+
+	qstat_start = qstat_sample_start();
+
 	if (pv_enabled())
 		goto pv_queue;
 
@@ -390,6 +427,7 @@ void queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 	 */
 	clear_pending_set_locked(lock);
 	qstat_inc(qstat_lock_pending, true);
+	qstat_contended(lock, qstat_start);
 	return;
 
 	/*
@@ -519,7 +557,7 @@ locked:
 	 *       PENDING will make the uncontended transition fail.
 	 */
 	if ((val & _Q_TAIL_MASK) == tail) {
-		if (atomic_try_cmpxchg_relaxed(&lock->val, &val, _Q_LOCKED_VAL))
+		if (try_clear_tail(lock, val, node))
 			goto release; /* No contention */
 	}
 
@@ -536,7 +574,7 @@ locked:
 	if (!next)
 		next = smp_cond_load_relaxed(&node->next, (VAL));
 
-	arch_mcs_spin_unlock_contended(&next->locked);
+	mcs_pass_lock(node, next);
 	pv_kick_node(lock, next);
 
 release:
@@ -544,4 +582,32 @@ release:
 	 * release the node
 	 */
 	this_cpu_dec(qnodes[0].mcs.count);
+	qstat_contended(lock, qstat_start);
 }
+
+/*
+ * Generate the NUMA-aware slowpath: the same code, with the PV hooks used
+ * to sort the queue by node while waiting at its head.
+ */
+#if defined(CONFIG_NUMA_AWARE_SPINLOCKS) && !defined(_GEN_CNA_LOCK_SLOWPATH)
+#define _GEN_CNA_LOCK_SLOWPATH
+
+#undef pv_init_node
+#define pv_init_node			cna_init_node
+
+#undef pv_wait_head_or_lock
+#define pv_wait_head_or_lock		cna_wait_head_or_lock
+
+#undef try_clear_tail
+#define try_clear_tail			cna_try_clear_tail
+
+#undef mcs_pass_lock
+#define mcs_pass_lock			cna_pass_lock
+
+#undef queued_spin_lock_slowpath
+#define queued_spin_lock_slowpath	__cna_queued_spin_lock_slowpath
+
+#include "qspinlock_cna.h"
+#include "qspinlock.c"
+
+#endif
@@ -0,0 +1,484 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _GEN_CNA_LOCK_SLOWPATH
+#error "do not include this file"
+#endif
+
+#include <linux/nodemask.h>
+#include <linux/numa.h>
+#include <linux/sched/clock.h>
+#include <linux/string.h>
+#include <linux/time64.h>
+
+/*
+ * Implement a NUMA-aware version of MCS (aka CNA, or compact NUMA-aware
+ * lock).
+ *
+ * In CNA, spinning threads are organized in two queues, a main queue for
+ * threads running on the same NUMA node as the current lock holder, and a
+ * secondary queue for threads running on other nodes. Schematically, it
+ * looks like this:
+ *
+ *    cna_node
+ *   +----------+     +--------+         +--------+
+ *   |mcs:next  | --> |mcs:next| --> ... |mcs:next| --> NULL  [Main queue]
+ *   |mcs:locked| -.  +--------+         +--------+
+ *   +----------+  |
+ *                 `----------------------.
+ *                                        v
+ *                 +--------+         +--------+
+ *                 |mcs:next| --> ... |mcs:next|            [Secondary queue]
+ *                 +--------+         +--------+
+ *                     ^                    |
+ *                     `--------------------'
+ *
+ * N.B. locked := 1 if secondary queue is absent. Otherwise, it contains the
+ * encoded pointer to the tail of the secondary queue, which is organized as a
+ * circular list.
+ *
+ * While the queue head waits for the owner to let go, it moves waiters from
+ * other nodes off the main queue onto the secondary queue, so that the lock
+ * is then handed to a waiter on its own node and the lock and the data it
+ * protects stay in that node's caches. The secondary queue is handed along
+ * with the lock.
+ *
+ * For fairness, once the secondary queue has existed for longer than
+ * numa_spinlock_threshold_ns, or when the main queue runs empty, it is
+ * spliced back in front of the main queue and its longest waiter goes
+ * next.
+ *
+ * Since the secondary queue is only ever touched by the lock holder and
+ * the queue head, which the MCS hand-off already serializes, no extra
+ * atomics are needed except when the secondary queue becomes the tail of
+ * the lock.
+ */
+
+struct cna_node {
+	struct mcs_spinlock	mcs;
+	int			numa_node;
+	u32			encoded_tail;	/* self */
+	u64			start_time;	/* of the secondary queue */
+};
+
+/* The secondary queue is to be spliced back at the next hand-off */
+#define CNA_FLUSH_SECONDARY	(~0ULL)
+
+static u64 numa_spinlock_threshold_ns __ro_after_init = NSEC_PER_MSEC;
+static int numa_spinlock_mode __initdata = -1;	/* auto */
+
+static int __init numa_spinlock_setup(char *str)
+{
+	if (!str)
+		return -EINVAL;
+
+	if (!strcmp(str, "auto"))
+		numa_spinlock_mode = -1;
+	else if (!strcmp(str, "on"))
+		numa_spinlock_mode = 1;
+	else if (!strcmp(str, "off"))
+		numa_spinlock_mode = 0;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+early_param("numa_spinlock", numa_spinlock_setup);
+
+static int __init numa_spinlock_threshold_setup(char *str)
+{
+	unsigned int us;
+
+	if (!str || kstrtouint(str, 0, &us) || !us)
+		return -EINVAL;
+
+	numa_spinlock_threshold_ns = (u64)us * NSEC_PER_USEC;
+
+	return 0;
+}
+early_param("numa_spinlock_threshold", numa_spinlock_threshold_setup);
+
+static void __init cna_init_nodes(void)
+{
+	int cpu, idx;
+
+	BUILD_BUG_ON(sizeof(struct cna_node) > sizeof(struct qnode));
+
+	for_each_possible_cpu(cpu) {
+		for (idx = 0; idx < MAX_NODES; idx++) {
+			struct cna_node *cn =
+				(struct cna_node *)per_cpu_ptr(&qnodes[idx].mcs, cpu);
+
+			cn->numa_node = cpu_to_node(cpu);
+			cn->encoded_tail = encode_tail(cpu, idx);
+		}
+	}
+}
+
+/*
+ * Pick the slowpath before any secondary cpu can contend. Ordering only
+ * pays off when there is more than one node to keep the lock away from.
+ */
+static int __init cna_init(void)
+{
+	if (!numa_spinlock_mode ||
+	    (numa_spinlock_mode < 0 && nr_online_nodes < 2))
+		return 0;
+
+	cna_init_nodes();
+	numa_spinlock = true;
+
+	pr_info("qspinlock: NUMA-aware slowpath on %d nodes, %llu us fairness threshold\n",
+		nr_online_nodes, div_u64(numa_spinlock_threshold_ns, NSEC_PER_USEC));
+
+	return 0;
+}
+early_initcall(cna_init);
+
+static __always_inline void cna_init_node(struct mcs_spinlock *node)
+{
+	((struct cna_node *)node)->start_time = 0;
+}
+
+/*
+ * cna_splice_head -- splice the entire secondary queue onto the head of the
+ * main queue, linking its tail to @next, or making it the tail of the lock
+ * when the main queue is empty.
+ *
+ * Returns the new main queue head, or NULL if the lock tail moved under us.
+ */
+static struct mcs_spinlock *cna_splice_head(struct qspinlock *lock, u32 val,
+					    struct mcs_spinlock *node,
+					    struct mcs_spinlock *next)
+{
+	struct mcs_spinlock *head_2nd, *tail_2nd;
+	u32 new;
+
+	tail_2nd = decode_tail(node->locked);
+	head_2nd = tail_2nd->next;
+
+	if (next) {
+		tail_2nd->next = next;
+		return head_2nd;
+	}
+
+	/*
+	 * Break the circular link before the secondary tail becomes the lock
+	 * tail, where a new waiter may link itself behind it as soon as the
+	 * cmpxchg below succeeds.
+	 */
+	tail_2nd->next = NULL;
+
+	new = ((struct cna_node *)tail_2nd)->encoded_tail | _Q_LOCKED_VAL;
+	if (!atomic_try_cmpxchg_release(&lock->val, &val, new)) {
+		/* Restore the circular link */
+		tail_2nd->next = head_2nd;
+		return NULL;
+	}
+
+	return head_2nd;
+}
+
+static inline bool cna_try_clear_tail(struct qspinlock *lock, u32 val,
+				      struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *next;
+
+	/* Both queues are empty, do what MCS does */
+	if (node->locked <= 1)
+		return __try_clear_tail(lock, val, node);
+
+	/*
+	 * The main queue is empty but waiters from other nodes are parked on
+	 * the secondary queue; move them back and let them rip.
+	 */
+	next = cna_splice_head(lock, val, node, NULL);
+	if (!next)
+		return false;
+
+	arch_mcs_spin_unlock_contended(&next->locked);
+	return true;
+}
+
+/*
+ * cna_splice_next -- move @next from the main queue to the tail of the
+ * secondary queue, @nnext becoming the successor of @node.
+ */
+static void cna_splice_next(struct mcs_spinlock *node,
+			    struct mcs_spinlock *next,
+			    struct mcs_spinlock *nnext)
+{
+	struct cna_node *cn = (struct cna_node *)node;
+
+	node->next = nnext;
+
+	if (node->locked <= 1) {
+		/* create the secondary queue and start the fairness clock */
+		next->next = next;
+		cn->start_time = sched_clock() ? : 1;
+	} else {
+		struct mcs_spinlock *tail_2nd = decode_tail(node->locked);
+
+		next->next = tail_2nd->next;
+		tail_2nd->next = next;
+	}
+
+	node->locked = ((struct cna_node *)next)->encoded_tail;
+}
+
+/*
+ * cna_order_queue -- check whether the next waiter in the main queue is on
+ * the same node as @node; if not, and it has a waiter behind it, move it to
+ * the secondary queue.
+ *
+ * Returns true once the next waiter is local.
+ */
+static bool cna_order_queue(struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *next = READ_ONCE(node->next);
+	struct mcs_spinlock *nnext;
+
+	if (!next)
+		return false;
+
+	if (((struct cna_node *)next)->numa_node ==
+	    ((struct cna_node *)node)->numa_node)
+		return true;
+
+	nnext = READ_ONCE(next->next);
+	if (nnext)
+		cna_splice_next(node, next, nnext);
+
+	return false;
+}
+
+/*
+ * Once the secondary queue has waited for longer than the threshold, the
+ * next hand-off passes the lock to its longest waiter instead.
+ */
+static inline bool cna_threshold_reached(struct cna_node *cn)
+{
+	if (!cn->start_time ||
+	    sched_clock() - cn->start_time < numa_spinlock_threshold_ns)
+		return false;
+
+	cn->start_time = CNA_FLUSH_SECONDARY;
+	return true;
+}
+
+#define LOCK_IS_BUSY(lock) (atomic_read(&(lock)->val) & _Q_LOCKED_PENDING_MASK)
+
+/*
+ * Put the time the queue head would otherwise spend waiting for the owner
+ * and pending bits to go away to use by sorting the queue.
+ */
+static __always_inline u32 cna_wait_head_or_lock(struct qspinlock *lock,
+						 struct mcs_spinlock *node)
+{
+	if (!cna_threshold_reached((struct cna_node *)node)) {
+		while (LOCK_IS_BUSY(lock) && !cna_order_queue(node))
+			cpu_relax();
+	}
+
+	return 0; /* we did not take the lock, go wait for it */
+}
+
+static inline void cna_pass_lock(struct mcs_spinlock *node,
+				 struct mcs_spinlock *next)
+{
+	struct cna_node *cn = (struct cna_node *)node;
+	u32 val = 1;
+
+	if (cn->start_time == CNA_FLUSH_SECONDARY) {
+		/* only set with a secondary queue to flush */
+		next = cna_splice_head(NULL, 0, node, next);
+	} else if (node->locked > 1) {
+		/*
+		 * Hand the secondary queue and its age along; @next may have
+		 * been moved there by cna_order_queue(), so reload it.
+		 */
+		val = node->locked;
+		next = node->next;
+		((struct cna_node *)next)->start_time = cn->start_time;
+	}
+
+	smp_store_release(&next->locked, val);
+}
+
+#ifdef CONFIG_TEST_NUMA_SPINLOCK
+#include <linux/boot_test.h>
+
+#define CNA_TEST_WAITERS	4
+
+static struct cna_node *cna_test_nodes[CNA_TEST_WAITERS] __initdata;
+
+#define cna_test_mcs(i)		(&cna_test_nodes[i]->mcs)
+#define cna_test_tail(i)	(cna_test_nodes[i]->encoded_tail)
+
+/*
+ * Queue the test nodes up behind each other on the NUMA nodes in @numa,
+ * the first one being the queue head.
+ */
+static void __init cna_test_queue(const int *numa, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		struct cna_node *cn = cna_test_nodes[i];
+
+		cn->mcs.next = i + 1 < nr ? cna_test_mcs(i + 1) : NULL;
+		cn->mcs.locked = 0;
+		cn->numa_node = numa[i];
+		cn->start_time = 0;
+	}
+	cna_test_mcs(0)->locked = 1;
+}
+
+/* A remote waiter at the end of the queue is left where it is */
+static void __init cna_test_order_last(struct boot_test *t)
+{
+	static const int numa[] __initconst = { 0, 1 };
+
+	cna_test_queue(numa, ARRAY_SIZE(numa));
+	BOOT_TEST_EXPECT(t, !cna_order_queue(cna_test_mcs(0)));
+	BOOT_TEST_EXPECT(t, cna_test_mcs(0)->next == cna_test_mcs(1));
+	BOOT_TEST_EXPECT(t, cna_test_mcs(0)->locked == 1);
+}
+
+/*
+ * Move both remote waiters of 0 -> 1 -> 1 -> 0 to the secondary queue,
+ * in order, and leave the head with a local successor.
+ */
+static void __init cna_test_order_remote(struct boot_test *t)
+{
+	static const int numa[] __initconst = { 0, 1, 1, 0 };
+	struct mcs_spinlock *head = cna_test_mcs(0);
+
+	cna_test_queue(numa, ARRAY_SIZE(numa));
+	BOOT_TEST_EXPECT(t, !cna_order_queue(head));
+	BOOT_TEST_EXPECT(t, !cna_order_queue(head));
+	BOOT_TEST_EXPECT(t, cna_order_queue(head));
+
+	BOOT_TEST_EXPECT(t, head->next == cna_test_mcs(3));
+	BOOT_TEST_EXPECT(t, head->locked == cna_test_tail(2));
+	BOOT_TEST_EXPECT(t, cna_test_mcs(2)->next == cna_test_mcs(1));
+	BOOT_TEST_EXPECT(t, cna_test_mcs(1)->next == cna_test_mcs(2));
+	BOOT_TEST_EXPECT(t, cna_test_nodes[0]->start_time);
+}
+
+/*
+ * The secondary queue and its age go along with the lock, to the head's
+ * current successor rather than the one the caller read before sorting.
+ */
+static void __init cna_test_pass_secondary(struct boot_test *t)
+{
+	cna_test_order_remote(t);
+	cna_pass_lock(cna_test_mcs(0), cna_test_mcs(1));
+
+	BOOT_TEST_EXPECT(t, cna_test_mcs(3)->locked == cna_test_tail(2));
+	BOOT_TEST_EXPECT(t, cna_test_nodes[3]->start_time ==
+			    cna_test_nodes[0]->start_time);
+	BOOT_TEST_EXPECT(t, !cna_test_mcs(1)->locked);
+}
+
+/*
+ * Past the threshold the lock goes to the longest remote waiter, with
+ * the secondary queue spliced back in front of the main queue.
+ */
+static void __init cna_test_flush(struct boot_test *t)
+{
+	struct cna_node *cn = cna_test_nodes[0];
+
+	cna_test_order_remote(t);
+	cn->start_time = 1;
+	if (sched_clock() - 1 >= numa_spinlock_threshold_ns) {
+		BOOT_TEST_EXPECT(t, cna_threshold_reached(cn));
+		BOOT_TEST_EXPECT(t, cn->start_time == CNA_FLUSH_SECONDARY);
+	}
+	cn->start_time = CNA_FLUSH_SECONDARY;
+	cna_pass_lock(cna_test_mcs(0), cna_test_mcs(3));
+
+	BOOT_TEST_EXPECT(t, cna_test_mcs(1)->locked == 1);
+	BOOT_TEST_EXPECT(t, !cna_test_mcs(3)->locked);
+	BOOT_TEST_EXPECT(t, cna_test_mcs(1)->next == cna_test_mcs(2));
+	BOOT_TEST_EXPECT(t, cna_test_mcs(2)->next == cna_test_mcs(3));
+}
+
+/* Make the head the last waiter of the main queue, node 1 on the side */
+static void __init cna_test_main_empty(struct qspinlock *lock)
+{
+	static const int numa[] __initconst = { 0, 1 };
+	struct mcs_spinlock *head = cna_test_mcs(0);
+
+	cna_test_queue(numa, ARRAY_SIZE(numa));
+	head->next = NULL;
+	head->locked = cna_test_tail(1);
+	cna_test_mcs(1)->next = cna_test_mcs(1);
+	atomic_set(&lock->val, cna_test_tail(0) | _Q_LOCKED_VAL);
+}
+
+/*
+ * With the main queue empty the secondary queue becomes the lock tail;
+ * if a waiter queued up meanwhile, nothing changes and the caller has
+ * to pass the lock instead.
+ */
+static void __init cna_test_clear_tail(struct boot_test *t)
+{
+	struct qspinlock lock = __ARCH_SPIN_LOCK_UNLOCKED;
+	u32 val;
+
+	cna_test_main_empty(&lock);
+	val = atomic_read(&lock.val);
+	BOOT_TEST_EXPECT(t, cna_try_clear_tail(&lock, val, cna_test_mcs(0)));
+	BOOT_TEST_EXPECT(t, atomic_read(&lock.val) ==
+			    (cna_test_tail(1) | _Q_LOCKED_VAL));
+	BOOT_TEST_EXPECT(t, cna_test_mcs(1)->locked == 1);
+	BOOT_TEST_EXPECT(t, !cna_test_mcs(1)->next);
+
+	cna_test_main_empty(&lock);
+	val = atomic_read(&lock.val);
+	atomic_set(&lock.val, cna_test_tail(2) | _Q_LOCKED_VAL);
+	BOOT_TEST_EXPECT(t, !cna_try_clear_tail(&lock, val, cna_test_mcs(0)));
+	BOOT_TEST_EXPECT(t, atomic_read(&lock.val) ==
+			    (cna_test_tail(2) | _Q_LOCKED_VAL));
+	BOOT_TEST_EXPECT(t, cna_test_mcs(1)->next == cna_test_mcs(1));
+	BOOT_TEST_EXPECT(t, !cna_test_mcs(1)->locked);
+}
+
+/*
+ * Only the boot cpu is up, so the queue operations are driven by hand
+ * on the queue nodes of a cpu that is not online.
+ */
+static void __init cna_test(struct boot_test *t)
+{
+	int cpu, idx;
+
+	for_each_possible_cpu(cpu) {
+		if (!cpu_online(cpu))
+			break;
+	}
+	if (cpu >= nr_cpu_ids) {
+		pr_info("%s: no offline cpu to borrow queue nodes from\n",
+			t->name);
+		return;
+	}
+
+	cna_init_nodes();
+	for (idx = 0; idx < CNA_TEST_WAITERS; idx++)
+		cna_test_nodes[idx] = (struct cna_node *)
+			per_cpu_ptr(&qnodes[idx].mcs, cpu);
+
+	cna_test_order_last(t);
+	cna_test_order_remote(t);
+	cna_test_pass_secondary(t);
+	cna_test_flush(t);
+	cna_test_clear_tail(t);
+
+	/* leave the nodes as the real slowpath expects them */
+	for (idx = 0; idx < CNA_TEST_WAITERS; idx++) {
+		cna_test_mcs(idx)->next = NULL;
+		cna_test_mcs(idx)->locked = 0;
+	}
+	cna_init_nodes();
+}
+boot_test(cna_test);
+
+#endif /* CONFIG_TEST_NUMA_SPINLOCK */
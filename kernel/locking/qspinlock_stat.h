@@ -13,33 +13,27 @@
  */
 
 /*
- * When queued spinlock statistical counters are enabled, the following
- * debugfs files will be created for reporting the counter values:
+ * When queued spinlock statistics are configured and enabled with the
+ * "qspinlock_stat[=<period>]" boot parameter or qstat_enable(), the
+ * following per-cpu counters are kept:
  *
- * <debugfs>/qlockstat/
- *   pv_hash_hops	- average # of hops per hashing operation
- *   pv_kick_unlock	- # of vCPU kicks issued at unlock time
- *   pv_kick_wake	- # of vCPU kicks used for computing pv_latency_wake
- *   pv_latency_kick	- average latency (ns) of vCPU kick operation
- *   pv_latency_wake	- average latency (ns) from vCPU kick to wakeup
- *   pv_lock_stealing	- # of lock stealing operations
- *   pv_spurious_wakeup	- # of spurious wakeups in non-head vCPUs
- *   pv_wait_again	- # of wait's after a queue head vCPU kick
- *   pv_wait_early	- # of early vCPU wait's
- *   pv_wait_head	- # of vCPU wait's at the queue head
- *   pv_wait_node	- # of vCPU wait's at a non-head queue node
  *   lock_pending	- # of locking operations via pending code
  *   lock_slowpath	- # of locking operations via MCS lock queue
+ *   lock_idx1..3	- # of MCS queueings at nesting level 1..3
  *
- * Writing to the "reset_counters" file will reset all the above counter
- * values.
+ * In addition one in <period> (default 64) slowpath entries per cpu is
+ * timed with the architected counter and accounted in a table keyed by
+ * lock address and call site, with a log2 histogram of the wait.
  *
- * These statistical counters are implemented as per-cpu variables which are
- * summed and computed whenever the corresponding debugfs files are read. This
- * minimizes added overhead making the counters usable even in a production
- * environment.
+ * qstat_dump() sums and prints the counters and the contended locks,
+ * worst total wait first, and qstat_reset() clears them. The table is
+ * dumped and reset once at the end of boot.
  *
- * There may be slight difference between pv_kick_wake and pv_kick_unlock.
+ * The counters are plain per-cpu variables that are only summed when
+ * dumped, and the table is only touched by sampled slowpath entries,
+ * so the overhead is low enough to leave them enabled in production.
+ * The pv_* counters are kept for reference; there is no paravirt
+ * support here.
  */
 enum qlock_stats {
 	qstat_pv_hash_hops,
@@ -62,5 +56,256 @@ enum qlock_stats {
 	qstat_reset_cnts = qstat_num,
 };
 
+#ifdef CONFIG_QUEUED_LOCK_STAT
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/sort.h>
+#include <linux/timex.h>
+#include <linux/time64.h>
+#include <linux/math64.h>
+
+#include <clocksource/arm_arch_timer.h>
+
+#define QSTAT_SITE_BITS		7
+#define QSTAT_SITES		(1 << QSTAT_SITE_BITS)
+#define QSTAT_PROBES		8
+#define QSTAT_HIST		16
+
+/*
+ * A sampled contended lock. @lock and @caller are claimed together with
+ * cmpxchg_double() so that a half-written key is never matched.
+ */
+struct qstat_site {
+	unsigned long lock;
+	unsigned long caller;
+	atomic_long_t count;
+	atomic_long_t wait;		/* timer ticks */
+	unsigned long max;
+	atomic_t hist[QSTAT_HIST];	/* by fls64() of the wait */
+} __aligned(2 * sizeof(unsigned long));
+
+static const char * const qstat_names[qstat_num] = {
+	[qstat_lock_pending]	= "lock_pending",
+	[qstat_lock_slowpath]	= "lock_slowpath",
+	[qstat_lock_idx1]	= "lock_idx1",
+	[qstat_lock_idx2]	= "lock_idx2",
+	[qstat_lock_idx3]	= "lock_idx3",
+};
+
+static DEFINE_PER_CPU(unsigned long, qstats[qstat_num]);
+static DEFINE_PER_CPU(unsigned int, qstat_sample_left);
+static struct qstat_site qstat_sites[QSTAT_SITES];
+static atomic_long_t qstat_site_drops;
+
+static bool qstat_enabled __read_mostly;
+static unsigned int qstat_sample_period __read_mostly = 64;
+
+static int __init qstat_setup(char *str)
+{
+	unsigned int period;
+
+	if (str && !kstrtouint(str, 0, &period) && period)
+		qstat_sample_period = period;
+	qstat_enabled = true;
+
+	return 0;
+}
+early_param("qspinlock_stat", qstat_setup);
+
+static inline void qstat_inc(enum qlock_stats stat, bool cond)
+{
+	if (READ_ONCE(qstat_enabled) && cond)
+		this_cpu_inc(qstats[stat]);
+}
+
+static inline void qstat_hop(int hopcnt)			{ }
+
+/*
+ * The slowpath is entered from the out of line _raw_spin_lock*()
+ * functions, so with frame pointers the interesting call site is one
+ * frame further up.
+ */
+#ifdef CONFIG_FRAME_POINTER
+#define QSTAT_CALLER	((unsigned long)__builtin_return_address(1))
+#else
+#define QSTAT_CALLER	_RET_IP_
+#endif
+
+/*
+ * Returns the start time when this slowpath entry is to be sampled,
+ * zero otherwise.
+ */
+static __always_inline u64 qstat_sample_start(void)
+{
+	unsigned int left;
+	u64 now;
+
+	if (!READ_ONCE(qstat_enabled))
+		return 0;
+
+	left = this_cpu_read(qstat_sample_left);
+	if (left) {
+		this_cpu_write(qstat_sample_left, left - 1);
+		return 0;
+	}
+	this_cpu_write(qstat_sample_left, qstat_sample_period - 1);
+
+	now = get_cycles();
+	return now ? now : 1;
+}
+
+static struct qstat_site *qstat_site_get(unsigned long lock,
+					 unsigned long caller)
+{
+	unsigned long key = (lock ^ (caller << 3)) * 0x61c8864680b583ebUL;
+	unsigned int i, idx = key >> (BITS_PER_LONG - QSTAT_SITE_BITS);
+	struct qstat_site *site;
+
+	for (i = 0; i < QSTAT_PROBES; i++) {
+		site = &qstat_sites[(idx + i) & (QSTAT_SITES - 1)];
+
+		if (!READ_ONCE(site->lock) &&
+		    cmpxchg_double(&site->lock, &site->caller,
+				   0UL, 0UL, lock, caller))
+			return site;
+
+		if (READ_ONCE(site->lock) == lock &&
+		    READ_ONCE(site->caller) == caller)
+			return site;
+	}
+
+	return NULL;
+}
+
+static void qstat_record(struct qspinlock *lock, unsigned long caller,
+			 u64 start)
+{
+	u64 wait = get_cycles() - start;
+	struct qstat_site *site;
+
+	site = qstat_site_get((unsigned long)lock, caller);
+	if (!site) {
+		atomic_long_inc(&qstat_site_drops);
+		return;
+	}
+
+	atomic_long_inc(&site->count);
+	atomic_long_add(wait, &site->wait);
+	if (wait > READ_ONCE(site->max))
+		WRITE_ONCE(site->max, wait);
+	atomic_inc(&site->hist[min(fls64(wait), QSTAT_HIST - 1)]);
+}
+
+#define qstat_contended(lock, start)					\
+do {									\
+	if (unlikely(start))						\
+		qstat_record(lock, QSTAT_CALLER, start);		\
+} while (0)
+
+void qstat_enable(bool on)
+{
+	WRITE_ONCE(qstat_enabled, on);
+}
+
+static u64 qstat_ns(u64 ticks)
+{
+	u32 khz = arch_timer_get_rate() / 1000;
+
+	return khz ? div_u64(ticks * (NSEC_PER_SEC / 1000), khz) : ticks;
+}
+
+static int qstat_site_cmp(const void *a, const void *b)
+{
+	long wa = atomic_long_read(&qstat_sites[*(const u8 *)a].wait);
+	long wb = atomic_long_read(&qstat_sites[*(const u8 *)b].wait);
+
+	return wa < wb ? 1 : wa > wb ? -1 : 0;
+}
+
+void qstat_dump(void)
+{
+	unsigned long sum[qstat_num] = { 0 };
+	u8 order[QSTAT_SITES];
+	char hist[QSTAT_HIST * 16];
+	int cpu, i, j, len, nr = 0;
+
+	for_each_possible_cpu(cpu)
+		for (i = qstat_lock_pending; i < qstat_num; i++)
+			sum[i] += per_cpu(qstats[i], cpu);
+
+	for (i = qstat_lock_pending; i < qstat_num; i++)
+		pr_info("qlockstat: %-14s %lu\n", qstat_names[i], sum[i]);
+
+	for (i = 0; i < QSTAT_SITES; i++)
+		if (READ_ONCE(qstat_sites[i].lock))
+			order[nr++] = i;
+	sort(order, nr, sizeof(order[0]), qstat_site_cmp, NULL);
+
+	pr_info("qlockstat: %d contended locks, 1 in %u waits sampled, %ld dropped\n",
+		nr, qstat_sample_period, atomic_long_read(&qstat_site_drops));
+
+	for (i = 0; i < nr; i++) {
+		struct qstat_site *site = &qstat_sites[order[i]];
+		long count = atomic_long_read(&site->count);
+		u64 wait = atomic_long_read(&site->wait);
+
+		pr_info("qlockstat: lock %p at %pS: %ld waits, %llu ns total, %llu ns avg, %llu ns max\n",
+			(void *)site->lock, (void *)site->caller, count,
+			qstat_ns(wait), qstat_ns(div64_u64(wait, count ? count : 1)),
+			qstat_ns(site->max));
+
+		for (j = 0, len = 0; j < QSTAT_HIST; j++) {
+			int n = atomic_read(&site->hist[j]);
+
+			if (!n)
+				continue;
+			if (j == QSTAT_HIST - 1)
+				len += scnprintf(hist + len, sizeof(hist) - len,
+						 " >=%llu:%d", qstat_ns(1ULL << (j - 1)), n);
+			else
+				len += scnprintf(hist + len, sizeof(hist) - len,
+						 " <%llu:%d", qstat_ns(1ULL << j), n);
+		}
+		pr_info("qlockstat:   ns histogram%s\n", len ? hist : " empty");
+	}
+}
+
+/*
+ * Sampling is paused while the table is cleared; a wait being recorded
+ * concurrently on another cpu may still be lost or miscounted.
+ */
+void qstat_reset(void)
+{
+	bool enabled = READ_ONCE(qstat_enabled);
+	int cpu;
+
+	WRITE_ONCE(qstat_enabled, false);
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(&qstats, cpu), 0, sizeof(qstats));
+	memset(qstat_sites, 0, sizeof(qstat_sites));
+	atomic_long_set(&qstat_site_drops, 0);
+	WRITE_ONCE(qstat_enabled, enabled);
+}
+
+static int __init qstat_boot_dump(void)
+{
+	if (!qstat_enabled)
+		return 0;
+
+	pr_info("qlockstat: contention during boot\n");
+	qstat_dump();
+	qstat_reset();
+
+	return 0;
+}
+late_initcall(qstat_boot_dump);
+
+#else /* CONFIG_QUEUED_LOCK_STAT */
+
 static inline void qstat_inc(enum qlock_stats stat, bool cond)	{ }
 static inline void qstat_hop(int hopcnt)			{ }
+static inline u64 qstat_sample_start(void)			{ return 0; }
+static inline void qstat_contended(struct qspinlock *lock, u64 start) { }
+
+#endif /* CONFIG_QUEUED_LOCK_STAT */
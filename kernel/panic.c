@@ -11,6 +11,22 @@
 #include <linux/compiler.h>
 #include <linux/kernel.h>
 
+int oops_in_progress;
+
+/*
+ * Bracket the report of an oops the system may not survive: printk()
+ * writes to the console synchronously until oops_exit().
+ */
+void oops_enter(void)
+{
+	oops_in_progress++;
+}
+
+void oops_exit(void)
+{
+	oops_in_progress--;
+}
+
 /**
  *	panic - halt the system
  *	@fmt: The text string to print
@@ -24,11 +40,14 @@ void panic(const char *fmt, ...)
 	static char buf[1024];
 	va_list args;
 
+	oops_in_progress++;
+
 	va_start(args, fmt);
 	vsnprintf(buf, sizeof(buf), fmt, args);
 	va_end(args);
 
 	pr_emerg("Kernel panic - not syncing: %s\n", buf);
+	console_flush_on_panic();
 
 	while (1);
 }
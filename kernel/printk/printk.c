@@ -16,8 +16,12 @@
  *	01Mar01 Andrew Morton
  */
 #include <linux/kernel.h>
+#include <linux/init.h>
 #include <linux/smp.h>
 #include <linux/irqflags.h>
+#include <linux/atomic.h>
+#include <linux/percpu.h>
+#include <linux/string.h>
 
 int console_printk[4] = {
 	CONSOLE_LOGLEVEL_DEFAULT,	/* console_loglevel */
@@ -36,27 +40,249 @@ enum log_flags {
 	LOG_NEWLINE	= 2,	/* text ended with a newline */
 	LOG_PREFIX	= 4,	/* text started with a prefix */
 	LOG_CONT	= 8,	/* text is a fragment of a continuation line */
+	LOG_PAD		= 16,	/* filler up to the end of the buffer */
 };
 
+/*
+ * The log buffer is a ring of variable length records, each a struct
+ * printk_log header followed by the NUL terminated text.
+ *
+ * Writers reserve space with a cmpxchg on log_head, which packs the
+ * sequence number of the next record above the logical byte offset of
+ * the next free space so that both advance together. A reservation that
+ * would straddle the end of the buffer is preceded by a LOG_PAD record.
+ * Once the text is copied in, the writer publishes the record by storing
+ * its logical offset (| 1) into @commit with release semantics.
+ *
+ * A single console owner consumes the records in order and moves
+ * log_tail past them once they are printed. Writers never overwrite
+ * records that have not been printed: a message that doesn't fit is
+ * dropped without taking a sequence number, and counted in log_dropped
+ * for the console to report.
+ */
+struct printk_log {
+	u32 commit;		/* logical offset | 1 once complete */
+	u32 seq;		/* sequence number */
+	u16 len;		/* length of the entire record */
+	u16 text_len;		/* length of the text, without the NUL */
+	u8 flags:5;		/* internal record flags */
+	u8 level:3;		/* syslog level */
+} __aligned(8);
+
+#define LOG_ALIGN		__alignof__(struct printk_log)
+#define __LOG_BUF_LEN		(1 << CONFIG_LOG_BUF_SHIFT)
+#define LOG_POS(seq, off)	((u64)(seq) << 32 | (u32)(off))
+
+static char __log_buf[__LOG_BUF_LEN] __aligned(LOG_ALIGN);
+static atomic64_t log_head = ATOMIC64_INIT(0);
+static u32 log_tail;
+
+/* messages that found no room in the ring since the console last said so */
+static atomic_t log_dropped = ATOMIC_INIT(0);
+static atomic_t console_owner = ATOMIC_INIT(0);
+
+/* messages are formatted here before being copied into the ring */
+static DEFINE_PER_CPU(char [LOG_LINE_MAX], printk_textbuf);
+
+static bool printk_sync __read_mostly;
+
+/*
+ * Until the boot CPU first goes idle, and while an oops is reported,
+ * whoever logs a message prints it: nothing else is sure to run.
+ */
+static bool printk_idle_reached;
+
+static int __init printk_sync_setup(char *arg)
+{
+	printk_sync = true;
+	return 0;
+}
+early_param("printk_sync", printk_sync_setup);
+
+static struct printk_log *log_from_pos(u32 pos)
+{
+	return (struct printk_log *)(__log_buf + (pos & (__LOG_BUF_LEN - 1)));
+}
+
+static char *log_text(const struct printk_log *msg)
+{
+	return (char *)msg + sizeof(struct printk_log);
+}
+
+static void log_commit(struct printk_log *msg, u32 pos)
+{
+	smp_store_release(&msg->commit, pos | 1);
+}
+
+/* Returns false if the record could not be stored. */
+static bool log_store(int level, enum log_flags lflags,
+		      const char *text, u16 text_len)
+{
+	u32 size = ALIGN(sizeof(struct printk_log) + text_len + 1, LOG_ALIGN);
+	struct printk_log *msg;
+	u32 off, pad, seq;
+	u64 head;
+
+	do {
+		head = atomic64_read(&log_head);
+		off = (u32)head;
+		seq = head >> 32;
+
+		/* never split a record over the end of the buffer */
+		pad = __LOG_BUF_LEN - (off & (__LOG_BUF_LEN - 1));
+		if (pad >= size)
+			pad = 0;
+
+		/* only a stored record takes a sequence number */
+		if (off + pad + size - smp_load_acquire(&log_tail) >
+		    __LOG_BUF_LEN)
+			return false;
+	} while (atomic64_cmpxchg(&log_head, head,
+				  LOG_POS(seq + 1, off + pad + size)) != head);
+
+	/* a pad too short for a header is skipped by the console anyway */
+	if (pad >= sizeof(struct printk_log)) {
+		msg = log_from_pos(off);
+		msg->len = pad;
+		msg->text_len = 0;
+		msg->flags = LOG_PAD;
+		log_commit(msg, off);
+	}
+	off += pad;
+
+	msg = log_from_pos(off);
+	msg->seq = seq;
+	msg->len = size;
+	msg->text_len = text_len;
+	msg->flags = lflags;
+	msg->level = level;
+	memcpy(log_text(msg), text, text_len);
+	log_text(msg)[text_len] = '\0';
+	log_commit(msg, off);
+
+	return true;
+}
+
 extern void puts_q(const char *str); /* TODO Temp */
-asmlinkage int vprintk_emit(int facility, int level,
-			    const char *dict, size_t dictlen,
-			    const char *fmt, va_list args)
+extern int uart_console_ready(void);
+
+/*
+ * Returns the oldest record if the console can consume it, NULL if the
+ * ring is empty or that record is still being written. Too short a
+ * space before the end of the buffer holds no record and is stepped
+ * over; @pos is set to where the record starts.
+ */
+static struct printk_log *console_peek(u32 *pos)
+{
+	u32 tail = READ_ONCE(log_tail);
+	u32 rem;
+
+	if (tail == (u32)atomic64_read(&log_head))
+		return NULL;
+
+	rem = __LOG_BUF_LEN - (tail & (__LOG_BUF_LEN - 1));
+	if (rem < sizeof(struct printk_log))
+		tail += rem;
+
+	if (smp_load_acquire(&log_from_pos(tail)->commit) != (tail | 1))
+		return NULL;
+
+	*pos = tail;
+	return log_from_pos(tail);
+}
+
+static void console_emit(struct printk_log *msg)
 {
-	static char textbuf[LOG_LINE_MAX];
-	char *text = textbuf;
+	char buf[48];
+	int dropped;
+
+	if (msg->flags & LOG_PAD)
+		return;
+
+	if (atomic_read(&log_dropped)) {
+		dropped = atomic_xchg(&log_dropped, 0);
+		snprintf(buf, sizeof(buf), "** %d printk messages dropped **\n",
+			 dropped);
+		puts_q(buf);
+	}
+
+	puts_q(log_text(msg));
+	if (msg->flags & LOG_NEWLINE)
+		puts_q("\n");
+}
+
+/*
+ * Print everything that is in the log buffer. Only one CPU prints at a
+ * time; anyone else finding the console busy leaves their records to
+ * the current owner, which checks for new ones before letting go.
+ */
+static void console_flush(void)
+{
+	struct printk_log *msg;
+	u32 pos;
+
+	if (!uart_console_ready())
+		return;
+
+	do {
+		if (atomic_xchg(&console_owner, 1))
+			return;
+
+		while ((msg = console_peek(&pos)) != NULL) {
+			console_emit(msg);
+			smp_store_release(&log_tail, pos + msg->len);
+		}
+
+		atomic_set(&console_owner, 0);
+		smp_mb();
+	} while (console_peek(&pos));
+}
+
+/*
+ * Called from the idle loop: this is where messages normally reach the
+ * console, away from whoever logged them.
+ */
+bool printk_flush_idle(void)
+{
+	u32 pos;
+
+	WRITE_ONCE(printk_idle_reached, true);
+
+	if (!uart_console_ready() || !console_peek(&pos))
+		return false;
+
+	console_flush();
+	return true;
+}
+
+/*
+ * Whoever owned the console may never come back to release it, take it
+ * over and print what is left.
+ */
+void console_flush_on_panic(void)
+{
+	atomic_set(&console_owner, 0);
+	console_flush();
+}
+
+/*
+ * Format the message into this cpu's buffer and store it in the ring.
+ * Called with interrupts off, which keeps the buffer ours.
+ */
+static bool printk_store(int facility, int level, const char *fmt,
+			 va_list args, size_t *len)
+{
+	char *text;
 	size_t text_len = 0;
 	enum log_flags lflags = 0;
-	unsigned long flags;
 
-	/* This stops the holder of console_sem just where we want him */
-	local_irq_save(flags);
+	text = this_cpu_ptr(printk_textbuf);
 
 	/*
 	 * The printf needs to come first; we need the syslog
 	 * prefix which might be passed-in as a parameter.
 	 */
-	text_len = vscnprintf(text, sizeof(textbuf), fmt, args);
+	text_len = vscnprintf(text, LOG_LINE_MAX, fmt, args);
 
 	/* mark and strip a trailing newline */
 	if (text_len && text[text_len-1] == '\n') {
@@ -90,10 +316,43 @@ asmlinkage int vprintk_emit(int facility, int level,
 	if (level == -1)
 		level = default_message_loglevel;
 
-	puts_q(text);
-	
+	*len = text_len;
+	return log_store(level, lflags, text, text_len);
+}
+
+asmlinkage int vprintk_emit(int facility, int level,
+			    const char *dict, size_t dictlen,
+			    const char *fmt, va_list args)
+{
+	size_t text_len;
+	unsigned long flags;
+	va_list retry;
+	bool stored;
+
+	va_copy(retry, args);
+
+	/* only keep interrupts off while the per-cpu buffer is in use */
+	local_irq_save(flags);
+	stored = printk_store(facility, level, fmt, args, &text_len);
 	local_irq_restore(flags);
 
+	if (!stored) {
+		/* make room by printing what is there, then try once more */
+		console_flush();
+
+		local_irq_save(flags);
+		stored = printk_store(facility, level, fmt, retry, &text_len);
+		local_irq_restore(flags);
+
+		if (!stored)
+			atomic_inc(&log_dropped);
+	}
+	va_end(retry);
+
+	if (printk_sync || !READ_ONCE(printk_idle_reached) ||
+	    READ_ONCE(oops_in_progress))
+		console_flush();
+
 	return text_len;
 }
 
@@ -14,6 +14,7 @@
 #include <linux/init.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
+#include <linux/percpu-rwlock.h>
 #include <linux/device.h>
 #include <linux/mm.h>
 #include <linux/resource_ext.h>
@@ -45,7 +46,7 @@ struct resource_constraint {
 	void *alignf_data;
 };
 
-static DEFINE_RWLOCK(resource_lock);
+DEFINE_STATIC_PERCPU_RWLOCK(resource_lock);
 
 /*
  * For memory hotplug, there is no way to free resource entries allocated
@@ -192,9 +193,9 @@ static void __release_child_resources(struct resource *r)
 
 void release_child_resources(struct resource *r)
 {
-	write_lock(&resource_lock);
+	percpu_write_lock(&resource_lock);
 	__release_child_resources(r);
-	write_unlock(&resource_lock);
+	percpu_write_unlock(&resource_lock);
 }
 
 /**
@@ -208,9 +209,9 @@ struct resource *request_resource_conflict(struct resource *root, struct resourc
 {
 	struct resource *conflict;
 
-	write_lock(&resource_lock);
+	percpu_write_lock(&resource_lock);
 	conflict = __request_resource(root, new);
-	write_unlock(&resource_lock);
+	percpu_write_unlock(&resource_lock);
 	return conflict;
 }
 
@@ -237,9 +238,9 @@ int release_resource(struct resource *old)
 {
 	int retval;
 
-	write_lock(&resource_lock);
+	percpu_write_lock(&resource_lock);
 	retval = __release_resource(old, true);
-	write_unlock(&resource_lock);
+	percpu_write_unlock(&resource_lock);
 	return retval;
 }
 
@@ -274,7 +275,7 @@ static int find_next_iomem_res(resource_size_t start, resource_size_t end,
 	if (start >= end)
 		return -EINVAL;
 
-	read_lock(&resource_lock);
+	percpu_read_lock(&resource_lock);
 
 	for (p = iomem_resource.child; p; p = next_resource(p, first_lvl)) {
 		if ((p->flags & flags) != flags)
@@ -289,7 +290,7 @@ static int find_next_iomem_res(resource_size_t start, resource_size_t end,
 			break;
 	}
 
-	read_unlock(&resource_lock);
+	percpu_read_unlock(&resource_lock);
 	if (!p)
 		return -1;
 
@@ -435,7 +436,7 @@ int region_intersects(resource_size_t start, size_t size, unsigned long flags,
 	int type = 0; int other = 0;
 	struct resource *p;
 
-	read_lock(&resource_lock);
+	percpu_read_lock(&resource_lock);
 	for (p = iomem_resource.child; p ; p = p->sibling) {
 		bool is_type = (((p->flags & flags) == flags) &&
 				((desc == IORES_DESC_NONE) ||
@@ -448,7 +449,7 @@ int region_intersects(resource_size_t start, size_t size, unsigned long flags,
 		if (p->start >= start && p->end <= end)
 			is_type ? type++ : other++;
 	}
-	read_unlock(&resource_lock);
+	percpu_read_unlock(&resource_lock);
 
 	if (other == 0)
 		return type ? REGION_INTERSECTS : REGION_DISJOINT;
@@ -568,7 +569,7 @@ static int reallocate_resource(struct resource *root, struct resource *old,
 	struct resource new = *old;
 	struct resource *conflict;
 
-	write_lock(&resource_lock);
+	percpu_write_lock(&resource_lock);
 
 	if ((err = __find_resource(root, old, &new, newsize, constraint)))
 		goto out;
@@ -594,7 +595,7 @@ static int reallocate_resource(struct resource *root, struct resource *old,
 		BUG_ON(conflict);
 	}
 out:
-	write_unlock(&resource_lock);
+	percpu_write_unlock(&resource_lock);
 	return err;
 }
 
@@ -637,11 +638,11 @@ int allocate_resource(struct resource *root, struct resource *new,
 		return reallocate_resource(root, new, size, &constraint);
 	}
 
-	write_lock(&resource_lock);
+	percpu_write_lock(&resource_lock);
 	err = find_resource(root, new, size, &constraint);
 	if (err >= 0 && __request_resource(root, new))
 		err = -EBUSY;
-	write_unlock(&resource_lock);
+	percpu_write_unlock(&resource_lock);
 	return err;
 }
 
@@ -656,12 +657,12 @@ struct resource *lookup_resource(struct resource *root, resource_size_t start)
 {
 	struct resource *res;
 
-	read_lock(&resource_lock);
+	percpu_read_lock(&resource_lock);
 	for (res = root->child; res; res = res->sibling) {
 		if (res->start == start)
 			break;
 	}
-	read_unlock(&resource_lock);
+	percpu_read_unlock(&resource_lock);
 
 	return res;
 }
@@ -739,9 +740,9 @@ struct resource *insert_resource_conflict(struct resource *parent, struct resour
 {
 	struct resource *conflict;
 
-	write_lock(&resource_lock);
+	percpu_write_lock(&resource_lock);
 	conflict = __insert_resource(parent, new);
-	write_unlock(&resource_lock);
+	percpu_write_unlock(&resource_lock);
 	return conflict;
 }
 
@@ -776,7 +777,7 @@ void insert_resource_expand_to_fit(struct resource *root, struct resource *new)
 	if (new->parent)
 		return;
 
-	write_lock(&resource_lock);
+	percpu_write_lock(&resource_lock);
 	for (;;) {
 		struct resource *conflict;
 
@@ -794,7 +795,7 @@ void insert_resource_expand_to_fit(struct resource *root, struct resource *new)
 
 		printk("Expanded resource %s due to conflict with %s\n", new->name, conflict->name);
 	}
-	write_unlock(&resource_lock);
+	percpu_write_unlock(&resource_lock);
 }
 
 /**
@@ -816,9 +817,9 @@ int remove_resource(struct resource *old)
 {
 	int retval;
 
-	write_lock(&resource_lock);
+	percpu_write_lock(&resource_lock);
 	retval = __release_resource(old, false);
-	write_unlock(&resource_lock);
+	percpu_write_unlock(&resource_lock);
 	return retval;
 }
 
@@ -874,9 +875,9 @@ int adjust_resource(struct resource *res, resource_size_t start,
 {
 	int result;
 
-	write_lock(&resource_lock);
+	percpu_write_lock(&resource_lock);
 	result = __adjust_resource(res, start, size);
-	write_unlock(&resource_lock);
+	percpu_write_unlock(&resource_lock);
 	return result;
 }
 
@@ -947,7 +948,7 @@ reserve_region_with_split(struct resource *root, resource_size_t start,
 {
 	int abort = 0;
 
-	write_lock(&resource_lock);
+	percpu_write_lock(&resource_lock);
 	if (root->start > start || root->end < end) {
 		pr_err("requested range [0x%llx-0x%llx] not in root %pr\n",
 		       (unsigned long long)start, (unsigned long long)end,
@@ -967,7 +968,7 @@ reserve_region_with_split(struct resource *root, resource_size_t start,
 	}
 	if (!abort)
 		__reserve_region_with_split(root, start, end, name);
-	write_unlock(&resource_lock);
+	percpu_write_unlock(&resource_lock);
 }
 
 /**
@@ -998,7 +999,7 @@ int iomem_map_sanity_check(resource_size_t addr, unsigned long size)
 	int err = 0;
 	loff_t l;
 
-	read_lock(&resource_lock);
+	percpu_read_lock(&resource_lock);
 	for (p = p->child; p ; p = r_next(NULL, p, &l)) {
 		/*
 		 * We can probably skip the resources without
@@ -1027,7 +1028,7 @@ int iomem_map_sanity_check(resource_size_t addr, unsigned long size)
 		err = -1;
 		break;
 	}
-	read_unlock(&resource_lock);
+	percpu_read_unlock(&resource_lock);
 
 	return err;
 }
@@ -1050,7 +1051,7 @@ bool iomem_is_exclusive(u64 addr)
 
 	addr = addr & PAGE_MASK;
 
-	read_lock(&resource_lock);
+	percpu_read_lock(&resource_lock);
 	for (p = p->child; p ; p = r_next(NULL, p, &l)) {
 		/*
 		 * We can probably skip the resources without
@@ -1073,7 +1074,7 @@ bool iomem_is_exclusive(u64 addr)
 			break;
 		}
 	}
-	read_unlock(&resource_lock);
+	percpu_read_unlock(&resource_lock);
 
 	return err;
 }
@@ -1135,7 +1136,7 @@ struct resource * __request_region(struct resource *parent,
 	res->start = start;
 	res->end = start + n - 1;
 
-	write_lock(&resource_lock);
+	percpu_write_lock(&resource_lock);
 
 	for (;;) {
 		struct resource *conflict;
@@ -1155,11 +1156,11 @@ struct resource * __request_region(struct resource *parent,
 		}
 		if (conflict->flags & flags & IORESOURCE_MUXED) {
 			add_wait_queue(&muxed_resource_wait, &wait);
-			write_unlock(&resource_lock);
+			percpu_write_unlock(&resource_lock);
 			set_current_state(TASK_UNINTERRUPTIBLE);
 			schedule();
 			remove_wait_queue(&muxed_resource_wait, &wait);
-			write_lock(&resource_lock);
+			percpu_write_lock(&resource_lock);
 			continue;
 		}
 		/* Uhhuh, that didn't work out.. */
@@ -1167,7 +1168,7 @@ struct resource * __request_region(struct resource *parent,
 		res = NULL;
 		break;
 	}
-	write_unlock(&resource_lock);
+	percpu_write_unlock(&resource_lock);
 	return res;
 }
 
@@ -1189,7 +1190,7 @@ void __release_region(struct resource *parent, resource_size_t start,
 	p = &parent->child;
 	end = start + n - 1;
 
-	write_lock(&resource_lock);
+	percpu_write_lock(&resource_lock);
 
 	for (;;) {
 		struct resource *res = *p;
@@ -1204,7 +1205,7 @@ void __release_region(struct resource *parent, resource_size_t start,
 			if (res->start != start || res->end != end)
 				break;
 			*p = res->sibling;
-			write_unlock(&resource_lock);
+			percpu_write_unlock(&resource_lock);
 			if (res->flags & IORESOURCE_MUXED)
 				wake_up(&muxed_resource_wait);
 			free_resource(res);
@@ -1213,7 +1214,7 @@ void __release_region(struct resource *parent, resource_size_t start,
 		p = &res->sibling;
 	}
 
-	write_unlock(&resource_lock);
+	percpu_write_unlock(&resource_lock);
 
 	printk(KERN_WARNING "Trying to free nonexistent resource "
 		"<%016llx-%016llx>\n", (unsigned long long)start,
@@ -12,6 +12,8 @@
 #include <linux/percpu.h>
 #include <linux/jiffies.h>
 
+#include <asm/switch_to.h>
+
 #include "sched.h"
 #include "pelt.h"
 
@@ -970,10 +972,11 @@ unsigned long wait_task_inactive(struct task_struct *p, long match_state)
 		 * yield - it could be a while.
 		 */
 		if (unlikely(queued)) {
-			//ktime_t to = NSEC_PER_SEC / HZ;
-
-			set_current_state(TASK_UNINTERRUPTIBLE);
-			//schedule_hrtimeout(&to, HRTIMER_MODE_REL);
+			/*
+			 * No hrtimer sleeps here, just yield the cpu and let
+			 * it run until it blocks.
+			 */
+			schedule();
 			continue;
 		}
 
@@ -2219,7 +2222,7 @@ context_switch(struct rq *rq, struct task_struct *prev,
 	prepare_lock_switch(rq, next, rf);
 
 	/* Here we just switch the register state and the stack. */
-	//switch_to(prev, next, prev);
+	switch_to(prev, next, prev);
 	barrier();
 
 	return finish_task_switch(prev);
@@ -2612,8 +2615,12 @@ static void __sched notrace __schedule(bool preempt)
 
 	switch_count = &prev->nivcsw;
 	if (!preempt && prev->state) {
-		//if (signal_pending_state(prev->state, prev)) {
-		if (1) {
+		/*
+		 * There are no signals to wake a sleeper early. The idle
+		 * task is what runs the initcalls here, it must never
+		 * leave the runqueue and only yields when it schedules.
+		 */
+		if (unlikely(is_idle_task(prev))) {
 			prev->state = TASK_RUNNING;
 		} else {
 			deactivate_task(rq, prev, DEQUEUE_SLEEP | DEQUEUE_NOCLOCK);
@@ -3934,6 +3941,10 @@ out:
 
 bool sched_smp_initialized __read_mostly;
 
+#ifdef CONFIG_SCHED_SMT
+DEFINE_STATIC_KEY_FALSE(sched_smt_present);
+#endif
+
 void set_rq_online(struct rq *rq)
 {
 	if (!rq->online) {
@@ -4029,7 +4040,7 @@ int sched_cpu_activate(unsigned int cpu)
 	cpu_set_active(cpu);
 
 	if (sched_smp_initialized) {
-		//sched_domains_numa_masks_set(cpu);
+		sched_domains_numa_masks_set(cpu);
 		cpuset_cpu_active();
 	}
 
@@ -4084,7 +4095,7 @@ int sched_cpu_deactivate(unsigned int cpu)
 		cpu_set_active(cpu);
 		return ret;
 	}
-	//sched_domains_numa_masks_clear(cpu);
+	sched_domains_numa_masks_clear(cpu);
 	return 0;
 }
 
@@ -4105,7 +4116,7 @@ int sched_cpu_starting(unsigned int cpu)
 
 void __init sched_init_smp(void)
 {
-	//sched_init_numa();
+	sched_init_numa();
 
 	/*
 	 * There's no userspace yet to cause hotplug operations; hence all the
@@ -4115,7 +4126,7 @@ void __init sched_init_smp(void)
 	 */
 	//cpus_read_lock();
 	mutex_lock(&sched_domains_mutex);
-	//sched_init_domains(cpu_active_mask);
+	sched_init_domains(cpu_active_mask);
 	mutex_unlock(&sched_domains_mutex);
 	//cpus_read_unlock();
 
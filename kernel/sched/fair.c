@@ -2778,9 +2778,7 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 	s64 delta;
 	int cpu, nr = INT_MAX;
 
-	/* TODO */
-	this_sd = NULL;
-	//this_sd = rcu_dereference(*this_cpu_ptr(&sd_llc));
+	this_sd = rcu_dereference(*this_cpu_ptr(&sd_llc));
 	if (!this_sd)
 		return -1;
 
@@ -2853,9 +2851,7 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 		return recent_used_cpu;
 	}
 
-	/* TODO */
-	sd = NULL;
-	//sd = rcu_dereference(per_cpu(sd_llc, target));
+	sd = rcu_dereference(per_cpu(sd_llc, target));
 	if (!sd)
 		return target;
 
@@ -5291,8 +5287,8 @@ static int should_we_balance(struct lb_env *env)
 		break;
 	}
 
-	//if (balance_cpu == -1)
-	//	balance_cpu = group_balance_cpu(sg);
+	if (balance_cpu == -1)
+		balance_cpu = group_balance_cpu(sg);
 
 	/*
 	 * First idle CPU or the first CPU(busiest) in this sched group
@@ -7,6 +7,10 @@
  */
 #include "sched.h"
 
+#include <linux/cpu.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+
 /* Linker adds these: start and end of __cpuidle functions */
 extern char __cpuidle_text_start[], __cpuidle_text_end[];
 
@@ -16,6 +20,58 @@ bool cpu_in_idle(unsigned long pc)
 		pc < (unsigned long)__cpuidle_text_end;
 }
 
+void __weak arch_cpu_idle(void)
+{
+	local_irq_enable();
+}
+
+/*
+ * Generic idle loop implementation
+ *
+ * Called with polling cleared.
+ */
+static void do_idle(void)
+{
+	/*
+	 * If the arch has a polling bit, we maintain an invariant:
+	 *
+	 * Our polling bit is clear if we're not scheduled (i.e. if rq->curr !=
+	 * rq->idle). This means that, if rq->idle has the polling bit set,
+	 * then setting need_resched is guaranteed to cause the CPU to
+	 * reschedule.
+	 */
+	__current_set_polling();
+
+	while (!need_resched()) {
+		rmb();
+
+		/*
+		 * Spend otherwise idle cycles printing the log buffer and
+		 * zeroing pages for __GFP_ZERO allocations; only go to
+		 * sleep once there is nothing left to do.
+		 */
+		if (printk_flush_idle() || zero_pool_refill())
+			continue;
+
+		local_irq_disable();
+		if (need_resched()) {
+			local_irq_enable();
+			break;
+		}
+		arch_cpu_idle();
+	}
+
+	__current_clr_polling();
+
+	schedule_idle();
+}
+
+void cpu_startup_entry(enum cpuhp_state state)
+{
+	while (1)
+		do_idle();
+}
+
 /*
  * It is not legal to sleep in the idle task - print a warning
  * message if some code attempts to do it:
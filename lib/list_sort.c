@@ -145,6 +145,7 @@ void list_sort(void *priv, struct list_head *head,
 
 #ifdef CONFIG_TEST_LIST_SORT
 
+#include <linux/module.h>
 #include <linux/random.h>
 
 /*
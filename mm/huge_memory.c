@@ -0,0 +1,617 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * mm/huge_memory.c
+ *
+ * Transparent huge pages for private anonymous memory.
+ *
+ * A write fault on an empty pmd whose naturally aligned 2MB range lies
+ * entirely inside the VMA is served with a single PMD block mapping of a
+ * compound order-9 page. If that allocation fails the fault falls back
+ * to the regular 4K path. Read faults keep using the zero page at pte
+ * level so that sparse readers don't pin 2MB each.
+ *
+ * Ranges that ended up populated with 4K pages anyway (read first, huge
+ * allocation failure, or a VMA that only later became eligible) are
+ * merged into huge pages by khugepaged: every mm that faulted on a
+ * suitable VMA is put on a scan list, and ranges whose 512 ptes all map
+ * private pages are copied into a fresh huge page that replaces the pte
+ * table. The khugepaged thread scans a bounded number of pages per
+ * wakeup and sleeps khugepaged_scan_sleep_millisecs in between; it never
+ * reclaims and never holds a spinlock across the copy.
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/err.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/sched/task.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#include <asm/pgalloc.h>
+#include <asm/tlbflush.h>
+
+bool transparent_hugepage_enabled __read_mostly = true;
+
+static int __init setup_transparent_hugepage(char *str)
+{
+	if (!str)
+		return -EINVAL;
+
+	if (!strcmp(str, "always"))
+		transparent_hugepage_enabled = true;
+	else if (!strcmp(str, "never"))
+		transparent_hugepage_enabled = false;
+	else
+		pr_warn("transparent_hugepage= cannot parse, ignored\n");
+
+	return 0;
+}
+early_param("transparent_hugepage", setup_transparent_hugepage);
+
+static DEFINE_PER_CPU(unsigned long, thp_stats[NR_THP_STATS]);
+
+static const char * const thp_stat_names[NR_THP_STATS] = {
+	[THP_FAULT_ALLOC]		= "thp_fault_alloc",
+	[THP_FAULT_FALLBACK]		= "thp_fault_fallback",
+	[THP_COLLAPSE_ALLOC]		= "thp_collapse_alloc",
+	[THP_COLLAPSE_ALLOC_FAILED]	= "thp_collapse_alloc_failed",
+	[THP_SCAN_FULL]			= "thp_khugepaged_full_scans",
+};
+
+static inline void count_thp_event(enum thp_stat_item item)
+{
+	this_cpu_inc(thp_stats[item]);
+}
+
+void show_thp_stats(void)
+{
+	unsigned long sum;
+	int cpu, item;
+
+	for (item = 0; item < NR_THP_STATS; item++) {
+		sum = 0;
+		for_each_possible_cpu(cpu)
+			sum += per_cpu(thp_stats[item], cpu);
+		pr_info("%-26s %lu\n", thp_stat_names[item], sum);
+	}
+}
+
+static inline pmd_t mk_huge_pmd(struct page *page, pgprot_t prot)
+{
+	return pmd_mkhuge(mk_pmd(page, prot));
+}
+
+static inline pmd_t maybe_pmd_mkwrite(pmd_t pmd, struct vm_area_struct *vma)
+{
+	if (likely(vma->vm_flags & VM_WRITE))
+		pmd = pmd_mkwrite(pmd_mkdirty(pmd));
+	return pmd;
+}
+
+/*
+ * We enter with the pmd empty, the page table lock is not held.
+ * Returns VM_FAULT_FALLBACK whenever the fault should be retried at
+ * pte level.
+ */
+vm_fault_t do_huge_pmd_anonymous_page(struct vm_fault *vmf)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long haddr = vmf->address & HPAGE_PMD_MASK;
+	struct page *page;
+	pmd_t entry;
+
+	if (!transhuge_vma_suitable(vma, vmf->address))
+		return VM_FAULT_FALLBACK;
+
+	khugepaged_enter(vma);
+
+	/* Reads are served by the zero page at pte level */
+	if (!(vmf->flags & FAULT_FLAG_WRITE))
+		return VM_FAULT_FALLBACK;
+
+	page = alloc_pages(GFP_TRANSHUGE_LIGHT | __GFP_NORETRY | __GFP_ZERO,
+			   HPAGE_PMD_ORDER);
+	if (unlikely(!page)) {
+		count_thp_event(THP_FAULT_FALLBACK);
+		return VM_FAULT_FALLBACK;
+	}
+
+	entry = maybe_pmd_mkwrite(mk_huge_pmd(page, vma->vm_page_prot), vma);
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_none(*vmf->pmd))) {
+		/*
+		 * Raced with another fault: if it installed a huge page we
+		 * are done, if it installed a pte table continue there.
+		 */
+		bool huge = pmd_trans_huge(*vmf->pmd);
+
+		spin_unlock(&mm->page_table_lock);
+		__free_pages(page, HPAGE_PMD_ORDER);
+		return huge ? 0 : VM_FAULT_FALLBACK;
+	}
+	set_pmd_at(mm, haddr, vmf->pmd, entry);
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache_pmd(vma, vmf->address, vmf->pmd);
+	spin_unlock(&mm->page_table_lock);
+
+	count_thp_event(THP_FAULT_ALLOC);
+	return 0;
+}
+
+/*
+ * Access flag or dirty bit fault on a present huge pmd. Huge pmds are
+ * only ever installed writable in writable VMAs, so there is nothing to
+ * copy on write.
+ */
+void huge_pmd_set_accessed(struct vm_fault *vmf, pmd_t orig_pmd)
+{
+	struct mm_struct *mm = vmf->vma->vm_mm;
+	unsigned long haddr = vmf->address & HPAGE_PMD_MASK;
+	bool write = vmf->flags & FAULT_FLAG_WRITE;
+	pmd_t entry;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(pmd_val(*vmf->pmd) != pmd_val(orig_pmd)))
+		goto unlock;
+
+	entry = pmd_mkyoung(orig_pmd);
+	if (write)
+		entry = pmd_mkdirty(entry);
+	if (pmdp_set_access_flags(vmf->vma, haddr, vmf->pmd, entry, write))
+		update_mmu_cache_pmd(vmf->vma, vmf->address, vmf->pmd);
+unlock:
+	spin_unlock(&mm->page_table_lock);
+}
+
+/*
+ * khugepaged
+ */
+
+/* Number of 4K pages to look at per khugepaged wakeup */
+static unsigned int khugepaged_pages_to_scan __read_mostly = HPAGE_PMD_NR * 8;
+/* Sleep between two wakeups */
+static unsigned int khugepaged_scan_sleep_millisecs __read_mostly = 10000;
+
+static struct task_struct *khugepaged_thread __read_mostly;
+
+struct mm_slot {
+	struct list_head mm_node;
+	struct mm_struct *mm;
+};
+
+/*
+ * struct khugepaged_scan - cursor for scanning
+ * @mm_head: the head of the mm list to scan
+ * @mm_slot: the current mm_slot we are scanning
+ * @address: the next address inside that to be scanned
+ * @pinned: the mm_slot being scanned with khugepaged_mm_lock dropped
+ *
+ * There is only the one khugepaged_scan instance of this cursor
+ * structure, protected by khugepaged_mm_lock.
+ */
+struct khugepaged_scan {
+	struct list_head mm_head;
+	struct mm_slot *mm_slot;
+	unsigned long address;
+	struct mm_slot *pinned;
+};
+
+static DEFINE_SPINLOCK(khugepaged_mm_lock);
+
+static struct khugepaged_scan khugepaged_scan_state = {
+	.mm_head = LIST_HEAD_INIT(khugepaged_scan_state.mm_head),
+};
+
+/*
+ * Put @vma's mm on the scan list. Called from the fault path, once per
+ * mm: the MMF_VM_HUGEPAGE bit keeps the common case lockless.
+ */
+void khugepaged_enter(struct vm_area_struct *vma)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct mm_slot *mm_slot;
+	bool wakeup;
+
+	if (test_bit(MMF_VM_HUGEPAGE, &mm->flags))
+		return;
+
+	mm_slot = kzalloc(sizeof(*mm_slot), GFP_KERNEL);
+	if (!mm_slot)
+		return;
+	mm_slot->mm = mm;
+
+	spin_lock(&khugepaged_mm_lock);
+	if (test_and_set_bit(MMF_VM_HUGEPAGE, &mm->flags)) {
+		spin_unlock(&khugepaged_mm_lock);
+		kfree(mm_slot);
+		return;
+	}
+	/* khugepaged sleeps without a timeout while the list is empty */
+	wakeup = list_empty(&khugepaged_scan_state.mm_head);
+	list_add_tail(&mm_slot->mm_node, &khugepaged_scan_state.mm_head);
+	spin_unlock(&khugepaged_mm_lock);
+
+	if (wakeup && khugepaged_thread)
+		wake_up_process(khugepaged_thread);
+}
+
+static struct mm_slot *get_mm_slot(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+
+	list_for_each_entry(mm_slot, &khugepaged_scan_state.mm_head, mm_node)
+		if (mm_slot->mm == mm)
+			return mm_slot;
+
+	return NULL;
+}
+
+static struct mm_slot *next_mm_slot(struct mm_slot *mm_slot)
+{
+	if (list_is_last(&mm_slot->mm_node, &khugepaged_scan_state.mm_head))
+		return NULL;
+	return list_next_entry(mm_slot, mm_node);
+}
+
+/*
+ * Take @mm off the scan list. Must be called before the mm's page
+ * tables are torn down.
+ */
+void khugepaged_exit(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+
+	if (!test_bit(MMF_VM_HUGEPAGE, &mm->flags))
+		return;
+
+	spin_lock(&khugepaged_mm_lock);
+	mm_slot = get_mm_slot(mm);
+	/* Let a collapse in progress on this mm finish */
+	while (mm_slot && khugepaged_scan_state.pinned == mm_slot) {
+		spin_unlock(&khugepaged_mm_lock);
+		cpu_relax();
+		spin_lock(&khugepaged_mm_lock);
+	}
+	if (mm_slot) {
+		if (khugepaged_scan_state.mm_slot == mm_slot) {
+			khugepaged_scan_state.mm_slot = next_mm_slot(mm_slot);
+			khugepaged_scan_state.address = 0;
+		}
+		list_del(&mm_slot->mm_node);
+		clear_bit(MMF_VM_HUGEPAGE, &mm->flags);
+	}
+	spin_unlock(&khugepaged_mm_lock);
+
+	kfree(mm_slot);
+}
+
+static pmd_t *mm_find_pmd(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+
+	return pmd_offset(pud, address);
+}
+
+/* Do all ptes of the table map private (non zero-page) memory? */
+static bool khugepaged_range_populated(pte_t *pte)
+{
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		pte_t pteval = READ_ONCE(pte[i]);
+
+		if (!pte_present(pteval) || pte_special(pteval))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Write-protect the 512 ptes under @pmd so that their pages can be
+ * copied without the page table lock. Returns false, with nothing
+ * changed, if the range is no longer fully populated.
+ */
+static bool khugepaged_wrprotect_range(struct mm_struct *mm,
+		struct vm_area_struct *vma, pmd_t *pmd, unsigned long haddr,
+		pte_t *orig)
+{
+	pte_t *pte;
+	int i;
+
+	spin_lock(&mm->page_table_lock);
+	if (pmd_none(*pmd) || pmd_trans_huge(*pmd)) {
+		spin_unlock(&mm->page_table_lock);
+		return false;
+	}
+
+	pte = pte_offset_map(pmd, haddr);
+	if (!khugepaged_range_populated(pte)) {
+		pte_unmap(pte);
+		spin_unlock(&mm->page_table_lock);
+		return false;
+	}
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		ptep_set_wrprotect(mm, haddr + i * PAGE_SIZE, pte + i);
+		orig[i] = READ_ONCE(pte[i]);
+	}
+	pte_unmap(pte);
+	flush_tlb_range(vma, haddr, haddr + HPAGE_PMD_SIZE);
+	spin_unlock(&mm->page_table_lock);
+
+	return true;
+}
+
+/* A write fault on a write-protected pte makes it writable again */
+static bool khugepaged_range_unchanged(pte_t *pte, pte_t *orig)
+{
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		pte_t pteval = READ_ONCE(pte[i]);
+
+		if (!pte_present(pteval) || pte_write(pteval) ||
+		    pte_pfn(pteval) != pte_pfn(orig[i]))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Replace the pte table under @pmd with a huge page holding a copy of
+ * its 512 small pages.
+ *
+ * The huge page is allocated without reclaim before any lock is taken.
+ * The ptes are then write-protected and the copy is done unlocked: any
+ * write meanwhile goes through do_wp_page(), which makes its pte
+ * writable again, and the collapse is abandoned when the ptes are
+ * rechecked under the page table lock. That lock is only held again to
+ * swap the pte table for the huge pmd.
+ */
+static void collapse_huge_page(struct mm_struct *mm,
+		struct vm_area_struct *vma, pmd_t *pmd, unsigned long haddr)
+{
+	/* Only the khugepaged thread collapses */
+	static pte_t orig[HPAGE_PMD_NR];
+	struct page *new_page;
+	pgtable_t pgtable;
+	pmd_t _pmd;
+	pte_t *pte;
+	int i;
+
+	new_page = alloc_pages(GFP_TRANSHUGE_LIGHT | __GFP_NORETRY,
+			       HPAGE_PMD_ORDER);
+	if (unlikely(!new_page)) {
+		count_thp_event(THP_COLLAPSE_ALLOC_FAILED);
+		return;
+	}
+
+	if (!khugepaged_wrprotect_range(mm, vma, pmd, haddr, orig))
+		goto out_free;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		copy_page(page_address(new_page + i),
+			  page_address(pte_page(orig[i])));
+
+	spin_lock(&mm->page_table_lock);
+	_pmd = *pmd;
+	if (pmd_none(_pmd) || pmd_trans_huge(_pmd))
+		goto out_unlock;
+
+	pte = pte_offset_map(pmd, haddr);
+	if (!khugepaged_range_unchanged(pte, orig)) {
+		pte_unmap(pte);
+		goto out_unlock;
+	}
+
+	/*
+	 * Break-before-make: unhook the pte table and flush the old
+	 * translations before the block mapping becomes visible.
+	 */
+	pmd_clear(pmd);
+	flush_tlb_range(vma, haddr, haddr + HPAGE_PMD_SIZE);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		pte_clear(mm, haddr + i * PAGE_SIZE, pte + i);
+	pte_unmap(pte);
+	pgtable = pmd_pgtable(_pmd);
+
+	_pmd = maybe_pmd_mkwrite(mk_huge_pmd(new_page, vma->vm_page_prot), vma);
+	/* Make the copied data visible before the mapping */
+	smp_wmb();
+	set_pmd_at(mm, haddr, pmd, _pmd);
+	update_mmu_cache_pmd(vma, haddr, pmd);
+	spin_unlock(&mm->page_table_lock);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		__free_page(pte_page(orig[i]));
+	pte_free(mm, pgtable);
+	count_thp_event(THP_COLLAPSE_ALLOC);
+	return;
+
+out_unlock:
+	spin_unlock(&mm->page_table_lock);
+out_free:
+	__free_pages(new_page, HPAGE_PMD_ORDER);
+}
+
+static void khugepaged_scan_pmd(struct mm_struct *mm,
+		struct vm_area_struct *vma, unsigned long haddr)
+{
+	pmd_t *pmd, pmdval;
+	pte_t *pte;
+	bool populated;
+
+	pmd = mm_find_pmd(mm, haddr);
+	if (!pmd)
+		return;
+
+	pmdval = READ_ONCE(*pmd);
+	if (pmd_none(pmdval) || pmd_trans_huge(pmdval))
+		return;
+
+	/* Unlocked peek, collapse_huge_page() checks again under the lock */
+	pte = pte_offset_map(pmd, haddr);
+	populated = khugepaged_range_populated(pte);
+	pte_unmap(pte);
+
+	if (populated)
+		collapse_huge_page(mm, vma, pmd, haddr);
+}
+
+/*
+ * Scan up to @pages small pages of @mm_slot's mm from *@address on.
+ * Runs without khugepaged_mm_lock, the slot being pinned. VMAs are
+ * never unlinked yet, so walking the VMA list needs no lock either.
+ * Sets *@address to 0 once the whole mm has been scanned.
+ */
+static unsigned int khugepaged_scan_mm_slot(struct mm_slot *mm_slot,
+		unsigned long *address, unsigned int pages)
+{
+	struct mm_struct *mm = mm_slot->mm;
+	struct vm_area_struct *vma;
+	unsigned int progress = 0;
+
+	for (vma = find_vma(mm, *address); vma; vma = vma->vm_next) {
+		unsigned long hstart, hend;
+
+		hstart = ALIGN(vma->vm_start, HPAGE_PMD_SIZE);
+		hend = vma->vm_end & HPAGE_PMD_MASK;
+		if (!transhuge_vma_suitable(vma, hstart) || hstart >= hend) {
+			progress++;
+			continue;
+		}
+
+		if (*address < hstart)
+			*address = hstart;
+
+		while (*address < hend) {
+			khugepaged_scan_pmd(mm, vma, *address);
+			*address += HPAGE_PMD_SIZE;
+			progress += HPAGE_PMD_NR;
+			if (progress >= pages || need_resched())
+				return progress;
+		}
+	}
+
+	*address = 0;
+	return progress;
+}
+
+/*
+ * Scan up to khugepaged_pages_to_scan pages, resuming where the last
+ * call stopped.
+ */
+static void khugepaged_do_scan(void)
+{
+	unsigned int progress = 0, pages = khugepaged_pages_to_scan;
+	struct mm_slot *mm_slot;
+	unsigned long address;
+
+	spin_lock(&khugepaged_mm_lock);
+	if (!khugepaged_scan_state.mm_slot) {
+		if (list_empty(&khugepaged_scan_state.mm_head)) {
+			spin_unlock(&khugepaged_mm_lock);
+			return;
+		}
+		khugepaged_scan_state.mm_slot = list_first_entry(
+				&khugepaged_scan_state.mm_head,
+				struct mm_slot, mm_node);
+		khugepaged_scan_state.address = 0;
+	}
+
+	while (progress < pages && (mm_slot = khugepaged_scan_state.mm_slot)) {
+		/* khugepaged_exit() waits for the slot to be unpinned */
+		khugepaged_scan_state.pinned = mm_slot;
+		address = khugepaged_scan_state.address;
+		spin_unlock(&khugepaged_mm_lock);
+
+		progress += khugepaged_scan_mm_slot(mm_slot, &address,
+						    pages - progress);
+
+		spin_lock(&khugepaged_mm_lock);
+		khugepaged_scan_state.pinned = NULL;
+		khugepaged_scan_state.address = address;
+		if (address) {
+			/* Only yield with no slot pinned, see khugepaged_exit() */
+			if (need_resched()) {
+				spin_unlock(&khugepaged_mm_lock);
+				schedule();
+				spin_lock(&khugepaged_mm_lock);
+			}
+			continue;
+		}
+
+		/* Done with this mm, move on to the next one */
+		khugepaged_scan_state.mm_slot = next_mm_slot(mm_slot);
+		if (!khugepaged_scan_state.mm_slot)
+			count_thp_event(THP_SCAN_FULL);
+	}
+	spin_unlock(&khugepaged_mm_lock);
+}
+
+/*
+ * Sleep for the scan interval, or until khugepaged_enter() adds the
+ * first mm when there is nothing to scan.
+ */
+static void khugepaged_wait_work(void)
+{
+	ktime_t timeout = ms_to_ktime(khugepaged_scan_sleep_millisecs);
+
+	set_current_state(TASK_INTERRUPTIBLE);
+	if (kthread_should_stop()) {
+		__set_current_state(TASK_RUNNING);
+		return;
+	}
+
+	if (list_empty(&khugepaged_scan_state.mm_head))
+		schedule();
+	else
+		schedule_hrtimeout(&timeout, HRTIMER_MODE_REL);
+	__set_current_state(TASK_RUNNING);
+}
+
+static int khugepaged(void *none)
+{
+	while (!kthread_should_stop()) {
+		khugepaged_do_scan();
+		khugepaged_wait_work();
+	}
+
+	return 0;
+}
+
+static int __init khugepaged_init(void)
+{
+	struct task_struct *k;
+
+	if (!transparent_hugepage_enabled)
+		return 0;
+
+	k = kthread_run(khugepaged, NULL, "khugepaged");
+	if (IS_ERR(k)) {
+		pr_err("khugepaged: failed to start: %ld\n", PTR_ERR(k));
+		return PTR_ERR(k);
+	}
+	khugepaged_thread = k;
+
+	return 0;
+}
+subsys_initcall(khugepaged_init);
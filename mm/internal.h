@@ -71,4 +71,8 @@ struct alloc_context {
 	enum zone_type high_zoneidx;
 };
 
+/* mm/zero_pool.c */
+extern struct page *zero_pool_get(int nid, gfp_t gfp_mask);
+extern unsigned long zero_pool_drain(int nid);
+
 #endif	/* __MM_INTERNAL_H */
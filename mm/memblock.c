@@ -78,18 +78,45 @@ static unsigned long __init_memblock memblock_addrs_overlap(phys_addr_t base1,
 	return ((base1 < (base2 + size2)) && (base2 < (base1 + size1)));
 }
 
+/**
+ * memblock_lower_bound - find the first region ending above an address
+ * @type: memblock type to search
+ * @addr: address to look up
+ *
+ * The regions of @type are sorted and don't overlap, so both their bases
+ * and their ends are increasing and the first region that could contain
+ * or follow @addr can be found by bisection instead of by walking the
+ * array from the start.
+ *
+ * Return:
+ * index of the first region whose end is above @addr, @type->cnt if
+ * there is none.
+ */
+static int __init_memblock memblock_lower_bound(struct memblock_type *type,
+						phys_addr_t addr)
+{
+	unsigned int left = 0, right = type->cnt;
+
+	while (left < right) {
+		unsigned int mid = (right + left) / 2;
+
+		if (type->regions[mid].base + type->regions[mid].size <= addr)
+			left = mid + 1;
+		else
+			right = mid;
+	}
+	return left;
+}
+
 bool __init_memblock memblock_overlaps_region(struct memblock_type *type,
 					      phys_addr_t base,
 					      phys_addr_t size)
 {
-	unsigned long i;
+	unsigned long i = memblock_lower_bound(type, base);
 
-	for (i = 0; i < type->cnt; i++)
-		if (memblock_addrs_overlap(base, size, type->regions[i].base,
-					   type->regions[i].size))
-			break;
-
-	return i < type->cnt;
+	return i < type->cnt &&
+	       memblock_addrs_overlap(base, size, type->regions[i].base,
+				      type->regions[i].size);
 }
 
 static void __init_memblock memblock_insert_region(struct memblock_type *type,
@@ -112,15 +139,23 @@ static void __init_memblock memblock_insert_region(struct memblock_type *type,
 /**
  * memblock_merge_regions - merge neighboring compatible regions
  * @type: memblock type to scan
+ * @start_rgn: first region that was changed
+ * @end_rgn: one past the last region that was changed
  *
- * Scan @type and merge neighboring compatible regions.
+ * Scan [@start_rgn - 1, @end_rgn] of @type and merge neighboring
+ * compatible regions. Everything outside was minimal already.
  */
-static void __init_memblock memblock_merge_regions(struct memblock_type *type)
+static void __init_memblock memblock_merge_regions(struct memblock_type *type,
+						   unsigned long start_rgn,
+						   unsigned long end_rgn)
 {
 	int i = 0;
 
+	if (start_rgn)
+		i = start_rgn - 1;
 	/* cnt never goes below 1 */
-	while (i < type->cnt - 1) {
+	end_rgn = min(end_rgn, type->cnt - 1);
+	while (i < end_rgn) {
 		struct memblock_region *this = &type->regions[i];
 		struct memblock_region *next = &type->regions[i + 1];
 
@@ -137,6 +172,7 @@ static void __init_memblock memblock_merge_regions(struct memblock_type *type)
 		/* move forward from next + 1, index of which is i + 2 */
 		memmove(next, next + 1, (type->cnt - (i + 2)) * sizeof(*next));
 		type->cnt--;
+		end_rgn--;
 	}
 }
 
@@ -222,6 +258,9 @@ void __init_memblock __next_mem_range(u64 *idx, int nid,
 			return;
 		}
 
+		/* skip the areas that end below this region in one go */
+		idx_b = max_t(int, idx_b, memblock_lower_bound(type_b, m_start));
+
 		/* scan areas before each reservation */
 		for (; idx_b < type_b->cnt + 1; idx_b++) {
 			struct memblock_region *r;
@@ -322,6 +361,10 @@ void __init_memblock __next_mem_range_rev(u64 *idx, int nid,
 			return;
 		}
 
+		/* skip the areas that start above this region in one go */
+		idx_b = min_t(int, idx_b,
+			      memblock_lower_bound(type_b, m_end - 1));
+
 		/* scan areas before each reservation */
 		for (; idx_b >= 0; idx_b--) {
 			struct memblock_region *r;
@@ -606,7 +649,7 @@ int __init_memblock memblock_add_range(struct memblock_type *type,
 	bool insert = false;
 	phys_addr_t obase = base;
 	phys_addr_t end = base + memblock_cap_size(base, &size);
-	int idx, nr_new;
+	int idx, nr_new, start_rgn;
 	struct memblock_region *rgn;
 
 	if (!size)
@@ -631,14 +674,18 @@ repeat:
 	base = obase;
 	nr_new = 0;
 
-	for_each_memblock_type (idx, type, rgn) {
-		phys_addr_t rbase = rgn->base;
-		phys_addr_t rend = rbase + rgn->size;
+	/* regions ending at or below @base can't be affected */
+	start_rgn = memblock_lower_bound(type, base);
+
+	for (idx = start_rgn; idx < type->cnt; idx++) {
+		phys_addr_t rbase, rend;
+
+		rgn = &type->regions[idx];
+		rbase = rgn->base;
+		rend = rbase + rgn->size;
 
 		if (rbase >= end)
 			break;
-		if (rend <= base)
-			continue;
 		/*
 		 * @rgn overlaps.  If it separates the lower part of new
 		 * area, insert that portion.
@@ -677,7 +724,7 @@ repeat:
 		insert = true;
 		goto repeat;
 	} else {
-		memblock_merge_regions(type);
+		memblock_merge_regions(type, start_rgn, idx + 1);
 		return 0;
 	}
 }
@@ -752,14 +799,15 @@ static int __init_memblock memblock_isolate_range(struct memblock_type *type,
 		if (memblock_double_array(type, base, size) < 0)
 			return -ENOMEM;
 
-	for_each_memblock_type (idx, type, rgn) {
-		phys_addr_t rbase = rgn->base;
-		phys_addr_t rend = rbase + rgn->size;
+	for (idx = memblock_lower_bound(type, base); idx < type->cnt; idx++) {
+		phys_addr_t rbase, rend;
+
+		rgn = &type->regions[idx];
+		rbase = rgn->base;
+		rend = rbase + rgn->size;
 
 		if (rbase >= end)
 			break;
-		if (rend <= base)
-			continue;
 
 		if (rbase < base) {
 			/*
@@ -885,7 +933,7 @@ static int __init_memblock memblock_setclr_flag(phys_addr_t base,
 		else
 			memblock_clear_region_flags(&type->regions[i], flag);
 
-	memblock_merge_regions(type);
+	memblock_merge_regions(type, start_rgn, end_rgn);
 	return 0;
 }
 
@@ -951,11 +999,104 @@ int __init_memblock memblock_clear_nomap(phys_addr_t base, phys_addr_t size)
 	return memblock_setclr_flag(base, size, 0, MEMBLOCK_NOMAP);
 }
 
+/*
+ * Early allocation trace, enabled with "memblock=trace". Allocations are
+ * accounted to the call site that asked for them, along with the node
+ * they ended up on, and the sites are listed by size when memblock hands
+ * its free memory over to the page allocator.
+ */
+#define MEMBLOCK_TRACE_SITES	64
+
+struct memblock_trace_site {
+	unsigned long caller;
+	unsigned long count;
+	phys_addr_t bytes;
+	unsigned long remote;	/* landed off the requested node */
+	int nid;		/* node of the last allocation */
+};
+
+static int memblock_trace __initdata_memblock;
+static unsigned long memblock_trace_dropped __initdata_memblock;
+static struct memblock_trace_site
+	memblock_trace_sites[MEMBLOCK_TRACE_SITES] __initdata_memblock;
+
+static void __init memblock_trace_alloc(phys_addr_t base, phys_addr_t size,
+					int nid, unsigned long caller)
+{
+	struct memblock_type *type = &memblock.memory;
+	struct memblock_trace_site *site;
+	int i, got = NUMA_NO_NODE;
+
+	if (!memblock_trace || !base)
+		return;
+
+	i = memblock_lower_bound(type, base);
+	if (i < type->cnt && type->regions[i].base <= base)
+		got = memblock_get_region_node(&type->regions[i]);
+
+	for (i = 0; i < MEMBLOCK_TRACE_SITES; i++) {
+		site = &memblock_trace_sites[i];
+		if (!site->caller || site->caller == caller)
+			break;
+	}
+	if (i == MEMBLOCK_TRACE_SITES) {
+		memblock_trace_dropped++;
+		return;
+	}
+
+	site->caller = caller;
+	site->count++;
+	site->bytes += size;
+	site->nid = got;
+	if (nid != NUMA_NO_NODE && nid != got)
+		site->remote++;
+}
+
+static void __init memblock_trace_dump(void)
+{
+	struct memblock_trace_site *site, tmp;
+	phys_addr_t total = 0;
+	int i, j, nr;
+
+	if (!memblock_trace)
+		return;
+
+	for (nr = 0; nr < MEMBLOCK_TRACE_SITES; nr++)
+		if (!memblock_trace_sites[nr].caller)
+			break;
+
+	/* few enough sites that a selection sort by size will do */
+	for (i = 0; i < nr; i++) {
+		for (j = i + 1; j < nr; j++) {
+			if (memblock_trace_sites[j].bytes >
+			    memblock_trace_sites[i].bytes) {
+				tmp = memblock_trace_sites[i];
+				memblock_trace_sites[i] = memblock_trace_sites[j];
+				memblock_trace_sites[j] = tmp;
+			}
+		}
+		total += memblock_trace_sites[i].bytes;
+	}
+
+	pr_info("memblock: early allocations: %pa bytes from %d sites\n",
+		&total, nr);
+	for (i = 0; i < nr; i++) {
+		site = &memblock_trace_sites[i];
+		pr_info("  %pS: %lu allocs, %pa bytes, node %d, %lu off-node\n",
+			(void *)site->caller, site->count, &site->bytes,
+			site->nid, site->remote);
+	}
+	if (memblock_trace_dropped)
+		pr_info("  %lu allocations from further sites not traced\n",
+			memblock_trace_dropped);
+}
+
 static phys_addr_t __init memblock_alloc_range_nid(phys_addr_t size,
 						   phys_addr_t align,
 						   phys_addr_t start,
 						   phys_addr_t end, int nid,
-						   enum memblock_flags flags)
+						   enum memblock_flags flags,
+						   unsigned long caller)
 {
 	phys_addr_t found;
 
@@ -972,6 +1113,7 @@ static phys_addr_t __init memblock_alloc_range_nid(phys_addr_t size,
 		 * The min_count is set to 0 so that memblock allocations are
 		 * never reported as leaks.
 		 */
+		memblock_trace_alloc(found, size, nid, caller);
 		return found;
 	}
 	return 0;
@@ -982,25 +1124,33 @@ phys_addr_t __init memblock_alloc_range(phys_addr_t size, phys_addr_t align,
 					enum memblock_flags flags)
 {
 	return memblock_alloc_range_nid(size, align, start, end, NUMA_NO_NODE,
-					flags);
+					flags, _RET_IP_);
 }
 
 phys_addr_t __init memblock_alloc_base_nid(phys_addr_t size, phys_addr_t align,
 					   phys_addr_t max_addr, int nid,
 					   enum memblock_flags flags)
 {
-	return memblock_alloc_range_nid(size, align, 0, max_addr, nid, flags);
+	return memblock_alloc_range_nid(size, align, 0, max_addr, nid, flags,
+					_RET_IP_);
 }
 
-phys_addr_t __init memblock_phys_alloc_nid(phys_addr_t size, phys_addr_t align,
-					   int nid)
+/*
+ * The helpers below take the caller of the public function so that the
+ * allocation trace points at whoever asked for the memory rather than at
+ * the wrapper in between.
+ */
+static phys_addr_t __init __memblock_phys_alloc_nid(phys_addr_t size,
+						    phys_addr_t align, int nid,
+						    unsigned long caller)
 {
 	enum memblock_flags flags = choose_memblock_flags();
 	phys_addr_t ret;
 
 again:
-	ret = memblock_alloc_base_nid(size, align, MEMBLOCK_ALLOC_ACCESSIBLE,
-				      nid, flags);
+	ret = memblock_alloc_range_nid(size, align, 0,
+				       MEMBLOCK_ALLOC_ACCESSIBLE, nid, flags,
+				       caller);
 
 	if (!ret && (flags & MEMBLOCK_MIRROR)) {
 		flags &= ~MEMBLOCK_MIRROR;
@@ -1009,19 +1159,15 @@ again:
 	return ret;
 }
 
-phys_addr_t __init __memblock_alloc_base(phys_addr_t size, phys_addr_t align,
-					 phys_addr_t max_addr)
-{
-	return memblock_alloc_base_nid(size, align, max_addr, NUMA_NO_NODE,
-				       MEMBLOCK_NONE);
-}
-
-phys_addr_t __init memblock_alloc_base(phys_addr_t size, phys_addr_t align,
-				       phys_addr_t max_addr)
+static phys_addr_t __init __memblock_alloc_base_panic(phys_addr_t size,
+						      phys_addr_t align,
+						      phys_addr_t max_addr,
+						      unsigned long caller)
 {
 	phys_addr_t alloc;
 
-	alloc = __memblock_alloc_base(size, align, max_addr);
+	alloc = memblock_alloc_range_nid(size, align, 0, max_addr,
+					 NUMA_NO_NODE, MEMBLOCK_NONE, caller);
 
 	if (alloc == 0)
 		panic("ERROR: Failed to allocate %pa bytes below %pa.\n", &size,
@@ -1030,19 +1176,40 @@ phys_addr_t __init memblock_alloc_base(phys_addr_t size, phys_addr_t align,
 	return alloc;
 }
 
+phys_addr_t __init memblock_phys_alloc_nid(phys_addr_t size, phys_addr_t align,
+					   int nid)
+{
+	return __memblock_phys_alloc_nid(size, align, nid, _RET_IP_);
+}
+
+phys_addr_t __init __memblock_alloc_base(phys_addr_t size, phys_addr_t align,
+					 phys_addr_t max_addr)
+{
+	return memblock_alloc_range_nid(size, align, 0, max_addr, NUMA_NO_NODE,
+					MEMBLOCK_NONE, _RET_IP_);
+}
+
+phys_addr_t __init memblock_alloc_base(phys_addr_t size, phys_addr_t align,
+				       phys_addr_t max_addr)
+{
+	return __memblock_alloc_base_panic(size, align, max_addr, _RET_IP_);
+}
+
 phys_addr_t __init memblock_phys_alloc(phys_addr_t size, phys_addr_t align)
 {
-	return memblock_alloc_base(size, align, MEMBLOCK_ALLOC_ACCESSIBLE);
+	return __memblock_alloc_base_panic(size, align,
+					   MEMBLOCK_ALLOC_ACCESSIBLE, _RET_IP_);
 }
 
 phys_addr_t __init memblock_phys_alloc_try_nid(phys_addr_t size,
 					       phys_addr_t align, int nid)
 {
-	phys_addr_t res = memblock_phys_alloc_nid(size, align, nid);
+	phys_addr_t res = __memblock_phys_alloc_nid(size, align, nid, _RET_IP_);
 
 	if (res)
 		return res;
-	return memblock_alloc_base(size, align, MEMBLOCK_ALLOC_ACCESSIBLE);
+	return __memblock_alloc_base_panic(size, align,
+					   MEMBLOCK_ALLOC_ACCESSIBLE, _RET_IP_);
 }
 
 /**
@@ -1052,6 +1219,7 @@ phys_addr_t __init memblock_phys_alloc_try_nid(phys_addr_t size,
  * @min_addr: the lower bound of the memory region to allocate (phys address)
  * @max_addr: the upper bound of the memory region to allocate (phys address)
  * @nid: nid of the free area to find, %NUMA_NO_NODE for any node
+ * @caller: caller of the public allocation function, for the trace
  *
  * The @min_addr limit is dropped if it can not be satisfied and the allocation
  * will fall back to memory below @min_addr. Also, allocation may fall back
@@ -1072,7 +1240,8 @@ phys_addr_t __init memblock_phys_alloc_try_nid(phys_addr_t size,
  */
 static void *__init memblock_alloc_internal(phys_addr_t size, phys_addr_t align,
 					    phys_addr_t min_addr,
-					    phys_addr_t max_addr, int nid)
+					    phys_addr_t max_addr, int nid,
+					    unsigned long caller)
 {
 	phys_addr_t alloc;
 	void *ptr;
@@ -1117,6 +1286,7 @@ again:
 
 	return NULL;
 done:
+	memblock_trace_alloc(alloc, size, nid, caller);
 	ptr = phys_to_virt(alloc);
 
 	return ptr;
@@ -1150,7 +1320,8 @@ void *__init memblock_alloc_try_nid_nopanic(phys_addr_t size, phys_addr_t align,
 		__func__, (u64)size, (u64)align, nid, &min_addr, &max_addr,
 		(void *)_RET_IP_);
 
-	ptr = memblock_alloc_internal(size, align, min_addr, max_addr, nid);
+	ptr = memblock_alloc_internal(size, align, min_addr, max_addr, nid,
+				      _RET_IP_);
 	if (ptr)
 		memset(ptr, 0, size);
 	return ptr;
@@ -1184,7 +1355,8 @@ void *__init memblock_alloc_try_nid(phys_addr_t size, phys_addr_t align,
 		"%s: %llu bytes align=0x%llx nid=%d from=%pa max_addr=%pa %pF\n",
 		__func__, (u64)size, (u64)align, nid, &min_addr, &max_addr,
 		(void *)_RET_IP_);
-	ptr = memblock_alloc_internal(size, align, min_addr, max_addr, nid);
+	ptr = memblock_alloc_internal(size, align, min_addr, max_addr, nid,
+				      _RET_IP_);
 	if (ptr) {
 		memset(ptr, 0, size);
 		return ptr;
@@ -1382,7 +1554,7 @@ int __init_memblock memblock_set_node(phys_addr_t base, phys_addr_t size,
 	for (i = start_rgn; i < end_rgn; i++)
 		memblock_set_region_node(&type->regions[i], nid);
 
-	memblock_merge_regions(type);
+	memblock_merge_regions(type, start_rgn, end_rgn);
 	return 0;
 }
 
@@ -1539,6 +1711,8 @@ static int __init early_memblock(char *p)
 {
 	if (p && strstr(p, "debug"))
 		memblock_debug = 1;
+	if (p && strstr(p, "trace"))
+		memblock_trace = 1;
 	return 0;
 }
 early_param("memblock", early_memblock);
@@ -1654,6 +1828,8 @@ unsigned long __init memblock_free_all(void)
 
 	reset_all_zones_managed_pages();
 
+	memblock_trace_dump();
+
 	pages = free_low_memory_core_early();
 	totalram_pages_add(pages);
 
@@ -3,4 +3,754 @@
  *
  *  Copyright (C) 1991, 1992, 1993, 1994  Linus Torvalds
  */
+
+/*
+ * demand-loading started 01.12.91 - seems it is high on the list of
+ * things wanted, and it should be easy to implement. - Linus
+ */
+
+/*
+ * Only private anonymous memory is handled here: a missing pte is
+ * populated with the shared zero page on a read fault and with a fresh
+ * zeroed page on a write fault. Writes to the zero page are broken by
+ * do_wp_page(). To cut the number of faults taken by sequential
+ * readers, a read fault also maps the zero page into the still empty ptes
+ * of a naturally aligned window of fault_around_bytes around the faulting
+ * address (see do_fault_around()).
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
 #include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/preempt.h>
+#include <linux/sched/clock.h>
+
+#include <asm/pgalloc.h>
+#include <asm/tlbflush.h>
+
+#define FAULT_AROUND_MAX_PAGES	16
+
+unsigned long fault_around_bytes __read_mostly =
+	FAULT_AROUND_MAX_PAGES << PAGE_SHIFT;
+
+static int __init fault_around_bytes_setup(char *str)
+{
+	unsigned long val;
+
+	if (!str)
+		return -EINVAL;
+
+	val = memparse(str, &str);
+	/* The window must be a power of two and never cross a pmd */
+	val = clamp_t(unsigned long, val, PAGE_SIZE,
+		      FAULT_AROUND_MAX_PAGES << PAGE_SHIFT);
+	fault_around_bytes = rounddown_pow_of_two(val);
+
+	return 0;
+}
+early_param("fault_around_bytes", fault_around_bytes_setup);
+
+struct mm_fault_stat {
+	unsigned long count;
+	unsigned long total_ns;
+	unsigned long max_ns;
+};
+
+static DEFINE_PER_CPU(struct mm_fault_stat, mm_fault_stats[NR_MM_FAULT_TYPES]);
+static DEFINE_PER_CPU(unsigned long, fault_around_pages);
+
+static const char * const mm_fault_type_names[NR_MM_FAULT_TYPES] = {
+	[MM_FAULT_READ]		= "read",
+	[MM_FAULT_WRITE]	= "write",
+	[MM_FAULT_PERM]		= "permission",
+};
+
+static void mm_fault_account(enum mm_fault_type type, u64 delta)
+{
+	struct mm_fault_stat *stat;
+
+	preempt_disable();
+	stat = this_cpu_ptr(&mm_fault_stats[type]);
+	stat->count++;
+	stat->total_ns += delta;
+	if (delta > stat->max_ns)
+		stat->max_ns = delta;
+	preempt_enable();
+}
+
+void show_mm_fault_stats(void)
+{
+	unsigned long count, total, max, around = 0;
+	int cpu, type;
+
+	for (type = 0; type < NR_MM_FAULT_TYPES; type++) {
+		count = total = max = 0;
+		for_each_possible_cpu(cpu) {
+			struct mm_fault_stat *stat;
+
+			stat = per_cpu_ptr(&mm_fault_stats[type], cpu);
+			count += stat->count;
+			total += stat->total_ns;
+			max = max(max, stat->max_ns);
+		}
+		pr_info("%-10s faults: %8lu avg: %6lu ns max: %8lu ns\n",
+			mm_fault_type_names[type], count,
+			count ? total / count : 0, max);
+	}
+
+	for_each_possible_cpu(cpu)
+		around += per_cpu(fault_around_pages, cpu);
+	pr_info("fault-around: %lu extra ptes populated (window %lu pages)\n",
+		around, fault_around_bytes >> PAGE_SHIFT);
+}
+
+void reset_mm_fault_stats(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		memset(per_cpu_ptr(&mm_fault_stats, cpu), 0,
+		       sizeof(mm_fault_stats));
+		per_cpu(fault_around_pages, cpu) = 0;
+	}
+}
+
+static inline unsigned long my_zero_pfn(unsigned long addr)
+{
+	return page_to_pfn(ZERO_PAGE(addr));
+}
+
+static inline struct page *alloc_zeroed_user_page(struct vm_area_struct *vma,
+						  unsigned long vaddr)
+{
+	return alloc_page(GFP_USER | __GFP_ZERO);
+}
+
+/*
+ * Allocate page upper directory.
+ * We've already handled the fast-path in-line.
+ */
+int __pud_alloc(struct mm_struct *mm, pgd_t *pgd, unsigned long address)
+{
+	pud_t *new = pud_alloc_one(mm, address);
+
+	if (!new)
+		return -ENOMEM;
+
+	smp_wmb(); /* See comment in __pte_alloc */
+
+	spin_lock(&mm->page_table_lock);
+	if (pgd_present(*pgd))		/* Another has populated it */
+		pud_free(mm, new);
+	else
+		pgd_populate(mm, pgd, new);
+	spin_unlock(&mm->page_table_lock);
+	return 0;
+}
+
+/*
+ * Allocate page middle directory.
+ * We've already handled the fast-path in-line.
+ */
+int __pmd_alloc(struct mm_struct *mm, pud_t *pud, unsigned long address)
+{
+	pmd_t *new = pmd_alloc_one(mm, address);
+
+	if (!new)
+		return -ENOMEM;
+
+	smp_wmb(); /* See comment in __pte_alloc */
+
+	spin_lock(&mm->page_table_lock);
+	if (pud_present(*pud))		/* Another has populated it */
+		pmd_free(mm, new);
+	else
+		pud_populate(mm, pud, new);
+	spin_unlock(&mm->page_table_lock);
+	return 0;
+}
+
+static int __pte_alloc(struct mm_struct *mm, pmd_t *pmd)
+{
+	pgtable_t new = pte_alloc_one(mm);
+
+	if (!new)
+		return -ENOMEM;
+
+	/*
+	 * Ensure all pte setup (eg. pte page lock and page clearing) are
+	 * visible before the pte is made visible to other CPUs by being
+	 * put into page tables.
+	 *
+	 * The other side of the story is the pointer chasing in the page
+	 * table walking code (when walking the page table without locking;
+	 * ie. most of the time). Fortunately, these data accesses consist
+	 * of a chain of data-dependent loads, meaning most CPUs (alpha
+	 * being the notable exception) will already guarantee loads are
+	 * seen in-order.
+	 */
+	smp_wmb();
+
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_none(*pmd))) {	/* Has another populated it ? */
+		pmd_populate(mm, pmd, new);
+		new = NULL;
+	}
+	spin_unlock(&mm->page_table_lock);
+	if (new)
+		pte_free(mm, new);
+	return 0;
+}
+
+int __pte_alloc_kernel(pmd_t *pmd)
+{
+	pte_t *new = pte_alloc_one_kernel(&init_mm);
+
+	if (!new)
+		return -ENOMEM;
+
+	smp_wmb(); /* See comment in __pte_alloc */
+
+	spin_lock(&init_mm.page_table_lock);
+	if (likely(pmd_none(*pmd))) {	/* Has another populated it ? */
+		pmd_populate_kernel(&init_mm, pmd, new);
+		new = NULL;
+	}
+	spin_unlock(&init_mm.page_table_lock);
+	if (new)
+		pte_free_kernel(&init_mm, new);
+	return 0;
+}
+
+#define pte_alloc(mm, pmd) (unlikely(pmd_none(*(pmd))) && __pte_alloc(mm, pmd))
+
+/*
+ * Populate the empty ptes of the fault-around window surrounding
+ * vmf->address, which has already been mapped by the caller, with the
+ * shared zero page. Only read faults do this: the zero page already
+ * exists and is mapped read-only, so a sequential reader takes one fault
+ * per window instead of one per page without allocating anything. Write
+ * faults map just the faulting page.
+ *
+ * The window is naturally aligned and at most FAULT_AROUND_MAX_PAGES
+ * long, so it never crosses the pmd covering the faulting address; it
+ * is further clipped to the VMA.
+ */
+static void do_fault_around(struct vm_fault *vmf)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long nr_pages, mask, start, end, addr;
+	int mapped = 0;
+	pte_t *pte, entry;
+
+	if (vmf->flags & FAULT_FLAG_WRITE)
+		return;
+
+	nr_pages = READ_ONCE(fault_around_bytes) >> PAGE_SHIFT;
+	if (nr_pages <= 1)
+		return;
+
+	mask = ~(nr_pages * PAGE_SIZE - 1) & PAGE_MASK;
+	start = max(vmf->address & mask, vma->vm_start);
+	end = min((vmf->address & mask) + nr_pages * PAGE_SIZE, vma->vm_end);
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(pmd_trans_huge(*vmf->pmd))) {
+		/* khugepaged collapsed the range under us */
+		spin_unlock(&mm->page_table_lock);
+		return;
+	}
+	pte = pte_offset_map(vmf->pmd, start);
+	for (addr = start; addr < end; addr += PAGE_SIZE, pte++) {
+		if (!pte_none(*pte))
+			continue;
+
+		entry = pfn_pte(my_zero_pfn(addr), vma->vm_page_prot);
+		entry = pte_mkspecial(entry);
+		set_pte_at(mm, addr, pte, entry);
+		mapped++;
+	}
+	pte_unmap(pte);
+	spin_unlock(&mm->page_table_lock);
+
+	this_cpu_add(fault_around_pages, mapped);
+}
+
+/*
+ * We enter with the pte missing, the page table lock is not held.
+ */
+static vm_fault_t do_anonymous_page(struct vm_fault *vmf)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *page = NULL;
+	pte_t entry;
+
+	/* Shared anonymous memory needs a backing object we don't have */
+	if (vma->vm_flags & VM_SHARED)
+		return VM_FAULT_SIGBUS;
+
+	if (pte_alloc(mm, vmf->pmd))
+		return VM_FAULT_OOM;
+
+	if (!(vmf->flags & FAULT_FLAG_WRITE)) {
+		/* Use the zero-page for reads */
+		entry = pfn_pte(my_zero_pfn(vmf->address), vma->vm_page_prot);
+		entry = pte_mkspecial(entry);
+	} else {
+		page = alloc_zeroed_user_page(vma, vmf->address);
+		if (!page)
+			return VM_FAULT_OOM;
+		entry = mk_pte(page, vma->vm_page_prot);
+		entry = pte_mkwrite(pte_mkdirty(entry));
+	}
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(pmd_trans_huge(*vmf->pmd))) {
+		/* A huge page was installed, retry the access */
+		spin_unlock(&mm->page_table_lock);
+		if (page)
+			__free_page(page);
+		return 0;
+	}
+	vmf->pte = pte_offset_map(vmf->pmd, vmf->address);
+	if (!pte_none(*vmf->pte)) {
+		/* Raced with another fault on the same address */
+		spin_unlock(&mm->page_table_lock);
+		if (page)
+			__free_page(page);
+		return 0;
+	}
+	set_pte_at(mm, vmf->address, vmf->pte, entry);
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(vma, vmf->address, vmf->pte);
+	pte_unmap(vmf->pte);
+	spin_unlock(&mm->page_table_lock);
+
+	do_fault_around(vmf);
+
+	return 0;
+}
+
+/*
+ * This routine handles present pages, when users try to write to a
+ * read-only pte. Private anonymous pages are never shared here, so
+ * they are simply made writable; the zero page is replaced by a fresh
+ * zeroed page.
+ *
+ * We enter with the page table lock held and return with it released.
+ */
+static vm_fault_t do_wp_page(struct vm_fault *vmf)
+	__releases(vmf->vma->vm_mm->page_table_lock)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *new_page;
+	pte_t entry;
+
+	if (pte_pfn(vmf->orig_pte) != my_zero_pfn(vmf->address)) {
+		entry = pte_mkyoung(vmf->orig_pte);
+		entry = pte_mkwrite(pte_mkdirty(entry));
+		if (ptep_set_access_flags(vma, vmf->address, vmf->pte, entry, 1))
+			update_mmu_cache(vma, vmf->address, vmf->pte);
+		pte_unmap(vmf->pte);
+		spin_unlock(&mm->page_table_lock);
+		return 0;
+	}
+
+	pte_unmap(vmf->pte);
+	spin_unlock(&mm->page_table_lock);
+
+	new_page = alloc_zeroed_user_page(vma, vmf->address);
+	if (!new_page)
+		return VM_FAULT_OOM;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(pmd_trans_huge(*vmf->pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		__free_page(new_page);
+		return 0;
+	}
+	vmf->pte = pte_offset_map(vmf->pmd, vmf->address);
+	if (unlikely(!pte_same(*vmf->pte, vmf->orig_pte))) {
+		pte_unmap(vmf->pte);
+		spin_unlock(&mm->page_table_lock);
+		__free_page(new_page);
+		return 0;
+	}
+
+	entry = mk_pte(new_page, vma->vm_page_prot);
+	entry = pte_mkwrite(pte_mkdirty(entry));
+	/*
+	 * The output address changes, so break-before-make: clear the
+	 * old entry and flush it from the TLB before installing the new
+	 * one.
+	 */
+	pte_clear(mm, vmf->address, vmf->pte);
+	flush_tlb_page(vma, vmf->address);
+	set_pte_at(mm, vmf->address, vmf->pte, entry);
+	update_mmu_cache(vma, vmf->address, vmf->pte);
+	pte_unmap(vmf->pte);
+	spin_unlock(&mm->page_table_lock);
+
+	return 0;
+}
+
+static vm_fault_t handle_pte_fault(struct vm_fault *vmf)
+{
+	struct mm_struct *mm = vmf->vma->vm_mm;
+	pte_t entry;
+
+	if (unlikely(pmd_none(*vmf->pmd))) {
+		/*
+		 * Leave __pte_alloc() until later: because vm_ops->fault may
+		 * want to allocate huge page, and if we expose page table
+		 * for an instant, it will be difficult to retract from
+		 * concurrent faults and from rmap lookups.
+		 */
+		vmf->pte = NULL;
+	} else {
+		vmf->pte = pte_offset_map(vmf->pmd, vmf->address);
+		vmf->orig_pte = READ_ONCE(*vmf->pte);
+		if (pte_none(vmf->orig_pte)) {
+			pte_unmap(vmf->pte);
+			vmf->pte = NULL;
+		}
+	}
+
+	if (!vmf->pte) {
+		vmf->type = (vmf->flags & FAULT_FLAG_WRITE) ?
+				MM_FAULT_WRITE : MM_FAULT_READ;
+		return do_anonymous_page(vmf);
+	}
+
+	vmf->type = MM_FAULT_PERM;
+
+	spin_lock(&mm->page_table_lock);
+	/* The pte table may have been collapsed into a huge page meanwhile */
+	if (unlikely(pmd_trans_huge(*vmf->pmd)))
+		goto unlock;
+	entry = vmf->orig_pte;
+	if (unlikely(!pte_same(*vmf->pte, entry)))
+		goto unlock;
+	if (vmf->flags & FAULT_FLAG_WRITE) {
+		if (!pte_write(entry))
+			return do_wp_page(vmf);
+		entry = pte_mkdirty(entry);
+	}
+	entry = pte_mkyoung(entry);
+	if (ptep_set_access_flags(vmf->vma, vmf->address, vmf->pte, entry,
+				  vmf->flags & FAULT_FLAG_WRITE))
+		update_mmu_cache(vmf->vma, vmf->address, vmf->pte);
+unlock:
+	pte_unmap(vmf->pte);
+	spin_unlock(&mm->page_table_lock);
+	return 0;
+}
+
+/*
+ * Walk down to the pmd covering the fault, allocating the intermediate
+ * tables on the way. An empty pmd in a suitable VMA is first offered to
+ * the huge page path, a present huge pmd only ever takes access flag
+ * faults; everything else is resolved at pte level.
+ */
+static vm_fault_t __handle_mm_fault(struct vm_fault *vmf)
+{
+	struct mm_struct *mm = vmf->vma->vm_mm;
+	unsigned long address = vmf->address;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t orig_pmd;
+	vm_fault_t ret;
+
+	pgd = pgd_offset(mm, address);
+	pud = pud_alloc(mm, pgd, address);
+	if (!pud)
+		return VM_FAULT_OOM;
+	vmf->pmd = pmd_alloc(mm, pud, address);
+	if (!vmf->pmd)
+		return VM_FAULT_OOM;
+
+	orig_pmd = READ_ONCE(*vmf->pmd);
+	if (pmd_none(orig_pmd) && transhuge_vma_suitable(vmf->vma, address)) {
+		vmf->type = MM_FAULT_WRITE;
+		ret = do_huge_pmd_anonymous_page(vmf);
+		if (!(ret & VM_FAULT_FALLBACK))
+			return ret;
+	} else if (pmd_trans_huge(orig_pmd)) {
+		vmf->type = MM_FAULT_PERM;
+		huge_pmd_set_accessed(vmf, orig_pmd);
+		return 0;
+	}
+
+	return handle_pte_fault(vmf);
+}
+
+vm_fault_t handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
+		unsigned int flags)
+{
+	struct vm_fault vmf = {
+		.vma = vma,
+		.address = address & PAGE_MASK,
+		.flags = flags,
+	};
+	u64 start;
+	vm_fault_t ret;
+
+	if ((flags & FAULT_FLAG_WRITE) && !(vma->vm_flags & VM_WRITE))
+		return VM_FAULT_SIGSEGV;
+
+	if (!vma_is_anonymous(vma))
+		return VM_FAULT_SIGBUS;
+
+	start = sched_clock();
+	ret = __handle_mm_fault(&vmf);
+	if (!(ret & VM_FAULT_ERROR))
+		mm_fault_account(vmf.type, sched_clock() - start);
+
+	return ret;
+}
+
+#ifdef CONFIG_TEST_ANON_FAULT
+#include <linux/boot_test.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+
+/* Every test VMA lives in the one pmd at ANON_FAULT_TEST_BASE */
+#define ANON_FAULT_TEST_BASE	SZ_4M
+#define ANON_FAULT_TEST_SIZE	PMD_SIZE
+#define ANON_FAULT_TEST_WINDOW	(FAULT_AROUND_MAX_PAGES << PAGE_SHIFT)
+
+#define TP(n)			(ANON_FAULT_TEST_BASE + (n) * PAGE_SIZE)
+
+enum { TEST_PTE_NONE, TEST_PTE_ZERO, TEST_PTE_PRIVATE };
+
+static struct mm_struct * __init anon_fault_test_mm(struct vm_area_struct *vma)
+{
+	struct mm_struct *mm;
+
+	mm = kzalloc(sizeof(*mm) + cpumask_size(), GFP_KERNEL);
+	if (!mm)
+		return NULL;
+	spin_lock_init(&mm->page_table_lock);
+	mm->pgd = pgd_alloc(mm);
+	if (!mm->pgd)
+		goto free_mm;
+
+	if (insert_vm_struct(mm, vma))
+		goto free_pgd;
+
+	return mm;
+
+free_pgd:
+	pgd_free(mm, mm->pgd);
+free_mm:
+	kfree(mm);
+	return NULL;
+}
+
+static pte_t * __init anon_fault_test_pte(struct mm_struct *mm,
+					  unsigned long addr)
+{
+	pgd_t *pgd = pgd_offset(mm, addr);
+	pud_t *pud;
+	pmd_t *pmd;
+
+	if (pgd_none(*pgd))
+		return NULL;
+	pud = pud_offset(pgd, addr);
+	if (pud_none(*pud))
+		return NULL;
+	pmd = pmd_offset(pud, addr);
+	if (pmd_none(*pmd) || pmd_trans_huge(*pmd))
+		return NULL;
+	return pte_offset_map(pmd, addr);
+}
+
+static int __init anon_fault_test_state(struct mm_struct *mm,
+					unsigned long addr)
+{
+	pte_t *pte = anon_fault_test_pte(mm, addr);
+
+	if (!pte || pte_none(*pte))
+		return TEST_PTE_NONE;
+	if (pte_pfn(*pte) == my_zero_pfn(addr))
+		return TEST_PTE_ZERO;
+	return TEST_PTE_PRIVATE;
+}
+
+static bool __init anon_fault_test_writable(struct mm_struct *mm,
+					    unsigned long addr)
+{
+	pte_t *pte = anon_fault_test_pte(mm, addr);
+
+	return pte && pte_present(*pte) && pte_write(*pte);
+}
+
+static void __init anon_fault_test_teardown(struct mm_struct *mm)
+{
+	unsigned long addr;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	khugepaged_exit(mm);
+
+	for (addr = ANON_FAULT_TEST_BASE;
+	     addr < ANON_FAULT_TEST_BASE + ANON_FAULT_TEST_SIZE;
+	     addr += PAGE_SIZE) {
+		pte = anon_fault_test_pte(mm, addr);
+		if (!pte || pte_none(*pte))
+			continue;
+		if (!pte_special(*pte))
+			__free_page(pte_page(*pte));
+		pte_clear(mm, addr, pte);
+	}
+
+	pgd = pgd_offset(mm, ANON_FAULT_TEST_BASE);
+	if (pgd_none(*pgd))
+		goto out;
+	pud = pud_offset(pgd, ANON_FAULT_TEST_BASE);
+	if (pud_none(*pud))
+		goto free_pud;
+
+	pmd = pmd_offset(pud, ANON_FAULT_TEST_BASE);
+	if (!pmd_none(*pmd)) {
+		pte_free(mm, pmd_page(*pmd));
+		pmd_clear(pmd);
+	}
+	pmd_free(mm, pmd_offset(pud, 0));
+free_pud:
+	pud_free(mm, pud_offset(pgd, 0));
+out:
+	pgd_free(mm, mm->pgd);
+	kfree(mm);
+}
+
+static vm_fault_t __init anon_fault_test_fault(struct vm_area_struct *vma,
+					       unsigned long addr, bool write)
+{
+	return handle_mm_fault(vma, addr, write ? FAULT_FLAG_WRITE : 0);
+}
+
+/* The read fault window is clipped to a VMA smaller than the window */
+static void __init anon_fault_test_clip(struct boot_test *t)
+{
+	struct vm_area_struct vma = {
+		.vm_start	= TP(3),
+		.vm_end		= TP(13),
+		.vm_flags	= VM_READ | VM_WRITE,
+	};
+	struct mm_struct *mm = anon_fault_test_mm(&vma);
+	unsigned long addr;
+
+	if (!BOOT_TEST_EXPECT(t, mm))
+		return;
+
+	BOOT_TEST_EXPECT(t, !anon_fault_test_fault(&vma, TP(5), false));
+	for (addr = TP(0); addr < TP(FAULT_AROUND_MAX_PAGES); addr += PAGE_SIZE) {
+		if (addr < vma.vm_start || addr >= vma.vm_end) {
+			BOOT_TEST_EXPECT(t, anon_fault_test_state(mm, addr) ==
+					    TEST_PTE_NONE);
+			continue;
+		}
+		BOOT_TEST_EXPECT(t, anon_fault_test_state(mm, addr) ==
+				    TEST_PTE_ZERO);
+		BOOT_TEST_EXPECT(t, !anon_fault_test_writable(mm, addr));
+	}
+
+	/* Writing to a page mapped by fault-around replaces just that one */
+	BOOT_TEST_EXPECT(t, !anon_fault_test_fault(&vma, TP(6), true));
+	BOOT_TEST_EXPECT(t, anon_fault_test_state(mm, TP(6)) == TEST_PTE_PRIVATE);
+	BOOT_TEST_EXPECT(t, anon_fault_test_writable(mm, TP(6)));
+	BOOT_TEST_EXPECT(t, anon_fault_test_state(mm, TP(5)) == TEST_PTE_ZERO);
+	BOOT_TEST_EXPECT(t, anon_fault_test_state(mm, TP(7)) == TEST_PTE_ZERO);
+
+	anon_fault_test_teardown(mm);
+}
+
+/*
+ * A write fault maps only its own page. A later read fault fills the
+ * rest of its naturally aligned window, leaving the private page alone
+ * and not spilling into the next window.
+ */
+static void __init anon_fault_test_write(struct boot_test *t)
+{
+	struct vm_area_struct vma = {
+		.vm_start	= TP(0),
+		.vm_end		= TP(2 * FAULT_AROUND_MAX_PAGES),
+		.vm_flags	= VM_READ | VM_WRITE,
+	};
+	struct mm_struct *mm = anon_fault_test_mm(&vma);
+	unsigned long addr;
+	int state;
+
+	if (!BOOT_TEST_EXPECT(t, mm))
+		return;
+
+	BOOT_TEST_EXPECT(t, !anon_fault_test_fault(&vma, TP(5), true));
+	for (addr = vma.vm_start; addr < vma.vm_end; addr += PAGE_SIZE) {
+		state = anon_fault_test_state(mm, addr);
+		BOOT_TEST_EXPECT(t, addr == TP(5) ? state == TEST_PTE_PRIVATE :
+						    state == TEST_PTE_NONE);
+	}
+
+	BOOT_TEST_EXPECT(t, !anon_fault_test_fault(&vma, TP(9), false));
+	BOOT_TEST_EXPECT(t, anon_fault_test_state(mm, TP(5)) == TEST_PTE_PRIVATE);
+	BOOT_TEST_EXPECT(t, anon_fault_test_writable(mm, TP(5)));
+	for (addr = vma.vm_start; addr < vma.vm_end; addr += PAGE_SIZE) {
+		if (addr == TP(5))
+			continue;
+		state = anon_fault_test_state(mm, addr);
+		BOOT_TEST_EXPECT(t, addr < TP(FAULT_AROUND_MAX_PAGES) ?
+				    state == TEST_PTE_ZERO :
+				    state == TEST_PTE_NONE);
+	}
+
+	anon_fault_test_teardown(mm);
+}
+
+/* A one page window and a read-only VMA */
+static void __init anon_fault_test_limits(struct boot_test *t)
+{
+	struct vm_area_struct vma = {
+		.vm_start	= TP(0),
+		.vm_end		= TP(FAULT_AROUND_MAX_PAGES),
+		.vm_flags	= VM_READ,
+	};
+	unsigned long saved = fault_around_bytes;
+	struct mm_struct *mm = anon_fault_test_mm(&vma);
+	unsigned long addr;
+
+	if (!BOOT_TEST_EXPECT(t, mm))
+		return;
+
+	fault_around_bytes = PAGE_SIZE;
+	BOOT_TEST_EXPECT(t, !anon_fault_test_fault(&vma, TP(2), false));
+	fault_around_bytes = saved;
+	for (addr = vma.vm_start; addr < vma.vm_end; addr += PAGE_SIZE)
+		BOOT_TEST_EXPECT(t, anon_fault_test_state(mm, addr) ==
+				    (addr == TP(2) ? TEST_PTE_ZERO :
+						     TEST_PTE_NONE));
+
+	BOOT_TEST_EXPECT(t, anon_fault_test_fault(&vma, TP(3), true) ==
+			    VM_FAULT_SIGSEGV);
+	BOOT_TEST_EXPECT(t, anon_fault_test_state(mm, TP(3)) == TEST_PTE_NONE);
+
+	anon_fault_test_teardown(mm);
+}
+
+static void __init anon_fault_test(struct boot_test *t)
+{
+	unsigned long saved = fault_around_bytes;
+
+	fault_around_bytes = ANON_FAULT_TEST_WINDOW;
+	anon_fault_test_clip(t);
+	anon_fault_test_write(t);
+	anon_fault_test_limits(t);
+	fault_around_bytes = saved;
+}
+boot_test(anon_fault_test);
+#endif /* CONFIG_TEST_ANON_FAULT */
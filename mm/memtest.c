@@ -3,6 +3,11 @@
 #include <linux/types.h>
 #include <linux/init.h>
 #include <linux/memblock.h>
+#include <linux/nodemask.h>
+#include <linux/string.h>
+#include <linux/timex.h>
+
+#include <asm/arch_timer.h>
 
 static u64 patterns[] __initdata = {
 	/* The first entry has to be 0 to leave memtest with zeroed memory */
@@ -32,6 +37,26 @@ static void __init reserve_bad_mem(u64 pattern, phys_addr_t start_bad, phys_addr
 	memblock_reserve(start_bad, end_bad - start_bad);
 }
 
+#ifndef __HAVE_ARCH_MEMTEST
+static void __init __memtest_fill(u64 *start, u64 *end, u64 pattern)
+{
+	u64 *p;
+
+	for (p = start; p < end; p++)
+		*p = pattern;
+}
+
+static u64 * __init __memtest_check(u64 *start, u64 *end, u64 pattern)
+{
+	u64 *p;
+
+	for (p = start; p < end; p++)
+		if (*p != pattern)
+			break;
+	return p;
+}
+#endif
+
 static void __init memtest(u64 pattern, phys_addr_t start_phys, phys_addr_t size)
 {
 	u64 *p, *start, *end;
@@ -45,12 +70,11 @@ static void __init memtest(u64 pattern, phys_addr_t start_phys, phys_addr_t size
 	start_bad = 0;
 	last_bad = 0;
 
-	for (p = start; p < end; p++)
-		*p = pattern;
+	__memtest_fill(start, end, pattern);
 
-	for (p = start; p < end; p++, start_phys_aligned += incr) {
-		if (*p == pattern)
-			continue;
+	/* only the words that fail are looked at one by one */
+	for (p = start; (p = __memtest_check(p, end, pattern)) < end; p++) {
+		start_phys_aligned = __pa(p);
 		if (start_phys_aligned == last_bad + incr) {
 			last_bad += incr;
 			continue;
@@ -63,21 +87,25 @@ static void __init memtest(u64 pattern, phys_addr_t start_phys, phys_addr_t size
 		reserve_bad_mem(pattern, start_bad, last_bad + incr);
 }
 
-static void __init do_one_pass(u64 pattern, phys_addr_t start, phys_addr_t end)
+static phys_addr_t __init do_one_pass(u64 pattern, int nid, phys_addr_t start,
+				      phys_addr_t end)
 {
 	u64 i;
-	phys_addr_t this_start, this_end;
+	phys_addr_t this_start, this_end, tested = 0;
 
-	for_each_free_mem_range(i, NUMA_NO_NODE, MEMBLOCK_NONE, &this_start,
+	for_each_free_mem_range(i, nid, MEMBLOCK_NONE, &this_start,
 				&this_end, NULL) {
 		this_start = clamp(this_start, start, end);
 		this_end = clamp(this_end, start, end);
 		if (this_start < this_end) {
-			pr_info("  %pa - %pa pattern %016llx\n",
-				&this_start, &this_end, cpu_to_be64(pattern));
+			pr_debug("  %pa - %pa pattern %016llx\n",
+				 &this_start, &this_end, cpu_to_be64(pattern));
 			memtest(pattern, this_start, this_end - this_start);
+			tested += this_end - this_start;
 		}
 	}
+
+	return tested;
 }
 
 /* default is disabled */
@@ -97,17 +125,75 @@ static int __init parse_memtest(char *arg)
 
 early_param("memtest", parse_memtest);
 
+/*
+ * Incremental mode: only test one of memtest_slices equal slices of
+ * the physical range each boot.  Without a slice index on the command
+ * line, the counter picks one, so that every slice gets its turn over
+ * a number of boots without having to keep state across them.
+ */
+static unsigned int memtest_slices __initdata;
+static unsigned int memtest_slice __initdata = UINT_MAX;
+
+static int __init parse_memtest_slices(char *arg)
+{
+	char *idx;
+
+	if (!arg)
+		return -EINVAL;
+
+	/* memtest_slices=<count>[,<index>] */
+	idx = strchr(arg, ',');
+	if (idx) {
+		*idx++ = '\0';
+		if (kstrtouint(idx, 0, &memtest_slice))
+			return -EINVAL;
+	}
+	return kstrtouint(arg, 0, &memtest_slices);
+}
+
+early_param("memtest_slices", parse_memtest_slices);
+
 void __init early_memtest(phys_addr_t start, phys_addr_t end)
 {
 	unsigned int i;
 	unsigned int idx = 0;
+	phys_addr_t size, tested;
+	cycles_t t0;
+	int nid;
 
 	if (!memtest_pattern)
 		return;
 
+	if (memtest_slices > 1) {
+		if (memtest_slice >= memtest_slices)
+			memtest_slice = get_cycles() % memtest_slices;
+
+		size = round_up(DIV_ROUND_UP_ULL(end - start, memtest_slices),
+				PAGE_SIZE);
+		start = min(start + memtest_slice * size, end);
+		end = min(start + size, end);
+
+		pr_info("early_memtest: slice %u of %u: %pa - %pa\n",
+			memtest_slice, memtest_slices, &start, &end);
+	}
+
+	/*
+	 * Go node by node, so that each node's memory is tested in one go
+	 * and the time spent per node shows in the log.
+	 */
 	pr_info("early_memtest: # of tests: %u\n", memtest_pattern);
-	for (i = memtest_pattern-1; i < UINT_MAX; --i) {
-		idx = i % ARRAY_SIZE(patterns);
-		do_one_pass(patterns[idx], start, end);
+	for_each_online_node(nid) {
+		tested = 0;
+		t0 = get_cycles();
+		for (i = memtest_pattern-1; i < UINT_MAX; --i) {
+			idx = i % ARRAY_SIZE(patterns);
+			tested = do_one_pass(patterns[idx], nid, start, end);
+		}
+		/* sched_clock() isn't running yet, time with the counter */
+		if (tested)
+			pr_info("early_memtest: node %d: %llu MB tested in %llu ms\n",
+				nid, (unsigned long long)tested >> 20,
+				(u64)(get_cycles() - t0) * MSEC_PER_SEC /
+				arch_timer_get_cntfrq());
 	}
 }
@@ -265,9 +265,8 @@ __rmqueue(struct zone *zone, unsigned int order,
 	struct page *page;
 
 	page = __rmqueue_smallest(zone, order);
-	if (unlikely(!page)) {
-		WARN_ON(1);
-	}
+	/* alloc_flags still carries the caller's gfp mask */
+	WARN_ON(unlikely(!page) && !(alloc_flags & __GFP_NOWARN));
 
 	return page;
 }
@@ -519,6 +518,7 @@ get_page_from_freelist(gfp_t gfp_mask, unsigned int order, int alloc_flags,
 {
 	struct zoneref *z;
 	struct zone *zone;
+	bool no_fallback = nr_online_nodes > 1;
 
 retry:
 	/*
@@ -530,8 +530,7 @@ retry:
 								ac->nodemask) {
 		struct page *page;
 
-		if (nr_online_nodes > 1 &&
-		    zone != ac->preferred_zoneref->zone) {
+		if (no_fallback && zone != ac->preferred_zoneref->zone) {
 			int local_nid;
 
 			/*
@@ -541,6 +540,7 @@ retry:
 			 */
 			local_nid = zone_to_nid(ac->preferred_zoneref->zone);
 			if (zone_to_nid(zone) != local_nid) {
+				no_fallback = false;
 				goto retry;
 			}
 		}
@@ -583,6 +583,18 @@ static inline struct page *
 __alloc_pages_slowpath(gfp_t gfp_mask, unsigned int order,
 						struct alloc_context *ac)
 {
+	/*
+	 * There is no reclaim or compaction yet. Costly high-order requests
+	 * are opportunistic (huge pages fall back to small ones), so let
+	 * them fail; anything else running out of memory is fatal.
+	 */
+	if (order > PAGE_ALLOC_COSTLY_ORDER)
+		return NULL;
+
+	/* Nor can callers that may not reclaim, they have a fallback */
+	if (!(gfp_mask & __GFP_DIRECT_RECLAIM) || (gfp_mask & __GFP_NORETRY))
+		return NULL;
+
 	/* TODO */
 	BUG_ON(1);
 
@@ -615,11 +627,31 @@ __alloc_pages_nodemask(gfp_t gfp_mask, unsigned int order, int preferred_nid,
 
 	finalise_ac(gfp_mask, &ac);
 
+	/* Pages zeroed by idle CPUs save us the clear_page() below */
+	if ((gfp_mask & __GFP_ZERO) && !order) {
+		page = zero_pool_get(preferred_nid, gfp_mask);
+		if (page)
+			goto out;
+	}
+
 	/* First allocation attempt */
 	page = get_page_from_freelist(gfp_mask, order, alloc_flags, &ac);
 	if (likely(page))
 		goto out;
 
+	/*
+	 * Give the pre-zeroed pages back before declaring failure, but only
+	 * to order-0 callers that would otherwise have to reclaim. Huge page
+	 * attempts, node-local probes with a fallback and the pool's own
+	 * refill must not throw the zeroing work away.
+	 */
+	if (!order && (gfp_mask & __GFP_DIRECT_RECLAIM) &&
+	    !(gfp_mask & __GFP_THISNODE) && zero_pool_drain(preferred_nid)) {
+		page = get_page_from_freelist(gfp_mask, order, alloc_flags, &ac);
+		if (page)
+			goto out;
+	}
+
 	page = __alloc_pages_slowpath(alloc_flags, order, &ac);
 
 out:
@@ -1615,6 +1647,9 @@ static void __meminit init_currently_empty_zone(struct zone *zone,
 static void __meminit pgdat_init_internals(struct pglist_data *pgdat)
 {
 	spin_lock_init(&pgdat->lru_lock);
+	spin_lock_init(&pgdat->zero_pool_lock);
+	INIT_LIST_HEAD(&pgdat->zero_pool);
+	pgdat->nr_zero_pool = 0;
 }
 
 static int zone_batchsize(struct zone *zone)
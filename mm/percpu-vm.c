@@ -10,6 +10,15 @@
  * This is the default chunk allocator.
  */
 
+static struct page *pcpu_chunk_page(struct pcpu_chunk *chunk,
+				    unsigned int cpu, int page_idx)
+{
+	/* must not be used on pre-mapped chunk */
+	WARN_ON(chunk->immutable);
+
+	return vmalloc_to_page((void *)pcpu_chunk_addr(chunk, cpu, page_idx));
+}
+
 /**
  * pcpu_get_pages - get temp pages array
  *
@@ -67,45 +76,107 @@ static void pcpu_free_pages(struct pcpu_chunk *chunk,
  * Allocate pages [@page_start,@page_end) into @pages for all units.
  * The allocation is for @chunk.  Percpu core doesn't care about the
  * content of @pages and will pass it verbatim to pcpu_map_pages().
+ *
+ * Pages are allocated node by node, so that the units of all the cpus
+ * of a node are filled back to back from that node's free lists.  A
+ * unit is only backed from another node if its own node has run out of
+ * memory; the node local attempt must not reclaim, see
+ * __alloc_pages_slowpath(). show_percpu_numa_stats() reports such units.
  */
 static int pcpu_alloc_pages(struct pcpu_chunk *chunk,
 			    struct page **pages, int page_start, int page_end,
 			    gfp_t gfp)
 {
-	unsigned int cpu, tcpu;
-	int i;
+	unsigned int cpu;
+	int nid, i;
 
-	for_each_possible_cpu(cpu) {
-		for (i = page_start; i < page_end; i++) {
-			struct page **pagep = &pages[pcpu_page_idx(cpu, i)];
+	/* the temp array is shared, forget what the last user left in it */
+	for_each_possible_cpu(cpu)
+		memset(&pages[pcpu_page_idx(cpu, page_start)], 0,
+		       (page_end - page_start) * sizeof(pages[0]));
+
+	for_each_online_node(nid) {
+		for_each_possible_cpu(cpu) {
+			if (pcpu_unit_node(cpu) != nid)
+				continue;
 
-			*pagep = alloc_pages_node(cpu_to_node(cpu), gfp, 0);
-			if (!*pagep)
-				goto err;
+			for (i = page_start; i < page_end; i++) {
+				struct page **pagep =
+					&pages[pcpu_page_idx(cpu, i)];
+
+				*pagep = alloc_pages_node(nid,
+						gfp | __GFP_THISNODE |
+						__GFP_NORETRY | __GFP_NOWARN, 0);
+				if (!*pagep)
+					*pagep = alloc_pages_node(nid, gfp, 0);
+				if (!*pagep)
+					goto err;
+			}
 		}
 	}
 	return 0;
 
 err:
-	while (--i >= page_start)
-		__free_page(pages[pcpu_page_idx(cpu, i)]);
-
-	for_each_possible_cpu(tcpu) {
-		if (tcpu == cpu)
-			break;
-		for (i = page_start; i < page_end; i++)
-			__free_page(pages[pcpu_page_idx(tcpu, i)]);
-	}
+	pcpu_free_pages(chunk, pages, page_start, page_end);
 	return -ENOMEM;
 }
 
+/**
+ * pcpu_pre_unmap_flush - flush cache prior to unmapping
+ * @chunk: chunk the regions to be flushed belongs to
+ * @page_start: page index of the first page to be flushed
+ * @page_end: page index of the last page to be flushed + 1
+ *
+ * Pages in [@page_start,@page_end) of @chunk are about to be
+ * unmapped.  Flush cache.  As each flushing trial can be very
+ * expensive, issue flush on the whole region at once rather than
+ * doing it for each cpu.  This could be an overkill but is more
+ * scalable.
+ */
+static void pcpu_pre_unmap_flush(struct pcpu_chunk *chunk,
+				 int page_start, int page_end)
+{
+	flush_cache_vunmap(
+		pcpu_chunk_addr(chunk, pcpu_low_unit_cpu, page_start),
+		pcpu_chunk_addr(chunk, pcpu_high_unit_cpu, page_end));
+}
+
 static void __pcpu_unmap_pages(unsigned long addr, int nr_pages)
 {
-	/* TODO */
-	BUG();
-	//unmap_kernel_range_noflush(addr, nr_pages << PAGE_SHIFT);
+	unmap_kernel_range_noflush(addr, nr_pages << PAGE_SHIFT);
 }
 
+/**
+ * pcpu_unmap_pages - unmap pages out of a pcpu_chunk
+ * @chunk: chunk of interest
+ * @pages: pages array which can be used to pass information to free
+ * @page_start: page index of the first page to unmap
+ * @page_end: page index of the last page to unmap + 1
+ *
+ * For each cpu, unmap pages [@page_start,@page_end) out of @chunk.
+ * Corresponding elements in @pages were cleared by the caller and can
+ * be used to carry information to pcpu_free_pages() which will be
+ * called after all unmaps are finished.  The caller should call
+ * proper pre/post flush functions.
+ */
+static void pcpu_unmap_pages(struct pcpu_chunk *chunk,
+			     struct page **pages, int page_start, int page_end)
+{
+	unsigned int cpu;
+	int i;
+
+	for_each_possible_cpu(cpu) {
+		for (i = page_start; i < page_end; i++) {
+			struct page *page;
+
+			page = pcpu_chunk_page(chunk, cpu, i);
+			WARN_ON(!page);
+			pages[pcpu_page_idx(cpu, i)] = page;
+		}
+		__pcpu_unmap_pages(pcpu_chunk_addr(chunk, cpu, page_start),
+				   page_end - page_start);
+	}
+}
 /**
  * pcpu_post_unmap_tlb_flush - flush TLB after unmapping
  * @chunk: pcpu_chunk the regions to be flushed belong to
@@ -130,11 +201,8 @@ static void pcpu_post_unmap_tlb_flush(struct pcpu_chunk *chunk,
 static int __pcpu_map_pages(unsigned long addr, struct page **pages,
 			    int nr_pages)
 {
-	/* TODO */
-	BUG();
-	return 0;
-	//return map_kernel_range_noflush(addr, nr_pages << PAGE_SHIFT,
-	//				PAGE_KERNEL, pages);
+	return map_kernel_range_noflush(addr, nr_pages << PAGE_SHIFT,
+					PAGE_KERNEL, pages);
 }
 
 /**
@@ -234,6 +302,41 @@ static int pcpu_populate_chunk(struct pcpu_chunk *chunk,
 	return 0;
 }
 
+/**
+ * pcpu_depopulate_chunk - depopulate and unmap an area of a pcpu_chunk
+ * @chunk: chunk to depopulate
+ * @page_start: the start page
+ * @page_end: the end page
+ *
+ * For each cpu, depopulate and unmap pages [@page_start,@page_end)
+ * from @chunk.
+ *
+ * CONTEXT:
+ * pcpu_alloc_mutex.
+ */
+static void pcpu_depopulate_chunk(struct pcpu_chunk *chunk,
+				  int page_start, int page_end)
+{
+	struct page **pages;
+
+	/*
+	 * If control reaches here, there must have been at least one
+	 * successful population attempt so the temp pages array must
+	 * be available now.
+	 */
+	pages = pcpu_get_pages();
+	BUG_ON(!pages);
+
+	/* unmap and free */
+	pcpu_pre_unmap_flush(chunk, page_start, page_end);
+
+	pcpu_unmap_pages(chunk, pages, page_start, page_end);
+
+	/* no need to flush tlb, vmalloc will handle it lazily */
+
+	pcpu_free_pages(chunk, pages, page_start, page_end);
+}
+
 static struct pcpu_chunk *pcpu_create_chunk(gfp_t gfp)
 {
 	struct pcpu_chunk *chunk;
@@ -243,10 +346,8 @@ static struct pcpu_chunk *pcpu_create_chunk(gfp_t gfp)
 	if (!chunk)
 		return NULL;
 
-	//vms = pcpu_get_vm_areas(pcpu_group_offsets, pcpu_group_sizes,
-	//			pcpu_nr_groups, pcpu_atom_size);
-	/* TODO */
-	BUG();
+	vms = pcpu_get_vm_areas(pcpu_group_offsets, pcpu_group_sizes,
+				pcpu_nr_groups, pcpu_atom_size);
 	if (!vms) {
 		pcpu_free_chunk(chunk);
 		return NULL;
@@ -260,12 +361,21 @@ static struct pcpu_chunk *pcpu_create_chunk(gfp_t gfp)
 	return chunk;
 }
 
+static void pcpu_destroy_chunk(struct pcpu_chunk *chunk)
+{
+	if (!chunk)
+		return;
+
+	pcpu_stats_chunk_dealloc();
+
+	if (chunk->data)
+		pcpu_free_vm_areas(chunk->data, pcpu_nr_groups);
+	pcpu_free_chunk(chunk);
+}
+
 static struct page *pcpu_addr_to_page(void *addr)
 {
-	/* TODO */
-	BUG();
-	return NULL;
-	//return vmalloc_to_page(addr);
+	return vmalloc_to_page(addr);
 }
 
 static int __init pcpu_verify_alloc_info(const struct pcpu_alloc_info *ai)
@@ -67,6 +67,7 @@
 #include <linux/bitmap.h>
 #include <linux/memblock.h>
 #include <linux/err.h>
+#include <linux/kthread.h>
 #include <linux/lcm.h>
 #include <linux/list.h>
 #include <linux/log2.h>
@@ -79,6 +80,7 @@
 #include <linux/spinlock.h>
 #include <linux/vmalloc.h>
 #include <linux/sched.h>
+#include <linux/sched/task.h>
 
 #include <asm/cacheflush.h>
 #include <asm/sections.h>
@@ -90,6 +92,7 @@
 /* the slots are sorted by free bytes left, 1-31 bytes share the same slot */
 #define PCPU_SLOT_BASE_SHIFT		5
 
+/* default size of the reserve of empty populated pages, see percpu_reserve= */
 #define PCPU_EMPTY_POP_PAGES_LOW	2
 #define PCPU_EMPTY_POP_PAGES_HIGH	4
 
@@ -149,6 +152,12 @@ struct pcpu_chunk *pcpu_first_chunk __ro_after_init;
  */
 struct pcpu_chunk *pcpu_reserved_chunk __ro_after_init;
 
+/*
+ * pcpu_alloc_mutex serializes chunk creation, [de]population and
+ * destruction.  pcpu_lock protects the index data structures and is
+ * the only lock taken by atomic allocations and free_percpu().
+ */
+static DEFINE_MUTEX(pcpu_alloc_mutex);	/* chunk create/destroy, [de]pop */
 DEFINE_SPINLOCK(pcpu_lock);	/* all internal data structures */
 
 struct list_head *pcpu_slot __ro_after_init; /* chunk list slots */
@@ -172,9 +181,48 @@ static unsigned long pcpu_nr_populated;
 
 static bool pcpu_atomic_alloc_failed;
 
+/*
+ * Atomic allocations can only be served from pages that are already
+ * populated.  The balance pass keeps at least pcpu_reserve_low empty
+ * populated pages around, topping them up to pcpu_reserve_high, and
+ * returns all but one fully free chunk.
+ */
+static int pcpu_reserve_low __read_mostly = PCPU_EMPTY_POP_PAGES_LOW;
+static int pcpu_reserve_high __read_mostly = PCPU_EMPTY_POP_PAGES_HIGH;
+
+static int __init percpu_reserve_setup(char *str)
+{
+	if (!str)
+		return -EINVAL;
+
+	/* percpu_reserve=<size> per unit, refilled up to twice that */
+	pcpu_reserve_low = memparse(str, &str) >> PAGE_SHIFT;
+	pcpu_reserve_high = 2 * pcpu_reserve_low;
+
+	return 0;
+}
+early_param("percpu_reserve", percpu_reserve_setup);
+
+/* fill the reserve as soon as the balance thread starts */
+static bool pcpu_balance_pending = true;
+static struct task_struct *pcpu_balance_thread;
+
+/* reserve statistics, under pcpu_lock except for the failure count */
+static unsigned long pcpu_nr_atomic_allocs;
+static unsigned long pcpu_nr_atomic_fails;
+static unsigned long pcpu_nr_balance_runs;
+static unsigned long pcpu_nr_balance_pop_pages;
+static unsigned long pcpu_nr_balance_freed_chunks;
+
+/*
+ * There are no workqueues, so the balance work is done by a kthread,
+ * see pcpu_balance_workfn().  Can be called from atomic context.
+ */
 static void pcpu_schedule_balance_work(void)
 {
-	WARN_ON(1);
+	WRITE_ONCE(pcpu_balance_pending, true);
+	if (pcpu_balance_thread)
+		wake_up_process(pcpu_balance_thread);
 }
 
 /**
@@ -237,6 +285,19 @@ static int __maybe_unused pcpu_page_idx(unsigned int cpu, int page_idx)
 	return pcpu_unit_map[cpu] * pcpu_unit_pages + page_idx;
 }
 
+/*
+ * The node whose memory backs @cpu's units.  CPUs without a usable node
+ * are backed from the first online node.
+ */
+static int pcpu_unit_node(unsigned int cpu)
+{
+	int nid = cpu_to_node(cpu);
+
+	if (nid == NUMA_NO_NODE || !node_online(nid))
+		nid = first_online_node;
+	return nid;
+}
+
 static unsigned long pcpu_unit_page_offset(unsigned int cpu, int page_idx)
 {
 	return pcpu_unit_offsets[cpu] + (page_idx << PAGE_SHIFT);
@@ -255,6 +316,12 @@ static void pcpu_next_unpop(unsigned long *bitmap, int *rs, int *re, int end)
 	*re = find_next_bit(bitmap, end, *rs + 1);
 }
 
+static void pcpu_next_pop(unsigned long *bitmap, int *rs, int *re, int end)
+{
+	*rs = find_next_bit(bitmap, end, *rs);
+	*re = find_next_zero_bit(bitmap, end, *rs + 1);
+}
+
 /*
  * Bitmap region iterators.  Iterates over the bitmap between
  * [@start, @end) in @chunk.  @rs and @re should be integer variables
@@ -265,6 +332,11 @@ static void pcpu_next_unpop(unsigned long *bitmap, int *rs, int *re, int end)
 	     (rs) < (re);						     \
 	     (rs) = (re) + 1, pcpu_next_unpop((bitmap), &(rs), &(re), (end)))
 
+#define pcpu_for_each_pop_region(bitmap, rs, re, start, end)		     \
+	for ((rs) = (start), pcpu_next_pop((bitmap), &(rs), &(re), (end));   \
+	     (rs) < (re);						     \
+	     (rs) = (re) + 1, pcpu_next_pop((bitmap), &(rs), &(re), (end)))
+
 /*
  * The following are helper functions to help access bitmaps and convert
  * between bitmap offsets to address offsets.
@@ -545,6 +617,30 @@ static void pcpu_chunk_update(struct pcpu_chunk *chunk, int bit_off, int bits)
 	}
 }
 
+/*
+ * Metadata blocks are page sized, so a populated block whose contig hint
+ * covers the whole block is an empty populated page.
+ */
+static int pcpu_cnt_empty_blocks(struct pcpu_chunk *chunk, int s_index,
+				 int e_index)
+{
+	int index, nr = 0;
+
+	for (index = s_index; index <= e_index; index++)
+		if (chunk->md_blocks[index].contig_hint ==
+		    PCPU_BITMAP_BLOCK_BITS &&
+		    test_bit(index, chunk->populated))
+			nr++;
+	return nr;
+}
+
+static void pcpu_update_empty_pages(struct pcpu_chunk *chunk, int nr)
+{
+	chunk->nr_empty_pop_pages += nr;
+	if (chunk != pcpu_reserved_chunk)
+		pcpu_nr_empty_pop_pages += nr;
+}
+
 /**
  * pcpu_chunk_refresh_hint - updates metadata about a chunk
  * @chunk: chunk of interest
@@ -675,6 +771,10 @@ static void pcpu_block_update_hint_alloc(struct pcpu_chunk *chunk, int bit_off,
 	s_block = chunk->md_blocks + s_index;
 	e_block = chunk->md_blocks + e_index;
 
+	/* none of the blocks touched by the allocation stays empty */
+	pcpu_update_empty_pages(chunk,
+				-pcpu_cnt_empty_blocks(chunk, s_index, e_index));
+
 	/*
 	 * Update s_block.
 	 * block->first_free must be updated if the allocation takes its place.
@@ -757,11 +857,10 @@ static void pcpu_block_update_hint_alloc(struct pcpu_chunk *chunk, int bit_off,
  * forward and backward to determine the extent of the free area.  This is
  * capped at the boundary of blocks.
  *
- * A chunk update is triggered if a page becomes free, a block becomes free,
- * or the free spans across blocks.  This tradeoff is to minimize iterating
- * over the block metadata to update chunk->contig_bits.  chunk->contig_bits
- * may be off by up to a page, but it will never be more than the available
- * space.  If the contig hint is contained in one block, it will be accurate.
+ * The free area is then extended over the free edges of the neighbouring
+ * blocks to find the whole free area it merged into, which is all that is
+ * needed to keep chunk->contig_bits exact without a chunk-wide scan.  The
+ * blocks the free made empty are added to the empty populated page count.
  */
 static void pcpu_block_update_hint_free(struct pcpu_chunk *chunk, int bit_off,
 					int bits)
@@ -770,6 +869,7 @@ static void pcpu_block_update_hint_free(struct pcpu_chunk *chunk, int bit_off,
 	int s_index, e_index;	/* block indexes of the freed allocation */
 	int s_off, e_off;	/* block offsets of the freed allocation */
 	int start, end;		/* start and end of the whole free area */
+	int index, run_start, run_end;
 
 	/*
 	 * Calculate per block offsets.
@@ -836,19 +936,31 @@ static void pcpu_block_update_hint_free(struct pcpu_chunk *chunk, int bit_off,
 		}
 	}
 
+	pcpu_update_empty_pages(chunk,
+				pcpu_cnt_empty_blocks(chunk, s_index, e_index));
+
 	/*
-	 * Refresh chunk metadata when the free makes a page free, a block
-	 * free, or spans across blocks.  The contig hint may be off by up to
-	 * a page, but if the hint is contained in a block, it will be accurate
-	 * with the else condition below.
+	 * The free area only extends past [start, end) through the free
+	 * right edge of the blocks before s_block and the free left edge
+	 * of the blocks after e_block.
 	 */
-	if ((ALIGN_DOWN(end, min(PCPU_BITS_PER_PAGE, PCPU_BITMAP_BLOCK_BITS)) >
-	     ALIGN(start, min(PCPU_BITS_PER_PAGE, PCPU_BITMAP_BLOCK_BITS))) ||
-	    s_index != e_index)
-		pcpu_chunk_refresh_hint(chunk);
-	else
-		pcpu_chunk_update(chunk, pcpu_block_off_to_off(s_index, start),
-				  s_block->contig_hint);
+	run_start = pcpu_block_off_to_off(s_index, start);
+	for (index = s_index - 1; !start && index >= 0; index--) {
+		run_start -= chunk->md_blocks[index].right_free;
+		if (chunk->md_blocks[index].right_free != PCPU_BITMAP_BLOCK_BITS)
+			break;
+	}
+
+	run_end = pcpu_block_off_to_off(e_index, end);
+	for (index = e_index + 1;
+	     end == PCPU_BITMAP_BLOCK_BITS &&
+	     index < pcpu_chunk_nr_blocks(chunk); index++) {
+		run_end += chunk->md_blocks[index].left_free;
+		if (chunk->md_blocks[index].left_free != PCPU_BITMAP_BLOCK_BITS)
+			break;
+	}
+
+	pcpu_chunk_update(chunk, run_start, run_end - run_start);
 }
 
 /**
@@ -1103,9 +1215,8 @@ static struct pcpu_chunk * __init pcpu_alloc_first_chunk(unsigned long tmp_addr,
 	chunk->immutable = true;
 	bitmap_fill(chunk->populated, chunk->nr_pages);
 	chunk->nr_populated = chunk->nr_pages;
-	chunk->nr_empty_pop_pages =
-		pcpu_cnt_pop_pages(chunk, start_offset / PCPU_MIN_ALLOC_SIZE,
-				   map_size / PCPU_MIN_ALLOC_SIZE);
+	/* hiding the edges below takes the partial pages back out */
+	chunk->nr_empty_pop_pages = chunk->nr_pages;
 
 	chunk->contig_bits = map_size / PCPU_MIN_ALLOC_SIZE;
 	chunk->free_bytes = map_size;
@@ -1226,6 +1337,30 @@ static void pcpu_chunk_populated(struct pcpu_chunk *chunk, int page_start,
 	}
 }
 
+/**
+ * pcpu_chunk_depopulated - post-depopulation bookkeeping
+ * @chunk: pcpu_chunk which got depopulated
+ * @page_start: the start page
+ * @page_end: the end page
+ *
+ * Pages in [@page_start,@page_end) have been depopulated from @chunk.
+ * Update the bookkeeping information accordingly.  Must be called after
+ * each successful depopulation.
+ */
+static void pcpu_chunk_depopulated(struct pcpu_chunk *chunk,
+				   int page_start, int page_end)
+{
+	int nr = page_end - page_start;
+
+	lockdep_assert_held(&pcpu_lock);
+
+	bitmap_clear(chunk->populated, page_start, nr);
+	chunk->nr_populated -= nr;
+	chunk->nr_empty_pop_pages -= nr;
+	pcpu_nr_empty_pop_pages -= nr;
+	pcpu_nr_populated -= nr;
+}
+
 /*
  * Chunk management implementation.
  *
@@ -1235,13 +1370,18 @@ static void pcpu_chunk_populated(struct pcpu_chunk *chunk, int page_start,
  * should be implemented.
  *
  * pcpu_populate_chunk		- populate the specified range of a chunk
+ * pcpu_depopulate_chunk	- depopulate the specified range of a chunk
  * pcpu_create_chunk		- create a new chunk
+ * pcpu_destroy_chunk		- destroy a chunk, always preceded by full depop
  * pcpu_addr_to_page		- translate address to physical address
  * pcpu_verify_alloc_info	- check alloc_info is acceptable during init
  */
 static int pcpu_populate_chunk(struct pcpu_chunk *chunk,
 			       int page_start, int page_end, gfp_t gfp);
+static void pcpu_depopulate_chunk(struct pcpu_chunk *chunk,
+				  int page_start, int page_end);
 static struct pcpu_chunk *pcpu_create_chunk(gfp_t gfp);
+static void pcpu_destroy_chunk(struct pcpu_chunk *chunk);
 static struct page *pcpu_addr_to_page(void *addr);
 static int __init pcpu_verify_alloc_info(const struct pcpu_alloc_info *ai);
 
@@ -1282,6 +1422,184 @@ static struct pcpu_chunk *pcpu_chunk_addr_search(void *addr)
 	return pcpu_get_page_chunk(pcpu_addr_to_page(addr));
 }
 
+/*
+ * Per-cpu caches of recently freed small areas.  An area parked in a
+ * cache stays allocated in its chunk and is handed straight back to the
+ * next allocation of the same size class on that cpu, skipping the
+ * block scan and pcpu_lock.  Size classes are the powers of two from
+ * PCPU_MIN_ALLOC_SIZE to PCPU_CACHE_MAX_SIZE bytes.  Areas only ever
+ * come from populated pages, so atomic allocations can use the caches
+ * too.
+ *
+ * Each cache has its own lock, nested inside pcpu_lock, so that
+ * pcpu_cache_drain() can empty the caches of other cpus.  Only the
+ * drain ever contends for it.
+ */
+#define PCPU_CACHE_MAX_SIZE	256
+#define PCPU_CACHE_NR_CLASSES	\
+	(ilog2(PCPU_CACHE_MAX_SIZE) - PCPU_MIN_ALLOC_SHIFT + 1)
+#define PCPU_CACHE_DEPTH	16
+
+struct pcpu_area_cache {
+	spinlock_t		lock;
+	int			nr[PCPU_CACHE_NR_CLASSES];
+	void			*addr[PCPU_CACHE_NR_CLASSES][PCPU_CACHE_DEPTH];
+	unsigned long		hits;
+	unsigned long		misses;
+};
+
+static DEFINE_PER_CPU(struct pcpu_area_cache, pcpu_area_cache) = {
+	.lock = __SPIN_LOCK_UNLOCKED(pcpu_area_cache.lock),
+};
+
+static bool pcpu_cache_enabled __read_mostly = true;
+
+static int __init percpu_nocache_setup(char *str)
+{
+	pcpu_cache_enabled = false;
+	return 0;
+}
+early_param("percpu_nocache", percpu_nocache_setup);
+
+static int pcpu_cache_class(size_t size)
+{
+	if (size > PCPU_CACHE_MAX_SIZE || !is_power_of_2(size))
+		return -1;
+	return ilog2(size) - PCPU_MIN_ALLOC_SHIFT;
+}
+
+/*
+ * Take the most recently freed area of @size bytes that satisfies
+ * @align from this cpu's cache.
+ */
+static void __percpu *pcpu_cache_alloc(size_t size, size_t align)
+{
+	int class = pcpu_cache_class(size);
+	struct pcpu_area_cache *cache;
+	void __percpu *ptr = NULL;
+	unsigned long flags;
+	int i;
+
+	if (class < 0 || !READ_ONCE(pcpu_cache_enabled))
+		return NULL;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(&pcpu_area_cache);
+	spin_lock(&cache->lock);
+	for (i = cache->nr[class] - 1; i >= 0; i--) {
+		void *addr = cache->addr[class][i];
+
+		if (!IS_ALIGNED((unsigned long)addr, align))
+			continue;
+
+		cache->addr[class][i] = cache->addr[class][--cache->nr[class]];
+		ptr = __addr_to_pcpu_ptr(addr);
+		break;
+	}
+	if (ptr)
+		cache->hits++;
+	else
+		cache->misses++;
+	spin_unlock(&cache->lock);
+	local_irq_restore(flags);
+
+	return ptr;
+}
+
+/*
+ * Park the area at @addr of @chunk in this cpu's cache if it is of a
+ * cached size class and there is room.  The area is ours until it is
+ * freed, so the bits of the boundary map that give its size can be read
+ * without pcpu_lock.
+ */
+static bool pcpu_cache_free(struct pcpu_chunk *chunk, void *addr)
+{
+	struct pcpu_area_cache *cache;
+	int bit_off, end, class;
+	unsigned long flags;
+	bool cached = false;
+
+	if (!READ_ONCE(pcpu_cache_enabled) || chunk == pcpu_reserved_chunk)
+		return false;
+
+	bit_off = (addr - chunk->base_addr) / PCPU_MIN_ALLOC_SIZE;
+	end = find_next_bit(chunk->bound_map, pcpu_chunk_map_bits(chunk),
+			    bit_off + 1);
+	class = pcpu_cache_class((end - bit_off) * PCPU_MIN_ALLOC_SIZE);
+	if (class < 0)
+		return false;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(&pcpu_area_cache);
+	spin_lock(&cache->lock);
+	if (cache->nr[class] < PCPU_CACHE_DEPTH) {
+		cache->addr[class][cache->nr[class]++] = addr;
+		cached = true;
+	}
+	spin_unlock(&cache->lock);
+	local_irq_restore(flags);
+
+	return cached;
+}
+
+/**
+ * pcpu_release_area - free an area and reap empty chunks
+ * @chunk: chunk of interest
+ * @off: addr offset into chunk
+ *
+ * CONTEXT:
+ * pcpu_lock.
+ */
+static void pcpu_release_area(struct pcpu_chunk *chunk, int off)
+{
+	pcpu_free_area(chunk, off);
+
+	/* if there are more than one fully free chunks, wake up grim reaper */
+	if (chunk->free_bytes == pcpu_unit_size) {
+		struct pcpu_chunk *pos;
+
+		list_for_each_entry(pos, &pcpu_slot[pcpu_nr_slots - 1], list)
+			if (pos != chunk) {
+				pcpu_schedule_balance_work();
+				break;
+			}
+	}
+}
+
+/*
+ * Give all the areas parked in the caches of all possible cpus back to
+ * their chunks.  Returns the number of areas freed.
+ */
+static int pcpu_cache_drain(void)
+{
+	struct pcpu_area_cache *cache;
+	unsigned long flags;
+	int class, nr = 0;
+	unsigned int cpu;
+
+	spin_lock_irqsave(&pcpu_lock, flags);
+	for_each_possible_cpu(cpu) {
+		cache = per_cpu_ptr(&pcpu_area_cache, cpu);
+		spin_lock(&cache->lock);
+		for (class = 0; class < PCPU_CACHE_NR_CLASSES; class++) {
+			while (cache->nr[class]) {
+				void *addr;
+				struct pcpu_chunk *chunk;
+
+				addr = cache->addr[class][--cache->nr[class]];
+				chunk = pcpu_chunk_addr_search(addr);
+				pcpu_release_area(chunk,
+						  addr - chunk->base_addr);
+				nr++;
+			}
+		}
+		spin_unlock(&cache->lock);
+	}
+	spin_unlock_irqrestore(&pcpu_lock, flags);
+
+	return nr;
+}
+
 /**
  * pcpu_alloc - the percpu allocator
  * @size: size of area to allocate in bytes
@@ -1311,6 +1629,7 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 	unsigned long flags;
 	void __percpu *ptr;
 	size_t bits, bit_align;
+	bool drained = false;
 
 	/*
 	 * There is now a minimum allocation size of PCPU_MIN_ALLOC_SIZE,
@@ -1332,6 +1651,22 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 		return NULL;
 	}
 
+	if (!reserved) {
+		ptr = pcpu_cache_alloc(size, align);
+		if (ptr) {
+			for_each_possible_cpu(cpu)
+				memset(per_cpu_ptr(ptr, cpu), 0, size);
+			return ptr;
+		}
+	}
+
+	/*
+	 * Non-atomic allocations may create and populate chunks, which
+	 * must not race with the balance pass doing the same.
+	 */
+	if (!is_atomic)
+		mutex_lock(&pcpu_alloc_mutex);
+
 	spin_lock_irqsave(&pcpu_lock, flags);
 
 	/* serve reserved allocations from the reserved chunk if available */
@@ -1370,6 +1705,15 @@ restart:
 
 	spin_unlock_irqrestore(&pcpu_lock, flags);
 
+	/* areas parked in the cpu caches may make room */
+	if (!drained) {
+		drained = true;
+		if (pcpu_cache_drain()) {
+			spin_lock_irqsave(&pcpu_lock, flags);
+			goto restart;
+		}
+	}
+
 	/*
 	 * No space left.  Create a new chunk.  We don't want multiple
 	 * tasks to create chunks simultaneously.  Serialize and create iff
@@ -1397,6 +1741,8 @@ restart:
 
 area_found:
 	pcpu_stats_area_alloc(chunk, size);
+	if (is_atomic)
+		pcpu_nr_atomic_allocs++;
 	spin_unlock_irqrestore(&pcpu_lock, flags);
 
 	/* populate if not all pages are already there */
@@ -1423,9 +1769,12 @@ area_found:
 		}
 	}
 
-	if (pcpu_nr_empty_pop_pages < PCPU_EMPTY_POP_PAGES_LOW)
+	if (pcpu_nr_empty_pop_pages < pcpu_reserve_low)
 		pcpu_schedule_balance_work();
 
+	if (!is_atomic)
+		mutex_unlock(&pcpu_alloc_mutex);
+
 	/* clear the areas and return address relative to base address */
 	for_each_possible_cpu(cpu)
 		memset((void *)pcpu_chunk_addr(chunk, cpu, 0) + off, 0, size);
@@ -1437,6 +1786,8 @@ area_found:
 fail_unlock:
 	spin_unlock_irqrestore(&pcpu_lock, flags);
 fail:
+	if (!is_atomic)
+		mutex_unlock(&pcpu_alloc_mutex);
 	if (!is_atomic && do_warn && warn_limit) {
 		pr_warn("allocation failed, size=%zu align=%zu atomic=%d, %s\n",
 			size, align, is_atomic, err);
@@ -1445,8 +1796,9 @@ fail:
 			pr_info("limit reached, disable warning\n");
 	}
 	if (is_atomic) {
-		/* see the flag handling in pcpu_blance_workfn() */
+		/* see the flag handling in pcpu_balance() */
 		pcpu_atomic_alloc_failed = true;
+		WRITE_ONCE(pcpu_nr_atomic_fails, pcpu_nr_atomic_fails + 1);
 		pcpu_schedule_balance_work();
 	}
 	return NULL;
@@ -1505,6 +1857,177 @@ void __percpu *__alloc_reserved_percpu(size_t size, size_t align)
 	return pcpu_alloc(size, align, true, GFP_KERNEL);
 }
 
+/**
+ * pcpu_balance - manage the amount of free chunks and populated pages
+ *
+ * Drain the area caches, free all but one completely free chunk
+ * and make sure there are at least pcpu_reserve_low empty populated
+ * pages for atomic allocations, topping them up to pcpu_reserve_high
+ * and creating a chunk if needed.
+ *
+ * CONTEXT:
+ * pcpu_alloc_mutex, does GFP_KERNEL allocation.
+ */
+static void pcpu_balance(void)
+{
+	gfp_t gfp = GFP_KERNEL | __GFP_NOWARN;
+	LIST_HEAD(to_free);
+	struct list_head *free_head = &pcpu_slot[pcpu_nr_slots - 1];
+	struct pcpu_chunk *chunk, *next;
+	int slot, nr_to_pop, ret;
+	unsigned long nr_freed = 0;
+
+	/* parked areas would keep their chunks from ever becoming free */
+	pcpu_cache_drain();
+
+	spin_lock_irq(&pcpu_lock);
+
+	list_for_each_entry_safe(chunk, next, free_head, list) {
+		WARN_ON(chunk->immutable);
+
+		/* spare the first one */
+		if (chunk == list_first_entry(free_head, struct pcpu_chunk, list))
+			continue;
+
+		list_move(&chunk->list, &to_free);
+	}
+
+	spin_unlock_irq(&pcpu_lock);
+
+	list_for_each_entry_safe(chunk, next, &to_free, list) {
+		int rs, re;
+
+		pcpu_for_each_pop_region(chunk->populated, rs, re, 0,
+					 chunk->nr_pages) {
+			pcpu_depopulate_chunk(chunk, rs, re);
+			spin_lock_irq(&pcpu_lock);
+			pcpu_chunk_depopulated(chunk, rs, re);
+			spin_unlock_irq(&pcpu_lock);
+		}
+		pcpu_destroy_chunk(chunk);
+		nr_freed++;
+	}
+
+	/*
+	 * Ensure there are certain number of free populated pages for
+	 * atomic allocs.  Fill up from the most packed so that atomic
+	 * allocs don't increase fragmentation.  If atomic allocation
+	 * failed previously, always populate the maximum amount.  This
+	 * should prevent atomic allocs larger than PAGE_SIZE from keeping
+	 * failing indefinitely; however, large atomic allocs are not
+	 * something we support properly and can be highly unreliable and
+	 * inefficient.
+	 */
+retry_pop:
+	if (pcpu_atomic_alloc_failed) {
+		nr_to_pop = pcpu_reserve_high;
+		/* best effort anyway, don't worry about synchronization */
+		pcpu_atomic_alloc_failed = false;
+	} else {
+		nr_to_pop = clamp(pcpu_reserve_high - pcpu_nr_empty_pop_pages,
+				  0, pcpu_reserve_high);
+	}
+
+	for (slot = pcpu_size_to_slot(PAGE_SIZE); slot < pcpu_nr_slots; slot++) {
+		int nr_unpop = 0, rs, re;
+
+		if (!nr_to_pop)
+			break;
+
+		spin_lock_irq(&pcpu_lock);
+		list_for_each_entry(chunk, &pcpu_slot[slot], list) {
+			nr_unpop = chunk->nr_pages - chunk->nr_populated;
+			if (nr_unpop)
+				break;
+		}
+		spin_unlock_irq(&pcpu_lock);
+
+		if (!nr_unpop)
+			continue;
+
+		/* @chunk can't go away while pcpu_alloc_mutex is held */
+		pcpu_for_each_unpop_region(chunk->populated, rs, re, 0,
+					   chunk->nr_pages) {
+			int nr = min(re - rs, nr_to_pop);
+
+			ret = pcpu_populate_chunk(chunk, rs, rs + nr, gfp);
+			if (!ret) {
+				nr_to_pop -= nr;
+				spin_lock_irq(&pcpu_lock);
+				pcpu_chunk_populated(chunk, rs, rs + nr, false);
+				pcpu_nr_balance_pop_pages += nr;
+				spin_unlock_irq(&pcpu_lock);
+			} else {
+				nr_to_pop = 0;
+			}
+
+			if (!nr_to_pop)
+				break;
+		}
+	}
+
+	if (nr_to_pop) {
+		/* ran out of chunks to populate, create a new one and retry */
+		chunk = pcpu_create_chunk(gfp);
+		if (chunk) {
+			spin_lock_irq(&pcpu_lock);
+			pcpu_chunk_relocate(chunk, -1);
+			spin_unlock_irq(&pcpu_lock);
+			goto retry_pop;
+		}
+	}
+
+	spin_lock_irq(&pcpu_lock);
+	pcpu_nr_balance_runs++;
+	pcpu_nr_balance_freed_chunks += nr_freed;
+	spin_unlock_irq(&pcpu_lock);
+}
+
+/**
+ * pcpu_balance_workfn - run percpu balance work
+ * @none: unused
+ *
+ * Body of the "percpu_balance" kthread.  Sleeps until
+ * pcpu_schedule_balance_work() flags work, then runs pcpu_balance().
+ */
+static int pcpu_balance_workfn(void *none)
+{
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+		if (!READ_ONCE(pcpu_balance_pending)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		WRITE_ONCE(pcpu_balance_pending, false);
+		mutex_lock(&pcpu_alloc_mutex);
+		pcpu_balance();
+		mutex_unlock(&pcpu_alloc_mutex);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+static int __init pcpu_balance_init(void)
+{
+	struct task_struct *k;
+
+	k = kthread_run(pcpu_balance_workfn, NULL, "percpu_balance");
+	if (IS_ERR(k)) {
+		pr_err("failed to start the balance thread: %ld\n",
+		       PTR_ERR(k));
+		return PTR_ERR(k);
+	}
+	pcpu_balance_thread = k;
+
+	return 0;
+}
+subsys_initcall(pcpu_balance_init);
+
 /**
  * free_percpu - free percpu area
  * @ptr: pointer to area to free
@@ -1525,25 +2048,14 @@ void free_percpu(void __percpu *ptr)
 		return;
 
 	addr = __pcpu_ptr_to_addr(ptr);
-
-	spin_lock_irqsave(&pcpu_lock, flags);
-
 	chunk = pcpu_chunk_addr_search(addr);
-	off = addr - chunk->base_addr;
-
-	pcpu_free_area(chunk, off);
-
-	/* if there are more than one fully free chunks, wake up grim reaper */
-	if (chunk->free_bytes == pcpu_unit_size) {
-		struct pcpu_chunk *pos;
 
-		list_for_each_entry(pos, &pcpu_slot[pcpu_nr_slots - 1], list)
-			if (pos != chunk) {
-				pcpu_schedule_balance_work();
-				break;
-			}
-	}
+	if (pcpu_cache_free(chunk, addr))
+		return;
 
+	spin_lock_irqsave(&pcpu_lock, flags);
+	off = addr - chunk->base_addr;
+	pcpu_release_area(chunk, off);
 	spin_unlock_irqrestore(&pcpu_lock, flags);
 }
 
@@ -2396,3 +2908,226 @@ unsigned long pcpu_nr_pages(void)
 {
 	return pcpu_nr_populated * pcpu_nr_units;
 }
+
+/**
+ * show_percpu_numa_stats - report where percpu memory sits
+ *
+ * Count, per node, the pages backing the first chunk and the populated
+ * pages of the dynamic chunks, along with the units (a cpu's share of a
+ * chunk) that have any page off their cpu's node.
+ */
+void show_percpu_numa_stats(void)
+{
+	unsigned long remote_first = 0, remote_dyn = 0;
+	unsigned long *first_pages, *dyn_pages;
+	struct pcpu_chunk *chunk;
+	int slot, nid, i, nr_chunks = 0;
+	unsigned long flags;
+	unsigned int cpu;
+	bool remote;
+
+	first_pages = kcalloc(2 * MAX_NUMNODES, sizeof(*first_pages),
+			      GFP_KERNEL);
+	if (!first_pages)
+		return;
+	dyn_pages = first_pages + MAX_NUMNODES;
+
+	/* the first chunk is embedded in the linear map */
+	for_each_possible_cpu(cpu) {
+		void *unit = pcpu_base_addr + pcpu_unit_offsets[cpu];
+
+		remote = false;
+		for (i = 0; i < pcpu_unit_pages; i++) {
+			nid = page_to_nid(virt_to_page(unit + i * PAGE_SIZE));
+			first_pages[nid]++;
+			remote |= nid != pcpu_unit_node(cpu);
+		}
+		remote_first += remote;
+	}
+
+	spin_lock_irqsave(&pcpu_lock, flags);
+	for (slot = 0; slot < pcpu_nr_slots; slot++) {
+		list_for_each_entry(chunk, &pcpu_slot[slot], list) {
+			if (chunk == pcpu_first_chunk)
+				continue;
+			nr_chunks++;
+
+			for_each_possible_cpu(cpu) {
+				remote = false;
+				for_each_set_bit(i, chunk->populated,
+						 chunk->nr_pages) {
+					void *addr = (void *)pcpu_chunk_addr(chunk,
+									cpu, i);
+
+					nid = page_to_nid(pcpu_addr_to_page(addr));
+					dyn_pages[nid]++;
+					remote |= nid != pcpu_unit_node(cpu);
+				}
+				remote_dyn += remote;
+			}
+		}
+	}
+	spin_unlock_irqrestore(&pcpu_lock, flags);
+
+	for_each_online_node(nid)
+		pr_info("percpu: node %d: first chunk %lu pages, dynamic chunks %lu pages\n",
+			nid, first_pages[nid], dyn_pages[nid]);
+	pr_info("percpu: remote units: first chunk %lu of %u, %d dynamic chunks %lu of %lu\n",
+		remote_first, nr_possible_cpu_ids, nr_chunks, remote_dyn,
+		(unsigned long)nr_chunks * nr_possible_cpu_ids);
+
+	kfree(first_pages);
+}
+
+/**
+ * show_percpu_stats - report on the reserve kept for atomic allocations
+ */
+void show_percpu_stats(void)
+{
+	unsigned long hits = 0, misses = 0, flags;
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct pcpu_area_cache *cache = per_cpu_ptr(&pcpu_area_cache, cpu);
+
+		hits += cache->hits;
+		misses += cache->misses;
+	}
+
+	spin_lock_irqsave(&pcpu_lock, flags);
+	pr_info("percpu: reserve %d empty populated pages (low %d, high %d), %lu populated pages in use\n",
+		pcpu_nr_empty_pop_pages, pcpu_reserve_low, pcpu_reserve_high,
+		pcpu_nr_populated);
+	pr_info("percpu: atomic allocs %lu failed %lu, balance runs %lu populated %lu pages freed %lu chunks\n",
+		pcpu_nr_atomic_allocs, READ_ONCE(pcpu_nr_atomic_fails),
+		pcpu_nr_balance_runs, pcpu_nr_balance_pop_pages,
+		pcpu_nr_balance_freed_chunks);
+	pr_info("percpu: area cache %s, hits %lu misses %lu\n",
+		pcpu_cache_enabled ? "enabled" : "disabled", hits, misses);
+	spin_unlock_irqrestore(&pcpu_lock, flags);
+}
+
+#ifdef CONFIG_TEST_PERCPU
+#include <linux/boot_test.h>
+
+/* Rejected without touching the chunks, and without a warning */
+static void __init percpu_test_illegal(struct boot_test *t)
+{
+	gfp_t gfp = GFP_KERNEL | __GFP_NOWARN;
+
+	BOOT_TEST_EXPECT(t, !__alloc_percpu_gfp(0, 8, gfp));
+	BOOT_TEST_EXPECT(t, !__alloc_percpu_gfp(PCPU_MIN_UNIT_SIZE + 1, 8,
+						gfp));
+	BOOT_TEST_EXPECT(t, !__alloc_percpu_gfp(64, 24, gfp));
+	BOOT_TEST_EXPECT(t, !__alloc_percpu_gfp(64, 2 * PAGE_SIZE, gfp));
+}
+
+/* An area handed back by the area cache is zeroed on every cpu */
+static void __init percpu_test_recycle(struct boot_test *t)
+{
+	void __percpu *ptr;
+	unsigned int cpu;
+	bool zeroed = true;
+
+	ptr = __alloc_percpu(64, 64);
+	if (!BOOT_TEST_EXPECT(t, ptr))
+		return;
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(ptr, cpu), 0xa5, 64);
+	free_percpu(ptr);
+
+	ptr = __alloc_percpu(64, 64);
+	if (!BOOT_TEST_EXPECT(t, ptr))
+		return;
+	for_each_possible_cpu(cpu)
+		zeroed &= !memchr_inv(per_cpu_ptr(ptr, cpu), 0, 64);
+	BOOT_TEST_EXPECT(t, zeroed);
+	free_percpu(ptr);
+}
+
+/* Take every free page of @nid, largest blocks first */
+static void __init percpu_test_exhaust_node(int nid, struct list_head *hoard)
+{
+	struct page *page;
+	int order;
+
+	for (order = MAX_ORDER - 1; order >= 0; order--) {
+		while ((page = alloc_pages_node(nid, GFP_NOWAIT |
+				__GFP_THISNODE | __GFP_NOWARN, order))) {
+			set_page_private(page, order);
+			list_add(&page->lru, hoard);
+		}
+	}
+}
+
+static void __init percpu_test_release_node(struct list_head *hoard)
+{
+	struct page *page, *next;
+
+	list_for_each_entry_safe(page, next, hoard, lru) {
+		list_del(&page->lru);
+		__free_pages(page, page_private(page));
+	}
+}
+
+/*
+ * With the node of some cpus out of memory, populating a page for all
+ * units must neither fail nor reclaim: the units of those cpus are
+ * backed from other nodes, everybody else's stay local.
+ */
+static void __init percpu_test_node_exhausted(struct boot_test *t)
+{
+	LIST_HEAD(hoard);
+	struct page **pages;
+	unsigned int cpu;
+	int victim = NUMA_NO_NODE, nid, ret;
+	bool moved = true, local = true;
+
+	/* Starve a node with cpus that isn't the one running the test */
+	for_each_possible_cpu(cpu) {
+		nid = pcpu_unit_node(cpu);
+		if (nid != numa_node_id() && node_online(nid)) {
+			victim = nid;
+			break;
+		}
+	}
+	if (victim == NUMA_NO_NODE) {
+		pr_info("%s: single node, skipping node exhaustion\n",
+			t->name);
+		return;
+	}
+
+	mutex_lock(&pcpu_alloc_mutex);
+	pages = pcpu_get_pages();
+	if (!BOOT_TEST_EXPECT(t, pages)) {
+		mutex_unlock(&pcpu_alloc_mutex);
+		return;
+	}
+
+	percpu_test_exhaust_node(victim, &hoard);
+	ret = pcpu_alloc_pages(NULL, pages, 0, 1, GFP_KERNEL);
+	percpu_test_release_node(&hoard);
+
+	if (BOOT_TEST_EXPECT(t, !ret)) {
+		for_each_possible_cpu(cpu) {
+			nid = page_to_nid(pages[pcpu_page_idx(cpu, 0)]);
+			if (pcpu_unit_node(cpu) == victim)
+				moved &= nid != victim;
+			else
+				local &= nid == pcpu_unit_node(cpu);
+		}
+		BOOT_TEST_EXPECT(t, moved);
+		BOOT_TEST_EXPECT(t, local);
+		pcpu_free_pages(NULL, pages, 0, 1);
+	}
+	mutex_unlock(&pcpu_alloc_mutex);
+}
+
+static void __init percpu_test(struct boot_test *t)
+{
+	percpu_test_illegal(t);
+	percpu_test_recycle(t);
+	percpu_test_node_exhausted(t);
+}
+boot_test(percpu_test);
+#endif /* CONFIG_TEST_PERCPU */
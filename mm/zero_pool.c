@@ -0,0 +1,222 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * mm/zero_pool.c
+ *
+ * Pool of pages zeroed ahead of time by idle CPUs.
+ *
+ * Every order-0 __GFP_ZERO allocation used to pay for a clear_page()
+ * on the allocating CPU. Instead, whenever a CPU has nothing to run
+ * the idle loop calls zero_pool_refill(), which takes free pages from
+ * the CPU's own node, zeroes them with clear_page() (DC ZVA where the
+ * CPU permits it) and parks them on a per-node list. The allocator
+ * hands those out first and only falls back to the buddy lists and an
+ * explicit clear when the pool is empty. When the buddy lists run dry
+ * the pool is given back with zero_pool_drain() before the allocation
+ * is failed.
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/sched/clock.h>
+#include <linux/spinlock.h>
+
+#include "internal.h"
+
+/* Pages zeroed per refill call, bounds the time spent with a resched pending */
+#define ZERO_POOL_BATCH		16
+
+static unsigned long zero_pool_pages __read_mostly = 256;
+
+static int __init zero_pool_pages_setup(char *str)
+{
+	if (!str)
+		return -EINVAL;
+
+	/* zero_pool_pages=0 disables the pool altogether */
+	zero_pool_pages = memparse(str, &str) >> PAGE_SHIFT;
+
+	return 0;
+}
+early_param("zero_pool_pages", zero_pool_pages_setup);
+
+struct zero_pool_stat {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long zeroed;
+	unsigned long zero_ns;
+	unsigned long drained;
+};
+
+static DEFINE_PER_CPU(struct zero_pool_stat, zero_pool_stats);
+
+/*
+ * Never park more than 1/64th of a node in the pool, and stop refilling
+ * once the node's free memory drops to twice the pool size so that the
+ * pool never competes with real allocations.
+ */
+static unsigned long zero_pool_limit(pg_data_t *pgdat)
+{
+	return min(zero_pool_pages, pgdat->node_present_pages >> 6);
+}
+
+static unsigned long node_nr_free_pages(pg_data_t *pgdat)
+{
+	unsigned long nr_free = 0;
+	unsigned int order;
+	int i;
+
+	/* Racy, but only used as a refill heuristic */
+	for (i = 0; i < pgdat->nr_zones; i++) {
+		struct zone *zone = &pgdat->node_zones[i];
+
+		for (order = 0; order < MAX_ORDER; order++)
+			nr_free += READ_ONCE(zone->free_area[order].nr_free)
+					<< order;
+	}
+
+	return nr_free;
+}
+
+/*
+ * Take a pre-zeroed page from node @nid. The page has already been
+ * through prep_new_page(), so it is returned with a reference held.
+ */
+struct page *zero_pool_get(int nid, gfp_t gfp_mask)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	struct page *page = NULL;
+	unsigned long flags;
+
+	/* Pool pages may come from any zone of the node */
+	if (gfp_mask & __GFP_DMA)
+		return NULL;
+
+	if (READ_ONCE(pgdat->nr_zero_pool)) {
+		spin_lock_irqsave(&pgdat->zero_pool_lock, flags);
+		page = list_first_entry_or_null(&pgdat->zero_pool,
+						struct page, lru);
+		if (page) {
+			list_del(&page->lru);
+			pgdat->nr_zero_pool--;
+		}
+		spin_unlock_irqrestore(&pgdat->zero_pool_lock, flags);
+	}
+
+	if (page)
+		this_cpu_inc(zero_pool_stats.hits);
+	else
+		this_cpu_inc(zero_pool_stats.misses);
+
+	return page;
+}
+
+/*
+ * Return every pooled page of node @nid to the buddy allocator.
+ * Called when an order-0 allocation that may reclaim could not be
+ * satisfied otherwise, never from the refill.
+ */
+unsigned long zero_pool_drain(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	struct page *page, *next;
+	unsigned long flags, nr;
+	LIST_HEAD(pages);
+
+	if (!READ_ONCE(pgdat->nr_zero_pool))
+		return 0;
+
+	spin_lock_irqsave(&pgdat->zero_pool_lock, flags);
+	list_splice_init(&pgdat->zero_pool, &pages);
+	nr = pgdat->nr_zero_pool;
+	pgdat->nr_zero_pool = 0;
+	spin_unlock_irqrestore(&pgdat->zero_pool_lock, flags);
+
+	list_for_each_entry_safe(page, next, &pages, lru) {
+		list_del(&page->lru);
+		__free_page(page);
+	}
+
+	this_cpu_add(zero_pool_stats.drained, nr);
+	return nr;
+}
+
+/*
+ * Zero up to ZERO_POOL_BATCH pages for the local node. Called from the
+ * idle loop with interrupts enabled; backs off as soon as there is
+ * something else to run. Returns true if any page was added, in which
+ * case the caller should call again rather than go to sleep.
+ */
+bool zero_pool_refill(void)
+{
+	int nid = this_cpu_numa_node_id();
+	pg_data_t *pgdat = NODE_DATA(nid);
+	unsigned long limit, flags;
+	struct zero_pool_stat *stat;
+	struct page *page;
+	LIST_HEAD(pages);
+	u64 start;
+	int nr = 0, batch;
+
+	limit = zero_pool_limit(pgdat);
+	if (READ_ONCE(pgdat->nr_zero_pool) >= limit)
+		return false;
+	if (node_nr_free_pages(pgdat) < 2 * limit)
+		return false;
+
+	batch = min_t(unsigned long, ZERO_POOL_BATCH,
+		      limit - READ_ONCE(pgdat->nr_zero_pool));
+
+	start = sched_clock();
+	while (nr < batch && !need_resched()) {
+		page = alloc_pages_node(nid, GFP_NOWAIT | __GFP_THISNODE |
+					__GFP_NOWARN, 0);
+		if (!page)
+			break;
+		clear_page(page_address(page));
+		list_add(&page->lru, &pages);
+		nr++;
+	}
+
+	if (!nr)
+		return false;
+
+	spin_lock_irqsave(&pgdat->zero_pool_lock, flags);
+	list_splice(&pages, &pgdat->zero_pool);
+	pgdat->nr_zero_pool += nr;
+	spin_unlock_irqrestore(&pgdat->zero_pool_lock, flags);
+
+	preempt_disable();
+	stat = this_cpu_ptr(&zero_pool_stats);
+	stat->zeroed += nr;
+	stat->zero_ns += sched_clock() - start;
+	preempt_enable();
+
+	return true;
+}
+
+void show_zero_pool_stats(void)
+{
+	unsigned long hits = 0, misses = 0, zeroed = 0, zero_ns = 0;
+	unsigned long drained = 0;
+	int cpu, nid;
+
+	for_each_possible_cpu(cpu) {
+		struct zero_pool_stat *stat = per_cpu_ptr(&zero_pool_stats, cpu);
+
+		hits += stat->hits;
+		misses += stat->misses;
+		zeroed += stat->zeroed;
+		zero_ns += stat->zero_ns;
+		drained += stat->drained;
+	}
+
+	for_each_online_node(nid)
+		pr_info("zero pool: node %d: %lu of %lu pages\n", nid,
+			NODE_DATA(nid)->nr_zero_pool,
+			zero_pool_limit(NODE_DATA(nid)));
+	pr_info("zero pool: hits: %lu misses: %lu zeroed: %lu (avg %lu ns/page) drained: %lu\n",
+		hits, misses, zeroed, zeroed ? zero_ns / zeroed : 0, drained);
+}
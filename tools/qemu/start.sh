@@ -1,21 +1,36 @@
 #!/bin/sh
 
-qemu-system-aarch64 -cpu cortex-a57 -machine type=virt,gic-version=2 	\
+# GIC=3 ./start.sh boots 16 cpus on a GICv3, which is not limited to 8
+# cpus like GICv2. Cpus 8-15 go to the same nodes as the first 8.
+GIC=${GIC:-2}
+
+if [ "$GIC" = 3 ]; then
+	SMP="cores=8,threads=2"
+	NODE0=",cpus=8-9"
+	NODE1=",cpus=10-11"
+	NODE2=",cpus=12"
+	NODE3=",cpus=13-14"
+	NODE4=",cpus=15"
+else
+	SMP="cores=4,threads=2"
+fi
+
+qemu-system-aarch64 -cpu cortex-a57 -machine type=virt,gic-version=$GIC 	\
 		-append "rdinit=/linuxrc console=ttyAMA0 earlycon=115200"	\
 		-kernel ../../arch/arm64/boot/Image	\
 		-device virtio-scsi-device	\
-		-smp cores=4,threads=2	\
+		-smp $SMP	\
 		-m 4G	\
         -object memory-backend-ram,id=mem0,size=1G \
         -object memory-backend-ram,id=mem1,size=512M \
         -object memory-backend-ram,id=mem2,size=256M \
         -object memory-backend-ram,id=mem3,size=2G \
 		-object memory-backend-ram,id=mem4,size=256M \
-		-numa node,memdev=mem0,cpus=5-6,nodeid=0 \
-        -numa node,memdev=mem1,cpus=3,cpus=7,nodeid=1 \
-		-numa node,memdev=mem2,cpus=4,nodeid=2 \
-        -numa node,memdev=mem3,cpus=0-1,nodeid=3 \
-		-numa node,memdev=mem4,cpus=2,nodeid=4 \
+		-numa node,memdev=mem0,cpus=5-6$NODE0,nodeid=0 \
+        -numa node,memdev=mem1,cpus=3,cpus=7$NODE1,nodeid=1 \
+		-numa node,memdev=mem2,cpus=4$NODE2,nodeid=2 \
+        -numa node,memdev=mem3,cpus=0-1$NODE3,nodeid=3 \
+		-numa node,memdev=mem4,cpus=2$NODE4,nodeid=4 \
 		-numa dist,src=0,dst=0,val=10	\
 		-numa dist,src=0,dst=1,val=15	\
 		-numa dist,src=0,dst=2,val=20	\